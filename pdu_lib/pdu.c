@@ -12,11 +12,22 @@
 #include "pdu.h"
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 
+// PDU_SCALAR_ONLY builds the portable transcoder only; pdu_test uses it as
+// the reference for the SIMD paths.
+#if defined(__SSE2__) && !defined(PDU_SCALAR_ONLY)
+#define PDU_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(PDU_SCALAR_ONLY)
+#define PDU_NEON 1
+#include <arm_neon.h>
+#endif
+
 enum {
 	BITMASK_7BITS = 0x7F,
 	BITMASK_8BITS = 0xFF,
@@ -30,12 +41,18 @@ enum {
 
 	SMS_DELIVER_ONE_MESSAGE = 0x04,
 	SMS_SUBMIT              = 0x11,
+	SMS_STATUS_REPORT_REQUEST = 0x20,
+	SMS_MTI_MASK            = 0x03,
+	SMS_MTI_DELIVER         = 0x00,
+	SMS_MTI_SUBMIT          = 0x01,
+	SMS_MTI_STATUS_REPORT   = 0x02,
+	SMS_UDHI                = 0x40,
 
 	SMS_MAX_7BIT_TEXT_LENGTH  = 160,
 	SMS_MAX_UCS2_TEXT_LENGTH  = 70,
-	SMS_MAX_7BIT_PART_LENGTH  = 153,
-	SMS_MAX_UCS2_PART_LENGTH  = 67,
 	SMS_CONCAT_UDH_LENGTH     = 6,
+	SMS_CONCAT16_UDH_LENGTH   = 7,
+	SMS_MAX_UDH_LENGTH        = 13,
 };
 
 // Swap decimal digits of a number (e.g. 12 -> 21).
@@ -62,38 +79,137 @@ SwapDecimalNibble(const unsigned char x)
 // E8       32       9B       FD       46       97       D9       EC       37
 
 
-// Encode PDU message by merging 7 bit ASCII characters into 8 bit octets.
+// Fold the low 7 bits of 8 bytes into a 56-bit word, first septet in the
+// lowest bits: 7-bit pairs into 14-bit halves, then 28-bit and 56-bit.
+static uint64_t
+PackEightSeptets(const unsigned char* septets)
+{
+	uint64_t v;
+
+	memcpy(&v, septets, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	v &= 0x7F7F7F7F7F7F7F7FULL;
+	v = ((v & 0x7F007F007F007F00ULL) >> 1) | (v & 0x007F007F007F007FULL);
+	v = ((v & 0x3FFF00003FFF0000ULL) >> 2) | (v & 0x00003FFF00003FFFULL);
+	v = ((v & 0x0FFFFFFF00000000ULL) >> 4) | (v & 0x000000000FFFFFFFULL);
+	return v;
+}
+
+// Pack septets 8 at a time into 7 octets, starting fill_bits into the
+// first octet.
 int
-EncodePDUMessage(const char* sms_text, int sms_text_length, unsigned char* output_buffer, int buffer_size)
+pdu_pack_septets(const unsigned char* septets, int count, int fill_bits,
+		 unsigned char* output_buffer, int buffer_size)
 {
-	if (sms_text_length < 0)
+	if (count < 0 || fill_bits < 0 || fill_bits > 6)
 		return -1;
-	if (sms_text_length == 0)
-		return 0;
-
-	// Check if output buffer is big enough.
-	if ((sms_text_length * 7 + 7) / 8 > buffer_size)
+	const int output_length = (fill_bits + count * 7 + 7) / 8;
+	if (output_length > buffer_size)
 		return -1;
 
-	int output_buffer_length = 0;
-	int carry_on_bits = 1;
+	uint64_t carry = 0;
 	int i = 0;
+	int o = 0;
+	for (; i + 8 <= count; i += 8) {
+		const uint64_t word = (PackEightSeptets(septets + i) << fill_bits) |
+			carry;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		const uint64_t octets = __builtin_bswap64(word);
+#else
+		const uint64_t octets = word;
+#endif
+		memcpy(output_buffer + o, &octets, 7);
+		o += 7;
+		carry = word >> 56;
+	}
 
-	for (; i < sms_text_length - 1; ++i) {
-		output_buffer[output_buffer_length++] =
-			((sms_text[i] & BITMASK_7BITS) >> (carry_on_bits - 1)) |
-			((sms_text[i + 1] & BITMASK_7BITS) << (8 - carry_on_bits));
-		carry_on_bits++;
-		if (carry_on_bits == 8) {
-			carry_on_bits = 1;
-			++i;
-		}
+	if (i < count) {
+		unsigned char tail[8] = { 0 };
+		memcpy(tail, septets + i, count - i);
+		carry |= PackEightSeptets(tail) << fill_bits;
 	}
+	for (; o < output_length; carry >>= 8)
+		output_buffer[o++] = carry;
+
+	return output_length;
+}
 
-	if (i <= sms_text_length)
-		output_buffer[output_buffer_length++] =	(sms_text[i] & BITMASK_7BITS) >> (carry_on_bits - 1);
+// Encode PDU message by merging 7 bit ASCII characters into 8 bit octets.
+int
+EncodePDUMessage(const char* sms_text, int sms_text_length, unsigned char* output_buffer, int buffer_size)
+{
+	return pdu_pack_septets((const unsigned char*)sms_text, sms_text_length,
+				0, output_buffer, buffer_size);
+}
 
-	return output_buffer_length;
+// Spread a 56-bit word into 8 bytes of one septet each, the inverse of
+// PackEightSeptets(): 28-bit halves, then 14-bit and 7-bit.
+static uint64_t
+SpreadSeptets(uint64_t v)
+{
+	v = ((v & 0x00FFFFFFF0000000ULL) << 4) | (v & 0x000000000FFFFFFFULL);
+	v = ((v & 0x0FFFC0000FFFC000ULL) << 2) | (v & 0x00003FFF00003FFFULL);
+	v = ((v & 0x3F803F803F803F80ULL) << 1) | (v & 0x007F007F007F007FULL);
+	return v;
+}
+
+static void
+UnpackEightSeptets(uint64_t v, unsigned char* septets)
+{
+	v = SpreadSeptets(v);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(septets, &v, sizeof(v));
+}
+
+// Load up to 8 octets as a little-endian word, zero-padding a short tail.
+static uint64_t
+LoadOctets(const unsigned char* octets, int length)
+{
+	unsigned char tail[8] = { 0 };
+	uint64_t v;
+
+	if (length >= 8) {
+		memcpy(&v, octets, sizeof(v));
+	} else {
+		memcpy(tail, octets, length);
+		memcpy(&v, tail, sizeof(v));
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+// Unpack septets 8 at a time from 7 octets, skipping fill_bits of the
+// first octet. Stops early when the input runs out.
+int
+pdu_unpack_septets(const unsigned char* packed, int packed_length,
+		   int fill_bits, unsigned char* septets, int count)
+{
+	if (count < 0 || packed_length < 0 || fill_bits < 0 || fill_bits > 6)
+		return -1;
+	const int available = (packed_length * 8 - fill_bits) / 7;
+	if (count > available)
+		count = available > 0 ? available : 0;
+
+	int i = 0;
+	int o = 0;
+	for (; i + 8 <= count; i += 8, o += 7)
+		UnpackEightSeptets(LoadOctets(packed + o, packed_length - o) >>
+				   fill_bits, septets + i);
+
+	if (i < count) {
+		unsigned char spread[8];
+		UnpackEightSeptets(LoadOctets(packed + o, packed_length - o) >>
+				   fill_bits, spread);
+		memcpy(septets + i, spread, count - i);
+	}
+
+	return count;
 }
 
 // Decode PDU message by splitting 8 bit encoded buffer into 7 bit ASCII
@@ -101,100 +217,1510 @@ EncodePDUMessage(const char* sms_text, int sms_text_length, unsigned char* outpu
 int
 DecodePDUMessage_GSM_7bit(const unsigned char* buffer, int buffer_length, char* output_sms_text, int sms_text_length)
 {
-	int output_text_length = 0;
-	if (buffer_length > 0)
-		output_sms_text[output_text_length++] = BITMASK_7BITS & buffer[0];
+	return pdu_unpack_septets(buffer, buffer_length, 0,
+				  (unsigned char*)output_sms_text,
+				  sms_text_length);
+}
 
-	if (sms_text_length > 1) {
-		int carry_on_bits = 1;
-		int i = 1;
-		for (; i < buffer_length; ++i) {
+#define  GSM_7BITS_ESCAPE   0x1b
 
-			output_sms_text[output_text_length++] = BITMASK_7BITS &	((buffer[i] << carry_on_bits) | (buffer[i - 1] >> (8 - carry_on_bits)));
+enum {
+	SMS_LANGUAGE_DEFAULT    = 0,
+	SMS_LANGUAGE_TURKISH    = 1,
+	SMS_LANGUAGE_SPANISH    = 2,
+	SMS_LANGUAGE_PORTUGUESE = 3,
+	SMS_LANGUAGE_BENGALI    = 4,
+	SMS_LANGUAGE_GUJARATI   = 5,
+	SMS_LANGUAGE_HINDI      = 6,
+	SMS_LANGUAGE_KANNADA    = 7,
+	SMS_LANGUAGE_MALAYALAM  = 8,
+	SMS_LANGUAGE_ORIYA      = 9,
+	SMS_LANGUAGE_PUNJABI    = 10,
+	SMS_LANGUAGE_TAMIL      = 11,
+	SMS_LANGUAGE_TELUGU     = 12,
+	SMS_LANGUAGE_URDU       = 13,
+	SMS_LANGUAGE_COUNT      = 14,
+};
 
-			if (output_text_length == sms_text_length) break;
+// GSM 7 bit default alphabet (3GPP TS 23.038 6.2.1) and the national
+// language tables of annex A as UTF-8, so that decoding is a copy per
+// character. Unassigned characters have length 0.
+struct utf8_char {
+	char bytes[3];
+	unsigned char length;
+};
 
-			carry_on_bits++;
+static const struct utf8_char gsm7bits_to_utf8[128] = {
+	{ "@", 1 },          { "\xC2\xA3", 2 },   { "$", 1 },          { "\xC2\xA5", 2 },
+	{ "\xC3\xA8", 2 },   { "\xC3\xA9", 2 },   { "\xC3\xB9", 2 },   { "\xC3\xAC", 2 },
+	{ "\xC3\xB2", 2 },   { "\xC3\x87", 2 },   { "\n", 1 },         { "\xC3\x98", 2 },
+	{ "\xC3\xB8", 2 },   { "\r", 1 },         { "\xC3\x85", 2 },   { "\xC3\xA5", 2 },
+	{ "\xCE\x94", 2 },   { "_", 1 },          { "\xCE\xA6", 2 },   { "\xCE\x93", 2 },
+	{ "\xCE\x9B", 2 },   { "\xCE\xA9", 2 },   { "\xCE\xA0", 2 },   { "\xCE\xA8", 2 },
+	{ "\xCE\xA3", 2 },   { "\xCE\x98", 2 },   { "\xCE\x9E", 2 },   { "", 0 },
+	{ "\xC3\x86", 2 },   { "\xC3\xA6", 2 },   { "\xC3\x9F", 2 },   { "\xC3\x89", 2 },
+	{ " ", 1 },          { "!", 1 },          { "\"", 1 },         { "#", 1 },
+	{ "\xC2\xA4", 2 },   { "%", 1 },          { "&", 1 },          { "'", 1 },
+	{ "(", 1 },          { ")", 1 },          { "*", 1 },          { "+", 1 },
+	{ ",", 1 },          { "-", 1 },          { ".", 1 },          { "/", 1 },
+	{ "0", 1 },          { "1", 1 },          { "2", 1 },          { "3", 1 },
+	{ "4", 1 },          { "5", 1 },          { "6", 1 },          { "7", 1 },
+	{ "8", 1 },          { "9", 1 },          { ":", 1 },          { ";", 1 },
+	{ "<", 1 },          { "=", 1 },          { ">", 1 },          { "?", 1 },
+	{ "\xC2\xA1", 2 },   { "A", 1 },          { "B", 1 },          { "C", 1 },
+	{ "D", 1 },          { "E", 1 },          { "F", 1 },          { "G", 1 },
+	{ "H", 1 },          { "I", 1 },          { "J", 1 },          { "K", 1 },
+	{ "L", 1 },          { "M", 1 },          { "N", 1 },          { "O", 1 },
+	{ "P", 1 },          { "Q", 1 },          { "R", 1 },          { "S", 1 },
+	{ "T", 1 },          { "U", 1 },          { "V", 1 },          { "W", 1 },
+	{ "X", 1 },          { "Y", 1 },          { "Z", 1 },          { "\xC3\x84", 2 },
+	{ "\xC3\x96", 2 },   { "\xC3\x91", 2 },   { "\xC3\x9C", 2 },   { "\xC2\xA7", 2 },
+	{ "\xC2\xBF", 2 },   { "a", 1 },          { "b", 1 },          { "c", 1 },
+	{ "d", 1 },          { "e", 1 },          { "f", 1 },          { "g", 1 },
+	{ "h", 1 },          { "i", 1 },          { "j", 1 },          { "k", 1 },
+	{ "l", 1 },          { "m", 1 },          { "n", 1 },          { "o", 1 },
+	{ "p", 1 },          { "q", 1 },          { "r", 1 },          { "s", 1 },
+	{ "t", 1 },          { "u", 1 },          { "v", 1 },          { "w", 1 },
+	{ "x", 1 },          { "y", 1 },          { "z", 1 },          { "\xC3\xA4", 2 },
+	{ "\xC3\xB6", 2 },   { "\xC3\xB1", 2 },   { "\xC3\xBC", 2 },   { "\xC3\xA0", 2 },
+};
 
-			if (carry_on_bits == 8) {
-				carry_on_bits = 1;
-				output_sms_text[output_text_length++] = buffer[i] & BITMASK_7BITS;
-				if (output_text_length == sms_text_length) break;
-			}
+// Default alphabet extension table (6.2.1.1).
+static const struct utf8_char gsm7bits_extend_to_utf8[128] = {
+	[0x0A] = { "\f", 1 },
+	[0x14] = { "^", 1 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
 
-		}
-		if (output_text_length < sms_text_length)  // Add last remainder.
-			output_sms_text[output_text_length++] =	buffer[i - 1] >> (8 - carry_on_bits);
-	}
+// Turkish national language locking shift table (A.3.1).
+static const struct utf8_char turkish_locking_shift_utf8[128] = {
+	{ "@", 1 },          { "\xC2\xA3", 2 },   { "$", 1 },          { "\xC2\xA5", 2 },
+	{ "\xE2\x82\xAC", 3 }, { "\xC3\xA9", 2 },   { "\xC3\xB9", 2 },   { "\xC4\xB1", 2 },
+	{ "\xC3\xB2", 2 },   { "\xC3\x87", 2 },   { "\n", 1 },         { "\xC4\x9E", 2 },
+	{ "\xC4\x9F", 2 },   { "\r", 1 },         { "\xC3\x85", 2 },   { "\xC3\xA5", 2 },
+	{ "\xCE\x94", 2 },   { "_", 1 },          { "\xCE\xA6", 2 },   { "\xCE\x93", 2 },
+	{ "\xCE\x9B", 2 },   { "\xCE\xA9", 2 },   { "\xCE\xA0", 2 },   { "\xCE\xA8", 2 },
+	{ "\xCE\xA3", 2 },   { "\xCE\x98", 2 },   { "\xCE\x9E", 2 },   { "", 0 },
+	{ "\xC5\x9E", 2 },   { "\xC5\x9F", 2 },   { "\xC3\x9F", 2 },   { "\xC3\x89", 2 },
+	{ " ", 1 },          { "!", 1 },          { "\"", 1 },         { "#", 1 },
+	{ "\xC2\xA4", 2 },   { "%", 1 },          { "&", 1 },          { "'", 1 },
+	{ "(", 1 },          { ")", 1 },          { "*", 1 },          { "+", 1 },
+	{ ",", 1 },          { "-", 1 },          { ".", 1 },          { "/", 1 },
+	{ "0", 1 },          { "1", 1 },          { "2", 1 },          { "3", 1 },
+	{ "4", 1 },          { "5", 1 },          { "6", 1 },          { "7", 1 },
+	{ "8", 1 },          { "9", 1 },          { ":", 1 },          { ";", 1 },
+	{ "<", 1 },          { "=", 1 },          { ">", 1 },          { "?", 1 },
+	{ "\xC4\xB0", 2 },   { "A", 1 },          { "B", 1 },          { "C", 1 },
+	{ "D", 1 },          { "E", 1 },          { "F", 1 },          { "G", 1 },
+	{ "H", 1 },          { "I", 1 },          { "J", 1 },          { "K", 1 },
+	{ "L", 1 },          { "M", 1 },          { "N", 1 },          { "O", 1 },
+	{ "P", 1 },          { "Q", 1 },          { "R", 1 },          { "S", 1 },
+	{ "T", 1 },          { "U", 1 },          { "V", 1 },          { "W", 1 },
+	{ "X", 1 },          { "Y", 1 },          { "Z", 1 },          { "\xC3\x84", 2 },
+	{ "\xC3\x96", 2 },   { "\xC3\x91", 2 },   { "\xC3\x9C", 2 },   { "\xC2\xA7", 2 },
+	{ "\xC3\xA7", 2 },   { "a", 1 },          { "b", 1 },          { "c", 1 },
+	{ "d", 1 },          { "e", 1 },          { "f", 1 },          { "g", 1 },
+	{ "h", 1 },          { "i", 1 },          { "j", 1 },          { "k", 1 },
+	{ "l", 1 },          { "m", 1 },          { "n", 1 },          { "o", 1 },
+	{ "p", 1 },          { "q", 1 },          { "r", 1 },          { "s", 1 },
+	{ "t", 1 },          { "u", 1 },          { "v", 1 },          { "w", 1 },
+	{ "x", 1 },          { "y", 1 },          { "z", 1 },          { "\xC3\xA4", 2 },
+	{ "\xC3\xB6", 2 },   { "\xC3\xB1", 2 },   { "\xC3\xBC", 2 },   { "\xC3\xA0", 2 },
+};
 
-	return output_text_length;
-}
+// Portuguese national language locking shift table (A.3.3).
+static const struct utf8_char portuguese_locking_shift_utf8[128] = {
+	{ "@", 1 },          { "\xC2\xA3", 2 },   { "$", 1 },          { "\xC2\xA5", 2 },
+	{ "\xC3\xAA", 2 },   { "\xC3\xA9", 2 },   { "\xC3\xBA", 2 },   { "\xC3\xAD", 2 },
+	{ "\xC3\xB3", 2 },   { "\xC3\xA7", 2 },   { "\n", 1 },         { "\xC3\x94", 2 },
+	{ "\xC3\xB4", 2 },   { "\r", 1 },         { "\xC3\x81", 2 },   { "\xC3\xA1", 2 },
+	{ "\xCE\x94", 2 },   { "_", 1 },          { "\xC2\xAA", 2 },   { "\xC3\x87", 2 },
+	{ "\xC3\x80", 2 },   { "\xE2\x88\x9E", 3 }, { "^", 1 },          { "\\", 1 },
+	{ "\xE2\x82\xAC", 3 }, { "\xC3\x93", 2 },   { "|", 1 },          { "", 0 },
+	{ "\xC3\x82", 2 },   { "\xC3\xA2", 2 },   { "\xC3\x8A", 2 },   { "\xC3\x89", 2 },
+	{ " ", 1 },          { "!", 1 },          { "\"", 1 },         { "#", 1 },
+	{ "\xC2\xBA", 2 },   { "%", 1 },          { "&", 1 },          { "'", 1 },
+	{ "(", 1 },          { ")", 1 },          { "*", 1 },          { "+", 1 },
+	{ ",", 1 },          { "-", 1 },          { ".", 1 },          { "/", 1 },
+	{ "0", 1 },          { "1", 1 },          { "2", 1 },          { "3", 1 },
+	{ "4", 1 },          { "5", 1 },          { "6", 1 },          { "7", 1 },
+	{ "8", 1 },          { "9", 1 },          { ":", 1 },          { ";", 1 },
+	{ "<", 1 },          { "=", 1 },          { ">", 1 },          { "?", 1 },
+	{ "\xC3\x8D", 2 },   { "A", 1 },          { "B", 1 },          { "C", 1 },
+	{ "D", 1 },          { "E", 1 },          { "F", 1 },          { "G", 1 },
+	{ "H", 1 },          { "I", 1 },          { "J", 1 },          { "K", 1 },
+	{ "L", 1 },          { "M", 1 },          { "N", 1 },          { "O", 1 },
+	{ "P", 1 },          { "Q", 1 },          { "R", 1 },          { "S", 1 },
+	{ "T", 1 },          { "U", 1 },          { "V", 1 },          { "W", 1 },
+	{ "X", 1 },          { "Y", 1 },          { "Z", 1 },          { "\xC3\x83", 2 },
+	{ "\xC3\x95", 2 },   { "\xC3\x9A", 2 },   { "\xC3\x9C", 2 },   { "\xC2\xA7", 2 },
+	{ "~", 1 },          { "a", 1 },          { "b", 1 },          { "c", 1 },
+	{ "d", 1 },          { "e", 1 },          { "f", 1 },          { "g", 1 },
+	{ "h", 1 },          { "i", 1 },          { "j", 1 },          { "k", 1 },
+	{ "l", 1 },          { "m", 1 },          { "n", 1 },          { "o", 1 },
+	{ "p", 1 },          { "q", 1 },          { "r", 1 },          { "s", 1 },
+	{ "t", 1 },          { "u", 1 },          { "v", 1 },          { "w", 1 },
+	{ "x", 1 },          { "y", 1 },          { "z", 1 },          { "\xC3\xA3", 2 },
+	{ "\xC3\xB5", 2 },   { "`", 1 },          { "\xC3\xBC", 2 },   { "\xC3\xA0", 2 },
+};
 
-#define  GSM_7BITS_ESCAPE   0x1b
+// Turkish national language single shift table (A.2.1).
+static const struct utf8_char turkish_single_shift_utf8[128] = {
+	[0x0A] = { "\f", 1 },
+	[0x14] = { "^", 1 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x47] = { "\xC4\x9E", 2 },
+	[0x49] = { "\xC4\xB0", 2 },
+	[0x53] = { "\xC5\x9E", 2 },
+	[0x63] = { "\xC3\xA7", 2 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+	[0x67] = { "\xC4\x9F", 2 },
+	[0x69] = { "\xC4\xB1", 2 },
+	[0x73] = { "\xC5\x9F", 2 },
+};
 
-static const unsigned char gsm7bits_to_latin1[128] = {
-  '@', 0xa3,  '$', 0xa5, 0xe8, 0xe9, 0xf9, 0xec, 0xf2, 0xc7, '\n', 0xd8, 0xf8, '\r', 0xc5, 0xe5,
-    0,  '_',    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0xc6, 0xe6, 0xdf, 0xc9,
-  ' ',  '!',  '"',  '#', 0xa4,  '%',  '&', '\'',  '(',  ')',  '*',  '+',  ',',  '-',  '.',  '/',
-  '0',  '1',  '2',  '3',  '4',  '5',  '6',  '7',  '8',  '9',  ':',  ';',  '<',  '=',  '>',  '?',
- 0xa1,  'A',  'B',  'C',  'D',  'E',  'F',  'G',  'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
-  'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',  'X',  'Y',  'Z', 0xc4, 0xd6, 0xd1, 0xdc, 0xa7,
- 0xbf,  'a',  'b',  'c',  'd',  'e',  'f',  'g',  'h',  'i',  'j',  'k',  'l',  'm',  'n',  'o',
-  'p',  'q',  'r',  's',  't',  'u',  'v',  'w',  'x',  'y',  'z', 0xe4, 0xf6, 0xf1, 0xfc, 0xe0,
-};
-
-static const unsigned char gsm7bits_extend_to_latin1[128] = {
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,'\f',   0,   0,   0,   0,   0,
-    0,   0,   0,   0, '^',   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-    0,   0,   0,   0,   0,   0,   0,   0, '{', '}',   0,   0,   0,   0,   0,'\\',
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, '[', '~', ']',   0,
-  '|',   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-};
-
-static const char* gsm7bits_to_utf8[128] = {
-    [0x10] = "\xCE\x94", // Δ
-    [0x12] = "\xCE\xA6", // Φ
-    [0x13] = "\xCE\x93", // Γ
-    [0x14] = "\xCE\x9B", // Λ
-    [0x15] = "\xCE\xA9", // Ω
-    [0x16] = "\xCE\xA0", // Π
-    [0x17] = "\xCE\xA8", // Ψ
-    [0x18] = "\xCE\xA3", // Σ
-    [0x19] = "\xCE\x98", // Θ
-    [0x1A] = "\xCE\x9E", // Ξ
+// Spanish national language single shift table (A.2.2).
+static const struct utf8_char spanish_single_shift_utf8[128] = {
+	[0x09] = { "\xC3\xA7", 2 },
+	[0x0A] = { "\f", 1 },
+	[0x14] = { "^", 1 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "\xC3\x81", 2 },
+	[0x49] = { "\xC3\x8D", 2 },
+	[0x4F] = { "\xC3\x93", 2 },
+	[0x55] = { "\xC3\x9A", 2 },
+	[0x61] = { "\xC3\xA1", 2 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+	[0x69] = { "\xC3\xAD", 2 },
+	[0x6F] = { "\xC3\xB3", 2 },
+	[0x75] = { "\xC3\xBA", 2 },
 };
 
+// Portuguese national language single shift table (A.2.3).
+static const struct utf8_char portuguese_single_shift_utf8[128] = {
+	[0x05] = { "\xC3\xAA", 2 },
+	[0x09] = { "\xC3\xA7", 2 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "\xC3\x94", 2 },
+	[0x0C] = { "\xC3\xB4", 2 },
+	[0x0E] = { "\xC3\x81", 2 },
+	[0x0F] = { "\xC3\xA1", 2 },
+	[0x12] = { "\xCE\xA6", 2 },
+	[0x13] = { "\xCE\x93", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xCE\xA9", 2 },
+	[0x16] = { "\xCE\xA0", 2 },
+	[0x17] = { "\xCE\xA8", 2 },
+	[0x18] = { "\xCE\xA3", 2 },
+	[0x19] = { "\xCE\x98", 2 },
+	[0x1F] = { "\xC3\x8A", 2 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "\xC3\x80", 2 },
+	[0x49] = { "\xC3\x8D", 2 },
+	[0x4F] = { "\xC3\x93", 2 },
+	[0x55] = { "\xC3\x9A", 2 },
+	[0x5B] = { "\xC3\x83", 2 },
+	[0x5C] = { "\xC3\x95", 2 },
+	[0x61] = { "\xC3\x82", 2 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+	[0x69] = { "\xC3\xAD", 2 },
+	[0x6F] = { "\xC3\xB3", 2 },
+	[0x75] = { "\xC3\xBA", 2 },
+	[0x7B] = { "\xC3\xA3", 2 },
+	[0x7C] = { "\xC3\xB5", 2 },
+	[0x7F] = { "\xC3\xA2", 2 },
+};
+// Bengali national language locking shift table (A.3.4).
+static const struct utf8_char bengali_locking_shift_utf8[128] = {
+	{ "\xE0\xA6\x81", 3 }, { "\xE0\xA6\x82", 3 }, { "\xE0\xA6\x83", 3 }, { "\xE0\xA6\x85", 3 },
+	{ "\xE0\xA6\x86", 3 }, { "\xE0\xA6\x87", 3 }, { "\xE0\xA6\x88", 3 }, { "\xE0\xA6\x89", 3 },
+	{ "\xE0\xA6\x8A", 3 }, { "\xE0\xA6\x8B", 3 }, { "\n", 1 },           { "\xE0\xA6\x8C", 3 },
+	{ "", 0 },             { "\r", 1 },           { "", 0 },             { "\xE0\xA6\x8F", 3 },
+	{ "\xE0\xA6\x90", 3 }, { "", 0 },             { "", 0 },             { "\xE0\xA6\x93", 3 },
+	{ "\xE0\xA6\x94", 3 }, { "\xE0\xA6\x95", 3 }, { "\xE0\xA6\x96", 3 }, { "\xE0\xA6\x97", 3 },
+	{ "\xE0\xA6\x98", 3 }, { "\xE0\xA6\x99", 3 }, { "\xE0\xA6\x9A", 3 }, { "", 0 },
+	{ "\xE0\xA6\x9B", 3 }, { "\xE0\xA6\x9C", 3 }, { "\xE0\xA6\x9D", 3 }, { "\xE0\xA6\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xA6\x9F", 3 }, { "\xE0\xA6\xA0", 3 },
+	{ "\xE0\xA6\xA1", 3 }, { "\xE0\xA6\xA2", 3 }, { "\xE0\xA6\xA3", 3 }, { "\xE0\xA6\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xA6\xA5", 3 }, { "\xE0\xA6\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xA6\xA7", 3 }, { ".", 1 },            { "\xE0\xA6\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xA6\xAA", 3 }, { "\xE0\xA6\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xA6\xAC", 3 }, { "\xE0\xA6\xAD", 3 }, { "\xE0\xA6\xAE", 3 }, { "\xE0\xA6\xAF", 3 },
+	{ "\xE0\xA6\xB0", 3 }, { "", 0 },             { "\xE0\xA6\xB2", 3 }, { "", 0 },
+	{ "", 0 },             { "", 0 },             { "\xE0\xA6\xB6", 3 }, { "\xE0\xA6\xB7", 3 },
+	{ "\xE0\xA6\xB8", 3 }, { "\xE0\xA6\xB9", 3 }, { "\xE0\xA6\xBC", 3 }, { "\xE0\xA6\xBD", 3 },
+	{ "\xE0\xA6\xBE", 3 }, { "\xE0\xA6\xBF", 3 }, { "\xE0\xA7\x80", 3 }, { "\xE0\xA7\x81", 3 },
+	{ "\xE0\xA7\x82", 3 }, { "\xE0\xA7\x83", 3 }, { "\xE0\xA7\x84", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xA7\x87", 3 }, { "\xE0\xA7\x88", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xA7\x8B", 3 }, { "\xE0\xA7\x8C", 3 }, { "\xE0\xA7\x8D", 3 },
+	{ "\xE0\xA7\x8E", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xA7\x97", 3 },
+	{ "\xE0\xA7\x9C", 3 }, { "\xE0\xA7\x9D", 3 }, { "\xE0\xA7\xB0", 3 }, { "\xE0\xA7\xB1", 3 },
+};
+
+// Gujarati national language locking shift table (A.3.5).
+static const struct utf8_char gujarati_locking_shift_utf8[128] = {
+	{ "\xE0\xAA\x81", 3 }, { "\xE0\xAA\x82", 3 }, { "\xE0\xAA\x83", 3 }, { "\xE0\xAA\x85", 3 },
+	{ "\xE0\xAA\x86", 3 }, { "\xE0\xAA\x87", 3 }, { "\xE0\xAA\x88", 3 }, { "\xE0\xAA\x89", 3 },
+	{ "\xE0\xAA\x8A", 3 }, { "\xE0\xAA\x8B", 3 }, { "\n", 1 },           { "\xE0\xAA\x8C", 3 },
+	{ "\xE0\xAA\x8D", 3 }, { "\r", 1 },           { "", 0 },             { "\xE0\xAA\x8F", 3 },
+	{ "\xE0\xAA\x90", 3 }, { "\xE0\xAA\x91", 3 }, { "", 0 },             { "\xE0\xAA\x93", 3 },
+	{ "\xE0\xAA\x94", 3 }, { "\xE0\xAA\x95", 3 }, { "\xE0\xAA\x96", 3 }, { "\xE0\xAA\x97", 3 },
+	{ "\xE0\xAA\x98", 3 }, { "\xE0\xAA\x99", 3 }, { "\xE0\xAA\x9A", 3 }, { "", 0 },
+	{ "\xE0\xAA\x9B", 3 }, { "\xE0\xAA\x9C", 3 }, { "\xE0\xAA\x9D", 3 }, { "\xE0\xAA\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xAA\x9F", 3 }, { "\xE0\xAA\xA0", 3 },
+	{ "\xE0\xAA\xA1", 3 }, { "\xE0\xAA\xA2", 3 }, { "\xE0\xAA\xA3", 3 }, { "\xE0\xAA\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xAA\xA5", 3 }, { "\xE0\xAA\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xAA\xA7", 3 }, { ".", 1 },            { "\xE0\xAA\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xAA\xAA", 3 }, { "\xE0\xAA\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xAA\xAC", 3 }, { "\xE0\xAA\xAD", 3 }, { "\xE0\xAA\xAE", 3 }, { "\xE0\xAA\xAF", 3 },
+	{ "\xE0\xAA\xB0", 3 }, { "", 0 },             { "\xE0\xAA\xB2", 3 }, { "\xE0\xAA\xB3", 3 },
+	{ "", 0 },             { "\xE0\xAA\xB5", 3 }, { "\xE0\xAA\xB6", 3 }, { "\xE0\xAA\xB7", 3 },
+	{ "\xE0\xAA\xB8", 3 }, { "\xE0\xAA\xB9", 3 }, { "\xE0\xAA\xBC", 3 }, { "\xE0\xAA\xBD", 3 },
+	{ "\xE0\xAA\xBE", 3 }, { "\xE0\xAA\xBF", 3 }, { "\xE0\xAB\x80", 3 }, { "\xE0\xAB\x81", 3 },
+	{ "\xE0\xAB\x82", 3 }, { "\xE0\xAB\x83", 3 }, { "\xE0\xAB\x84", 3 }, { "\xE0\xAB\x85", 3 },
+	{ "", 0 },             { "\xE0\xAB\x87", 3 }, { "\xE0\xAB\x88", 3 }, { "\xE0\xAB\x89", 3 },
+	{ "", 0 },             { "\xE0\xAB\x8B", 3 }, { "\xE0\xAB\x8C", 3 }, { "\xE0\xAB\x8D", 3 },
+	{ "\xE0\xAB\x90", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xAB\xA0", 3 },
+	{ "\xE0\xAB\xA1", 3 }, { "\xE0\xAB\xA2", 3 }, { "\xE0\xAB\xA3", 3 }, { "\xE0\xAB\xB1", 3 },
+};
+
+// Hindi national language locking shift table (A.3.6).
+static const struct utf8_char hindi_locking_shift_utf8[128] = {
+	{ "\xE0\xA4\x81", 3 }, { "\xE0\xA4\x82", 3 }, { "\xE0\xA4\x83", 3 }, { "\xE0\xA4\x85", 3 },
+	{ "\xE0\xA4\x86", 3 }, { "\xE0\xA4\x87", 3 }, { "\xE0\xA4\x88", 3 }, { "\xE0\xA4\x89", 3 },
+	{ "\xE0\xA4\x8A", 3 }, { "\xE0\xA4\x8B", 3 }, { "\n", 1 },           { "\xE0\xA4\x8C", 3 },
+	{ "\xE0\xA4\x8D", 3 }, { "\r", 1 },           { "\xE0\xA4\x8E", 3 }, { "\xE0\xA4\x8F", 3 },
+	{ "\xE0\xA4\x90", 3 }, { "\xE0\xA4\x91", 3 }, { "\xE0\xA4\x92", 3 }, { "\xE0\xA4\x93", 3 },
+	{ "\xE0\xA4\x94", 3 }, { "\xE0\xA4\x95", 3 }, { "\xE0\xA4\x96", 3 }, { "\xE0\xA4\x97", 3 },
+	{ "\xE0\xA4\x98", 3 }, { "\xE0\xA4\x99", 3 }, { "\xE0\xA4\x9A", 3 }, { "", 0 },
+	{ "\xE0\xA4\x9B", 3 }, { "\xE0\xA4\x9C", 3 }, { "\xE0\xA4\x9D", 3 }, { "\xE0\xA4\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xA4\x9F", 3 }, { "\xE0\xA4\xA0", 3 },
+	{ "\xE0\xA4\xA1", 3 }, { "\xE0\xA4\xA2", 3 }, { "\xE0\xA4\xA3", 3 }, { "\xE0\xA4\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xA4\xA5", 3 }, { "\xE0\xA4\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xA4\xA7", 3 }, { ".", 1 },            { "\xE0\xA4\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "\xE0\xA4\xA9", 3 }, { "\xE0\xA4\xAA", 3 }, { "\xE0\xA4\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xA4\xAC", 3 }, { "\xE0\xA4\xAD", 3 }, { "\xE0\xA4\xAE", 3 }, { "\xE0\xA4\xAF", 3 },
+	{ "\xE0\xA4\xB0", 3 }, { "\xE0\xA4\xB1", 3 }, { "\xE0\xA4\xB2", 3 }, { "\xE0\xA4\xB3", 3 },
+	{ "\xE0\xA4\xB4", 3 }, { "\xE0\xA4\xB5", 3 }, { "\xE0\xA4\xB6", 3 }, { "\xE0\xA4\xB7", 3 },
+	{ "\xE0\xA4\xB8", 3 }, { "\xE0\xA4\xB9", 3 }, { "\xE0\xA4\xBC", 3 }, { "\xE0\xA4\xBD", 3 },
+	{ "\xE0\xA4\xBE", 3 }, { "\xE0\xA4\xBF", 3 }, { "\xE0\xA5\x80", 3 }, { "\xE0\xA5\x81", 3 },
+	{ "\xE0\xA5\x82", 3 }, { "\xE0\xA5\x83", 3 }, { "\xE0\xA5\x84", 3 }, { "\xE0\xA5\x85", 3 },
+	{ "\xE0\xA5\x86", 3 }, { "\xE0\xA5\x87", 3 }, { "\xE0\xA5\x88", 3 }, { "\xE0\xA5\x89", 3 },
+	{ "\xE0\xA5\x8A", 3 }, { "\xE0\xA5\x8B", 3 }, { "\xE0\xA5\x8C", 3 }, { "\xE0\xA5\x8D", 3 },
+	{ "\xE0\xA5\x90", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xA5\xB2", 3 },
+	{ "\xE0\xA5\xBB", 3 }, { "\xE0\xA5\xBC", 3 }, { "\xE0\xA5\xBE", 3 }, { "\xE0\xA5\xBF", 3 },
+};
+
+// Kannada national language locking shift table (A.3.7).
+static const struct utf8_char kannada_locking_shift_utf8[128] = {
+	{ "", 0 },             { "\xE0\xB2\x82", 3 }, { "\xE0\xB2\x83", 3 }, { "\xE0\xB2\x85", 3 },
+	{ "\xE0\xB2\x86", 3 }, { "\xE0\xB2\x87", 3 }, { "\xE0\xB2\x88", 3 }, { "\xE0\xB2\x89", 3 },
+	{ "\xE0\xB2\x8A", 3 }, { "\xE0\xB2\x8B", 3 }, { "\n", 1 },           { "\xE0\xB2\x8C", 3 },
+	{ "", 0 },             { "\r", 1 },           { "\xE0\xB2\x8E", 3 }, { "\xE0\xB2\x8F", 3 },
+	{ "\xE0\xB2\x90", 3 }, { "", 0 },             { "\xE0\xB2\x92", 3 }, { "\xE0\xB2\x93", 3 },
+	{ "\xE0\xB2\x94", 3 }, { "\xE0\xB2\x95", 3 }, { "\xE0\xB2\x96", 3 }, { "\xE0\xB2\x97", 3 },
+	{ "\xE0\xB2\x98", 3 }, { "\xE0\xB2\x99", 3 }, { "\xE0\xB2\x9A", 3 }, { "", 0 },
+	{ "\xE0\xB2\x9B", 3 }, { "\xE0\xB2\x9C", 3 }, { "\xE0\xB2\x9D", 3 }, { "\xE0\xB2\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xB2\x9F", 3 }, { "\xE0\xB2\xA0", 3 },
+	{ "\xE0\xB2\xA1", 3 }, { "\xE0\xB2\xA2", 3 }, { "\xE0\xB2\xA3", 3 }, { "\xE0\xB2\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xB2\xA5", 3 }, { "\xE0\xB2\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xB2\xA7", 3 }, { ".", 1 },            { "\xE0\xB2\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xB2\xAA", 3 }, { "\xE0\xB2\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xB2\xAC", 3 }, { "\xE0\xB2\xAD", 3 }, { "\xE0\xB2\xAE", 3 }, { "\xE0\xB2\xAF", 3 },
+	{ "\xE0\xB2\xB0", 3 }, { "\xE0\xB2\xB1", 3 }, { "\xE0\xB2\xB2", 3 }, { "\xE0\xB2\xB3", 3 },
+	{ "", 0 },             { "\xE0\xB2\xB5", 3 }, { "\xE0\xB2\xB6", 3 }, { "\xE0\xB2\xB7", 3 },
+	{ "\xE0\xB2\xB8", 3 }, { "\xE0\xB2\xB9", 3 }, { "\xE0\xB2\xBC", 3 }, { "\xE0\xB2\xBD", 3 },
+	{ "\xE0\xB2\xBE", 3 }, { "\xE0\xB2\xBF", 3 }, { "\xE0\xB3\x80", 3 }, { "\xE0\xB3\x81", 3 },
+	{ "\xE0\xB3\x82", 3 }, { "\xE0\xB3\x83", 3 }, { "\xE0\xB3\x84", 3 }, { "", 0 },
+	{ "\xE0\xB3\x86", 3 }, { "\xE0\xB3\x87", 3 }, { "\xE0\xB3\x88", 3 }, { "", 0 },
+	{ "\xE0\xB3\x8A", 3 }, { "\xE0\xB3\x8B", 3 }, { "\xE0\xB3\x8C", 3 }, { "\xE0\xB3\x8D", 3 },
+	{ "\xE0\xB3\x95", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xB3\x96", 3 },
+	{ "\xE0\xB3\xA0", 3 }, { "\xE0\xB3\xA1", 3 }, { "\xE0\xB3\xA2", 3 }, { "\xE0\xB3\xA3", 3 },
+};
+
+// Malayalam national language locking shift table (A.3.8).
+static const struct utf8_char malayalam_locking_shift_utf8[128] = {
+	{ "", 0 },             { "\xE0\xB4\x82", 3 }, { "\xE0\xB4\x83", 3 }, { "\xE0\xB4\x85", 3 },
+	{ "\xE0\xB4\x86", 3 }, { "\xE0\xB4\x87", 3 }, { "\xE0\xB4\x88", 3 }, { "\xE0\xB4\x89", 3 },
+	{ "\xE0\xB4\x8A", 3 }, { "\xE0\xB4\x8B", 3 }, { "\n", 1 },           { "\xE0\xB4\x8C", 3 },
+	{ "", 0 },             { "\r", 1 },           { "\xE0\xB4\x8E", 3 }, { "\xE0\xB4\x8F", 3 },
+	{ "\xE0\xB4\x90", 3 }, { "", 0 },             { "\xE0\xB4\x92", 3 }, { "\xE0\xB4\x93", 3 },
+	{ "\xE0\xB4\x94", 3 }, { "\xE0\xB4\x95", 3 }, { "\xE0\xB4\x96", 3 }, { "\xE0\xB4\x97", 3 },
+	{ "\xE0\xB4\x98", 3 }, { "\xE0\xB4\x99", 3 }, { "\xE0\xB4\x9A", 3 }, { "", 0 },
+	{ "\xE0\xB4\x9B", 3 }, { "\xE0\xB4\x9C", 3 }, { "\xE0\xB4\x9D", 3 }, { "\xE0\xB4\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xB4\x9F", 3 }, { "\xE0\xB4\xA0", 3 },
+	{ "\xE0\xB4\xA1", 3 }, { "\xE0\xB4\xA2", 3 }, { "\xE0\xB4\xA3", 3 }, { "\xE0\xB4\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xB4\xA5", 3 }, { "\xE0\xB4\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xB4\xA7", 3 }, { ".", 1 },            { "\xE0\xB4\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xB4\xAA", 3 }, { "\xE0\xB4\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xB4\xAC", 3 }, { "\xE0\xB4\xAD", 3 }, { "\xE0\xB4\xAE", 3 }, { "\xE0\xB4\xAF", 3 },
+	{ "\xE0\xB4\xB0", 3 }, { "\xE0\xB4\xB1", 3 }, { "\xE0\xB4\xB2", 3 }, { "\xE0\xB4\xB3", 3 },
+	{ "\xE0\xB4\xB4", 3 }, { "\xE0\xB4\xB5", 3 }, { "\xE0\xB4\xB6", 3 }, { "\xE0\xB4\xB7", 3 },
+	{ "\xE0\xB4\xB8", 3 }, { "\xE0\xB4\xB9", 3 }, { "", 0 },             { "\xE0\xB4\xBD", 3 },
+	{ "\xE0\xB4\xBE", 3 }, { "\xE0\xB4\xBF", 3 }, { "\xE0\xB5\x80", 3 }, { "\xE0\xB5\x81", 3 },
+	{ "\xE0\xB5\x82", 3 }, { "\xE0\xB5\x83", 3 }, { "\xE0\xB5\x84", 3 }, { "", 0 },
+	{ "\xE0\xB5\x86", 3 }, { "\xE0\xB5\x87", 3 }, { "\xE0\xB5\x88", 3 }, { "", 0 },
+	{ "\xE0\xB5\x8A", 3 }, { "\xE0\xB5\x8B", 3 }, { "\xE0\xB5\x8C", 3 }, { "\xE0\xB5\x8D", 3 },
+	{ "\xE0\xB5\x97", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xB5\xA0", 3 },
+	{ "\xE0\xB5\xA1", 3 }, { "\xE0\xB5\xA2", 3 }, { "\xE0\xB5\xA3", 3 }, { "\xE0\xB5\xB9", 3 },
+};
+
+// Oriya national language locking shift table (A.3.9).
+static const struct utf8_char oriya_locking_shift_utf8[128] = {
+	{ "\xE0\xAC\x81", 3 }, { "\xE0\xAC\x82", 3 }, { "\xE0\xAC\x83", 3 }, { "\xE0\xAC\x85", 3 },
+	{ "\xE0\xAC\x86", 3 }, { "\xE0\xAC\x87", 3 }, { "\xE0\xAC\x88", 3 }, { "\xE0\xAC\x89", 3 },
+	{ "\xE0\xAC\x8A", 3 }, { "\xE0\xAC\x8B", 3 }, { "\n", 1 },           { "\xE0\xAC\x8C", 3 },
+	{ "", 0 },             { "\r", 1 },           { "", 0 },             { "\xE0\xAC\x8F", 3 },
+	{ "\xE0\xAC\x90", 3 }, { "", 0 },             { "", 0 },             { "\xE0\xAC\x93", 3 },
+	{ "\xE0\xAC\x94", 3 }, { "\xE0\xAC\x95", 3 }, { "\xE0\xAC\x96", 3 }, { "\xE0\xAC\x97", 3 },
+	{ "\xE0\xAC\x98", 3 }, { "\xE0\xAC\x99", 3 }, { "\xE0\xAC\x9A", 3 }, { "", 0 },
+	{ "\xE0\xAC\x9B", 3 }, { "\xE0\xAC\x9C", 3 }, { "\xE0\xAC\x9D", 3 }, { "\xE0\xAC\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xAC\x9F", 3 }, { "\xE0\xAC\xA0", 3 },
+	{ "\xE0\xAC\xA1", 3 }, { "\xE0\xAC\xA2", 3 }, { "\xE0\xAC\xA3", 3 }, { "\xE0\xAC\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xAC\xA5", 3 }, { "\xE0\xAC\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xAC\xA7", 3 }, { ".", 1 },            { "\xE0\xAC\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xAC\xAA", 3 }, { "\xE0\xAC\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xAC\xAC", 3 }, { "\xE0\xAC\xAD", 3 }, { "\xE0\xAC\xAE", 3 }, { "\xE0\xAC\xAF", 3 },
+	{ "\xE0\xAC\xB0", 3 }, { "", 0 },             { "\xE0\xAC\xB2", 3 }, { "\xE0\xAC\xB3", 3 },
+	{ "", 0 },             { "\xE0\xAC\xB5", 3 }, { "\xE0\xAC\xB6", 3 }, { "\xE0\xAC\xB7", 3 },
+	{ "\xE0\xAC\xB8", 3 }, { "\xE0\xAC\xB9", 3 }, { "\xE0\xAC\xBC", 3 }, { "\xE0\xAC\xBD", 3 },
+	{ "\xE0\xAC\xBE", 3 }, { "\xE0\xAC\xBF", 3 }, { "\xE0\xAD\x80", 3 }, { "\xE0\xAD\x81", 3 },
+	{ "\xE0\xAD\x82", 3 }, { "\xE0\xAD\x83", 3 }, { "\xE0\xAD\x84", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xAD\x87", 3 }, { "\xE0\xAD\x88", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xAD\x8B", 3 }, { "\xE0\xAD\x8C", 3 }, { "\xE0\xAD\x8D", 3 },
+	{ "\xE0\xAD\x96", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xAD\x97", 3 },
+	{ "\xE0\xAD\xA0", 3 }, { "\xE0\xAD\xA1", 3 }, { "\xE0\xAD\xA2", 3 }, { "\xE0\xAD\xA3", 3 },
+};
+
+// Punjabi national language locking shift table (A.3.10).
+static const struct utf8_char punjabi_locking_shift_utf8[128] = {
+	{ "\xE0\xA8\x81", 3 }, { "\xE0\xA8\x82", 3 }, { "\xE0\xA8\x83", 3 }, { "\xE0\xA8\x85", 3 },
+	{ "\xE0\xA8\x86", 3 }, { "\xE0\xA8\x87", 3 }, { "\xE0\xA8\x88", 3 }, { "\xE0\xA8\x89", 3 },
+	{ "\xE0\xA8\x8A", 3 }, { "", 0 },             { "\n", 1 },           { "", 0 },
+	{ "", 0 },             { "\r", 1 },           { "", 0 },             { "\xE0\xA8\x8F", 3 },
+	{ "\xE0\xA8\x90", 3 }, { "", 0 },             { "", 0 },             { "\xE0\xA8\x93", 3 },
+	{ "\xE0\xA8\x94", 3 }, { "\xE0\xA8\x95", 3 }, { "\xE0\xA8\x96", 3 }, { "\xE0\xA8\x97", 3 },
+	{ "\xE0\xA8\x98", 3 }, { "\xE0\xA8\x99", 3 }, { "\xE0\xA8\x9A", 3 }, { "", 0 },
+	{ "\xE0\xA8\x9B", 3 }, { "\xE0\xA8\x9C", 3 }, { "\xE0\xA8\x9D", 3 }, { "\xE0\xA8\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xA8\x9F", 3 }, { "\xE0\xA8\xA0", 3 },
+	{ "\xE0\xA8\xA1", 3 }, { "\xE0\xA8\xA2", 3 }, { "\xE0\xA8\xA3", 3 }, { "\xE0\xA8\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xA8\xA5", 3 }, { "\xE0\xA8\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xA8\xA7", 3 }, { ".", 1 },            { "\xE0\xA8\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xA8\xAA", 3 }, { "\xE0\xA8\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xA8\xAC", 3 }, { "\xE0\xA8\xAD", 3 }, { "\xE0\xA8\xAE", 3 }, { "\xE0\xA8\xAF", 3 },
+	{ "\xE0\xA8\xB0", 3 }, { "", 0 },             { "\xE0\xA8\xB2", 3 }, { "\xE0\xA8\xB3", 3 },
+	{ "", 0 },             { "\xE0\xA8\xB5", 3 }, { "\xE0\xA8\xB6", 3 }, { "", 0 },
+	{ "\xE0\xA8\xB8", 3 }, { "\xE0\xA8\xB9", 3 }, { "\xE0\xA8\xBC", 3 }, { "", 0 },
+	{ "\xE0\xA8\xBE", 3 }, { "\xE0\xA8\xBF", 3 }, { "\xE0\xA9\x80", 3 }, { "\xE0\xA9\x81", 3 },
+	{ "\xE0\xA9\x82", 3 }, { "", 0 },             { "", 0 },             { "", 0 },
+	{ "", 0 },             { "\xE0\xA9\x87", 3 }, { "\xE0\xA9\x88", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xA9\x8B", 3 }, { "\xE0\xA9\x8C", 3 }, { "\xE0\xA9\x8D", 3 },
+	{ "\xE0\xA9\x91", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xA9\xB0", 3 },
+	{ "\xE0\xA9\xB1", 3 }, { "\xE0\xA9\xB2", 3 }, { "\xE0\xA9\xB3", 3 }, { "\xE0\xA9\xB4", 3 },
+};
+
+// Tamil national language locking shift table (A.3.11).
+static const struct utf8_char tamil_locking_shift_utf8[128] = {
+	{ "", 0 },             { "\xE0\xAE\x82", 3 }, { "\xE0\xAE\x83", 3 }, { "\xE0\xAE\x85", 3 },
+	{ "\xE0\xAE\x86", 3 }, { "\xE0\xAE\x87", 3 }, { "\xE0\xAE\x88", 3 }, { "\xE0\xAE\x89", 3 },
+	{ "\xE0\xAE\x8A", 3 }, { "", 0 },             { "\n", 1 },           { "", 0 },
+	{ "", 0 },             { "\r", 1 },           { "\xE0\xAE\x8E", 3 }, { "\xE0\xAE\x8F", 3 },
+	{ "\xE0\xAE\x90", 3 }, { "", 0 },             { "\xE0\xAE\x92", 3 }, { "\xE0\xAE\x93", 3 },
+	{ "\xE0\xAE\x94", 3 }, { "\xE0\xAE\x95", 3 }, { "", 0 },             { "", 0 },
+	{ "", 0 },             { "\xE0\xAE\x99", 3 }, { "\xE0\xAE\x9A", 3 }, { "", 0 },
+	{ "", 0 },             { "\xE0\xAE\x9C", 3 }, { "", 0 },             { "\xE0\xAE\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xAE\x9F", 3 }, { "", 0 },
+	{ "", 0 },             { "", 0 },             { "\xE0\xAE\xA3", 3 }, { "\xE0\xAE\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "", 0 },             { "", 0 },
+	{ ",", 1 },            { "", 0 },             { ".", 1 },            { "\xE0\xAE\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "\xE0\xAE\xA9", 3 }, { "\xE0\xAE\xAA", 3 }, { "", 0 },             { "?", 1 },
+	{ "", 0 },             { "", 0 },             { "\xE0\xAE\xAE", 3 }, { "\xE0\xAE\xAF", 3 },
+	{ "\xE0\xAE\xB0", 3 }, { "\xE0\xAE\xB1", 3 }, { "\xE0\xAE\xB2", 3 }, { "\xE0\xAE\xB3", 3 },
+	{ "\xE0\xAE\xB4", 3 }, { "\xE0\xAE\xB5", 3 }, { "\xE0\xAE\xB6", 3 }, { "\xE0\xAE\xB7", 3 },
+	{ "\xE0\xAE\xB8", 3 }, { "\xE0\xAE\xB9", 3 }, { "", 0 },             { "", 0 },
+	{ "\xE0\xAE\xBE", 3 }, { "\xE0\xAE\xBF", 3 }, { "\xE0\xAF\x80", 3 }, { "\xE0\xAF\x81", 3 },
+	{ "\xE0\xAF\x82", 3 }, { "", 0 },             { "", 0 },             { "", 0 },
+	{ "\xE0\xAF\x86", 3 }, { "\xE0\xAF\x87", 3 }, { "\xE0\xAF\x88", 3 }, { "", 0 },
+	{ "\xE0\xAF\x8A", 3 }, { "\xE0\xAF\x8B", 3 }, { "\xE0\xAF\x8C", 3 }, { "\xE0\xAF\x8D", 3 },
+	{ "\xE0\xAF\x90", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xAF\x97", 3 },
+	{ "\xE0\xAF\xB0", 3 }, { "\xE0\xAF\xB1", 3 }, { "\xE0\xAF\xB2", 3 }, { "\xE0\xAF\xB9", 3 },
+};
+
+// Telugu national language locking shift table (A.3.12).
+static const struct utf8_char telugu_locking_shift_utf8[128] = {
+	{ "\xE0\xB0\x81", 3 }, { "\xE0\xB0\x82", 3 }, { "\xE0\xB0\x83", 3 }, { "\xE0\xB0\x85", 3 },
+	{ "\xE0\xB0\x86", 3 }, { "\xE0\xB0\x87", 3 }, { "\xE0\xB0\x88", 3 }, { "\xE0\xB0\x89", 3 },
+	{ "\xE0\xB0\x8A", 3 }, { "\xE0\xB0\x8B", 3 }, { "\n", 1 },           { "\xE0\xB0\x8C", 3 },
+	{ "", 0 },             { "\r", 1 },           { "\xE0\xB0\x8E", 3 }, { "\xE0\xB0\x8F", 3 },
+	{ "\xE0\xB0\x90", 3 }, { "", 0 },             { "\xE0\xB0\x92", 3 }, { "\xE0\xB0\x93", 3 },
+	{ "\xE0\xB0\x94", 3 }, { "\xE0\xB0\x95", 3 }, { "\xE0\xB0\x96", 3 }, { "\xE0\xB0\x97", 3 },
+	{ "\xE0\xB0\x98", 3 }, { "\xE0\xB0\x99", 3 }, { "\xE0\xB0\x9A", 3 }, { "", 0 },
+	{ "\xE0\xB0\x9B", 3 }, { "\xE0\xB0\x9C", 3 }, { "\xE0\xB0\x9D", 3 }, { "\xE0\xB0\x9E", 3 },
+	{ " ", 1 },            { "!", 1 },            { "\xE0\xB0\x9F", 3 }, { "\xE0\xB0\xA0", 3 },
+	{ "\xE0\xB0\xA1", 3 }, { "\xE0\xB0\xA2", 3 }, { "\xE0\xB0\xA3", 3 }, { "\xE0\xB0\xA4", 3 },
+	{ ")", 1 },            { "(", 1 },            { "\xE0\xB0\xA5", 3 }, { "\xE0\xB0\xA6", 3 },
+	{ ",", 1 },            { "\xE0\xB0\xA7", 3 }, { ".", 1 },            { "\xE0\xB0\xA8", 3 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "", 0 },             { "\xE0\xB0\xAA", 3 }, { "\xE0\xB0\xAB", 3 }, { "?", 1 },
+	{ "\xE0\xB0\xAC", 3 }, { "\xE0\xB0\xAD", 3 }, { "\xE0\xB0\xAE", 3 }, { "\xE0\xB0\xAF", 3 },
+	{ "\xE0\xB0\xB0", 3 }, { "\xE0\xB0\xB1", 3 }, { "\xE0\xB0\xB2", 3 }, { "\xE0\xB0\xB3", 3 },
+	{ "", 0 },             { "\xE0\xB0\xB5", 3 }, { "\xE0\xB0\xB6", 3 }, { "\xE0\xB0\xB7", 3 },
+	{ "\xE0\xB0\xB8", 3 }, { "\xE0\xB0\xB9", 3 }, { "", 0 },             { "\xE0\xB0\xBD", 3 },
+	{ "\xE0\xB0\xBE", 3 }, { "\xE0\xB0\xBF", 3 }, { "\xE0\xB1\x80", 3 }, { "\xE0\xB1\x81", 3 },
+	{ "\xE0\xB1\x82", 3 }, { "\xE0\xB1\x83", 3 }, { "\xE0\xB1\x84", 3 }, { "", 0 },
+	{ "\xE0\xB1\x86", 3 }, { "\xE0\xB1\x87", 3 }, { "\xE0\xB1\x88", 3 }, { "", 0 },
+	{ "\xE0\xB1\x8A", 3 }, { "\xE0\xB1\x8B", 3 }, { "\xE0\xB1\x8C", 3 }, { "\xE0\xB1\x8D", 3 },
+	{ "\xE0\xB1\x95", 3 }, { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xE0\xB1\x96", 3 },
+	{ "\xE0\xB1\xA0", 3 }, { "\xE0\xB1\xA1", 3 }, { "\xE0\xB1\xA2", 3 }, { "\xE0\xB1\xA3", 3 },
+};
+
+// Urdu national language locking shift table (A.3.13).
+static const struct utf8_char urdu_locking_shift_utf8[128] = {
+	{ "\xD8\xA7", 2 },     { "\xD8\xA2", 2 },     { "\xD8\xA8", 2 },     { "\xD9\xBB", 2 },
+	{ "\xDA\x80", 2 },     { "\xD9\xBE", 2 },     { "\xDA\xA6", 2 },     { "\xD8\xAA", 2 },
+	{ "\xDB\x82", 2 },     { "\xD9\xBF", 2 },     { "\n", 1 },           { "\xD9\xB9", 2 },
+	{ "\xD9\xBD", 2 },     { "\r", 1 },           { "\xD9\xBA", 2 },     { "\xD9\xBC", 2 },
+	{ "\xD8\xAB", 2 },     { "\xD8\xAC", 2 },     { "\xDA\x81", 2 },     { "\xDA\x84", 2 },
+	{ "\xDA\x83", 2 },     { "\xDA\x85", 2 },     { "\xDA\x86", 2 },     { "\xDA\x87", 2 },
+	{ "\xD8\xAD", 2 },     { "\xD8\xAE", 2 },     { "\xD8\xAF", 2 },     { "", 0 },
+	{ "\xDA\x8C", 2 },     { "\xDA\x88", 2 },     { "\xDA\x89", 2 },     { "\xDA\x8A", 2 },
+	{ " ", 1 },            { "!", 1 },            { "\xDA\x8F", 2 },     { "\xDA\x8D", 2 },
+	{ "\xD8\xB0", 2 },     { "\xD8\xB1", 2 },     { "\xDA\x91", 2 },     { "\xDA\x93", 2 },
+	{ ")", 1 },            { "(", 1 },            { "\xDA\x99", 2 },     { "\xD8\xB2", 2 },
+	{ ",", 1 },            { "\xDA\x96", 2 },     { ".", 1 },            { "\xDA\x98", 2 },
+	{ "0", 1 },            { "1", 1 },            { "2", 1 },            { "3", 1 },
+	{ "4", 1 },            { "5", 1 },            { "6", 1 },            { "7", 1 },
+	{ "8", 1 },            { "9", 1 },            { ":", 1 },            { ";", 1 },
+	{ "\xDA\x9A", 2 },     { "\xD8\xB3", 2 },     { "\xD8\xB4", 2 },     { "?", 1 },
+	{ "\xD8\xB5", 2 },     { "\xD8\xB6", 2 },     { "\xD8\xB7", 2 },     { "\xD8\xB8", 2 },
+	{ "\xD8\xB9", 2 },     { "\xD9\x81", 2 },     { "\xD9\x82", 2 },     { "\xDA\xA9", 2 },
+	{ "\xDA\xAA", 2 },     { "\xDA\xAB", 2 },     { "\xDA\xAF", 2 },     { "\xDA\xB3", 2 },
+	{ "\xDA\xB1", 2 },     { "\xD9\x84", 2 },     { "\xD9\x85", 2 },     { "\xD9\x86", 2 },
+	{ "\xDA\xBA", 2 },     { "\xDA\xBB", 2 },     { "\xDA\xBC", 2 },     { "\xD9\x88", 2 },
+	{ "\xDB\x84", 2 },     { "\xDB\x95", 2 },     { "\xDB\x81", 2 },     { "\xDA\xBE", 2 },
+	{ "\xD8\xA1", 2 },     { "\xDB\x8C", 2 },     { "\xDB\x90", 2 },     { "\xDB\x92", 2 },
+	{ "\xD9\x8D", 2 },     { "\xD9\x90", 2 },     { "\xD9\x8F", 2 },     { "\xD9\x97", 2 },
+	{ "\xD9\x94", 2 },     { "a", 1 },            { "b", 1 },            { "c", 1 },
+	{ "d", 1 },            { "e", 1 },            { "f", 1 },            { "g", 1 },
+	{ "h", 1 },            { "i", 1 },            { "j", 1 },            { "k", 1 },
+	{ "l", 1 },            { "m", 1 },            { "n", 1 },            { "o", 1 },
+	{ "p", 1 },            { "q", 1 },            { "r", 1 },            { "s", 1 },
+	{ "t", 1 },            { "u", 1 },            { "v", 1 },            { "w", 1 },
+	{ "x", 1 },            { "y", 1 },            { "z", 1 },            { "\xD9\x95", 2 },
+	{ "\xD9\x91", 2 },     { "\xD9\x93", 2 },     { "\xD9\x96", 2 },     { "\xD9\xB0", 2 },
+};
+
+// Bengali national language single shift table (A.2.4).
+static const struct utf8_char bengali_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xA7\xA6", 3 },
+	[0x1D] = { "\xE0\xA7\xA7", 3 },
+	[0x1E] = { "\xE0\xA7\xA8", 3 },
+	[0x1F] = { "\xE0\xA7\xA9", 3 },
+	[0x20] = { "\xE0\xA7\xAA", 3 },
+	[0x21] = { "\xE0\xA7\xAB", 3 },
+	[0x22] = { "\xE0\xA7\xAC", 3 },
+	[0x23] = { "\xE0\xA7\xAD", 3 },
+	[0x24] = { "\xE0\xA7\xAE", 3 },
+	[0x25] = { "\xE0\xA7\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Gujarati national language single shift table (A.2.5).
+static const struct utf8_char gujarati_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xAB\xA6", 3 },
+	[0x1D] = { "\xE0\xAB\xA7", 3 },
+	[0x1E] = { "\xE0\xAB\xA8", 3 },
+	[0x1F] = { "\xE0\xAB\xA9", 3 },
+	[0x20] = { "\xE0\xAB\xAA", 3 },
+	[0x21] = { "\xE0\xAB\xAB", 3 },
+	[0x22] = { "\xE0\xAB\xAC", 3 },
+	[0x23] = { "\xE0\xAB\xAD", 3 },
+	[0x24] = { "\xE0\xAB\xAE", 3 },
+	[0x25] = { "\xE0\xAB\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Hindi national language single shift table (A.2.6).
+static const struct utf8_char hindi_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xA5\xA6", 3 },
+	[0x1D] = { "\xE0\xA5\xA7", 3 },
+	[0x1E] = { "\xE0\xA5\xA8", 3 },
+	[0x1F] = { "\xE0\xA5\xA9", 3 },
+	[0x20] = { "\xE0\xA5\xAA", 3 },
+	[0x21] = { "\xE0\xA5\xAB", 3 },
+	[0x22] = { "\xE0\xA5\xAC", 3 },
+	[0x23] = { "\xE0\xA5\xAD", 3 },
+	[0x24] = { "\xE0\xA5\xAE", 3 },
+	[0x25] = { "\xE0\xA5\xAF", 3 },
+	[0x26] = { "\xE0\xA5\x91", 3 },
+	[0x27] = { "\xE0\xA5\x92", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2A] = { "\xE0\xA5\x93", 3 },
+	[0x2B] = { "\xE0\xA5\x94", 3 },
+	[0x2C] = { "\xE0\xA5\x98", 3 },
+	[0x2D] = { "\xE0\xA5\x99", 3 },
+	[0x2E] = { "\xE0\xA5\x9A", 3 },
+	[0x2F] = { "\\", 1 },
+	[0x30] = { "\xE0\xA5\x9B", 3 },
+	[0x31] = { "\xE0\xA5\x9C", 3 },
+	[0x32] = { "\xE0\xA5\x9D", 3 },
+	[0x33] = { "\xE0\xA5\x9E", 3 },
+	[0x34] = { "\xE0\xA5\x9F", 3 },
+	[0x35] = { "\xE0\xA5\xA0", 3 },
+	[0x36] = { "\xE0\xA5\xA1", 3 },
+	[0x37] = { "\xE0\xA5\xA2", 3 },
+	[0x38] = { "\xE0\xA5\xA3", 3 },
+	[0x39] = { "\xE0\xA5\xB0", 3 },
+	[0x3A] = { "\xE0\xA5\xB1", 3 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Kannada national language single shift table (A.2.7).
+static const struct utf8_char kannada_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xB3\xA6", 3 },
+	[0x1D] = { "\xE0\xB3\xA7", 3 },
+	[0x1E] = { "\xE0\xB3\xA8", 3 },
+	[0x1F] = { "\xE0\xB3\xA9", 3 },
+	[0x20] = { "\xE0\xB3\xAA", 3 },
+	[0x21] = { "\xE0\xB3\xAB", 3 },
+	[0x22] = { "\xE0\xB3\xAC", 3 },
+	[0x23] = { "\xE0\xB3\xAD", 3 },
+	[0x24] = { "\xE0\xB3\xAE", 3 },
+	[0x25] = { "\xE0\xB3\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Malayalam national language single shift table (A.2.8).
+static const struct utf8_char malayalam_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xB5\xA6", 3 },
+	[0x1D] = { "\xE0\xB5\xA7", 3 },
+	[0x1E] = { "\xE0\xB5\xA8", 3 },
+	[0x1F] = { "\xE0\xB5\xA9", 3 },
+	[0x20] = { "\xE0\xB5\xAA", 3 },
+	[0x21] = { "\xE0\xB5\xAB", 3 },
+	[0x22] = { "\xE0\xB5\xAC", 3 },
+	[0x23] = { "\xE0\xB5\xAD", 3 },
+	[0x24] = { "\xE0\xB5\xAE", 3 },
+	[0x25] = { "\xE0\xB5\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Oriya national language single shift table (A.2.9).
+static const struct utf8_char oriya_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xAD\xA6", 3 },
+	[0x1D] = { "\xE0\xAD\xA7", 3 },
+	[0x1E] = { "\xE0\xAD\xA8", 3 },
+	[0x1F] = { "\xE0\xAD\xA9", 3 },
+	[0x20] = { "\xE0\xAD\xAA", 3 },
+	[0x21] = { "\xE0\xAD\xAB", 3 },
+	[0x22] = { "\xE0\xAD\xAC", 3 },
+	[0x23] = { "\xE0\xAD\xAD", 3 },
+	[0x24] = { "\xE0\xAD\xAE", 3 },
+	[0x25] = { "\xE0\xAD\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Punjabi national language single shift table (A.2.10).
+static const struct utf8_char punjabi_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xA9\xA6", 3 },
+	[0x1D] = { "\xE0\xA9\xA7", 3 },
+	[0x1E] = { "\xE0\xA9\xA8", 3 },
+	[0x1F] = { "\xE0\xA9\xA9", 3 },
+	[0x20] = { "\xE0\xA9\xAA", 3 },
+	[0x21] = { "\xE0\xA9\xAB", 3 },
+	[0x22] = { "\xE0\xA9\xAC", 3 },
+	[0x23] = { "\xE0\xA9\xAD", 3 },
+	[0x24] = { "\xE0\xA9\xAE", 3 },
+	[0x25] = { "\xE0\xA9\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Tamil national language single shift table (A.2.11).
+static const struct utf8_char tamil_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xAF\xA6", 3 },
+	[0x1D] = { "\xE0\xAF\xA7", 3 },
+	[0x1E] = { "\xE0\xAF\xA8", 3 },
+	[0x1F] = { "\xE0\xAF\xA9", 3 },
+	[0x20] = { "\xE0\xAF\xAA", 3 },
+	[0x21] = { "\xE0\xAF\xAB", 3 },
+	[0x22] = { "\xE0\xAF\xAC", 3 },
+	[0x23] = { "\xE0\xAF\xAD", 3 },
+	[0x24] = { "\xE0\xAF\xAE", 3 },
+	[0x25] = { "\xE0\xAF\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Telugu national language single shift table (A.2.12).
+static const struct utf8_char telugu_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xE0\xA5\xA4", 3 },
+	[0x1A] = { "\xE0\xA5\xA5", 3 },
+	[0x1C] = { "\xE0\xB1\xA6", 3 },
+	[0x1D] = { "\xE0\xB1\xA7", 3 },
+	[0x1E] = { "\xE0\xB1\xA8", 3 },
+	[0x1F] = { "\xE0\xB1\xA9", 3 },
+	[0x20] = { "\xE0\xB1\xAA", 3 },
+	[0x21] = { "\xE0\xB1\xAB", 3 },
+	[0x22] = { "\xE0\xB1\xAC", 3 },
+	[0x23] = { "\xE0\xB1\xAD", 3 },
+	[0x24] = { "\xE0\xB1\xAE", 3 },
+	[0x25] = { "\xE0\xB1\xAF", 3 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2F] = { "\\", 1 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+// Urdu national language single shift table (A.2.13).
+static const struct utf8_char urdu_single_shift_utf8[128] = {
+	[0x00] = { "@", 1 },
+	[0x01] = { "\xC2\xA3", 2 },
+	[0x02] = { "$", 1 },
+	[0x03] = { "\xC2\xA5", 2 },
+	[0x04] = { "\xC2\xBF", 2 },
+	[0x05] = { "\"", 1 },
+	[0x06] = { "\xC2\xA4", 2 },
+	[0x07] = { "%", 1 },
+	[0x08] = { "&", 1 },
+	[0x09] = { "'", 1 },
+	[0x0A] = { "\f", 1 },
+	[0x0B] = { "*", 1 },
+	[0x0C] = { "+", 1 },
+	[0x0E] = { "-", 1 },
+	[0x0F] = { "/", 1 },
+	[0x10] = { "<", 1 },
+	[0x11] = { "=", 1 },
+	[0x12] = { ">", 1 },
+	[0x13] = { "\xC2\xA1", 2 },
+	[0x14] = { "^", 1 },
+	[0x15] = { "\xC2\xA1", 2 },
+	[0x16] = { "_", 1 },
+	[0x17] = { "#", 1 },
+	[0x18] = { "*", 1 },
+	[0x19] = { "\xD8\x80", 2 },
+	[0x1A] = { "\xD8\x81", 2 },
+	[0x1C] = { "\xDB\xB0", 2 },
+	[0x1D] = { "\xDB\xB1", 2 },
+	[0x1E] = { "\xDB\xB2", 2 },
+	[0x1F] = { "\xDB\xB3", 2 },
+	[0x20] = { "\xDB\xB4", 2 },
+	[0x21] = { "\xDB\xB5", 2 },
+	[0x22] = { "\xDB\xB6", 2 },
+	[0x23] = { "\xDB\xB7", 2 },
+	[0x24] = { "\xDB\xB8", 2 },
+	[0x25] = { "\xDB\xB9", 2 },
+	[0x26] = { "\xD8\x8C", 2 },
+	[0x27] = { "\xD8\x8D", 2 },
+	[0x28] = { "{", 1 },
+	[0x29] = { "}", 1 },
+	[0x2A] = { "\xD8\x8E", 2 },
+	[0x2B] = { "\xD8\x8F", 2 },
+	[0x2C] = { "\xD8\x90", 2 },
+	[0x2D] = { "\xD8\x91", 2 },
+	[0x2E] = { "\xD8\x92", 2 },
+	[0x2F] = { "\\", 1 },
+	[0x30] = { "\xD8\x93", 2 },
+	[0x31] = { "\xD8\x94", 2 },
+	[0x32] = { "\xD8\x9B", 2 },
+	[0x33] = { "\xD8\x9F", 2 },
+	[0x34] = { "\xD9\x80", 2 },
+	[0x35] = { "\xD9\x92", 2 },
+	[0x36] = { "\xD9\x98", 2 },
+	[0x37] = { "\xD9\xAB", 2 },
+	[0x38] = { "\xD9\xAC", 2 },
+	[0x39] = { "\xD9\xB2", 2 },
+	[0x3A] = { "\xD9\xB3", 2 },
+	[0x3B] = { "\xDB\x8D", 2 },
+	[0x3C] = { "[", 1 },
+	[0x3D] = { "~", 1 },
+	[0x3E] = { "]", 1 },
+	[0x3F] = { "\xDB\x94", 2 },
+	[0x40] = { "|", 1 },
+	[0x41] = { "A", 1 },
+	[0x42] = { "B", 1 },
+	[0x43] = { "C", 1 },
+	[0x44] = { "D", 1 },
+	[0x45] = { "E", 1 },
+	[0x46] = { "F", 1 },
+	[0x47] = { "G", 1 },
+	[0x48] = { "H", 1 },
+	[0x49] = { "I", 1 },
+	[0x4A] = { "J", 1 },
+	[0x4B] = { "K", 1 },
+	[0x4C] = { "L", 1 },
+	[0x4D] = { "M", 1 },
+	[0x4E] = { "N", 1 },
+	[0x4F] = { "O", 1 },
+	[0x50] = { "P", 1 },
+	[0x51] = { "Q", 1 },
+	[0x52] = { "R", 1 },
+	[0x53] = { "S", 1 },
+	[0x54] = { "T", 1 },
+	[0x55] = { "U", 1 },
+	[0x56] = { "V", 1 },
+	[0x57] = { "W", 1 },
+	[0x58] = { "X", 1 },
+	[0x59] = { "Y", 1 },
+	[0x5A] = { "Z", 1 },
+	[0x65] = { "\xE2\x82\xAC", 3 },
+};
+
+static const struct utf8_char* const locking_shift_utf8[SMS_LANGUAGE_COUNT] = {
+	[SMS_LANGUAGE_DEFAULT]    = gsm7bits_to_utf8,
+	[SMS_LANGUAGE_TURKISH]    = turkish_locking_shift_utf8,
+	[SMS_LANGUAGE_PORTUGUESE] = portuguese_locking_shift_utf8,
+	[SMS_LANGUAGE_BENGALI]    = bengali_locking_shift_utf8,
+	[SMS_LANGUAGE_GUJARATI]   = gujarati_locking_shift_utf8,
+	[SMS_LANGUAGE_HINDI]      = hindi_locking_shift_utf8,
+	[SMS_LANGUAGE_KANNADA]    = kannada_locking_shift_utf8,
+	[SMS_LANGUAGE_MALAYALAM]  = malayalam_locking_shift_utf8,
+	[SMS_LANGUAGE_ORIYA]      = oriya_locking_shift_utf8,
+	[SMS_LANGUAGE_PUNJABI]    = punjabi_locking_shift_utf8,
+	[SMS_LANGUAGE_TAMIL]      = tamil_locking_shift_utf8,
+	[SMS_LANGUAGE_TELUGU]     = telugu_locking_shift_utf8,
+	[SMS_LANGUAGE_URDU]       = urdu_locking_shift_utf8,
+};
+static const struct utf8_char* const single_shift_utf8[SMS_LANGUAGE_COUNT] = {
+	[SMS_LANGUAGE_DEFAULT]    = gsm7bits_extend_to_utf8,
+	[SMS_LANGUAGE_TURKISH]    = turkish_single_shift_utf8,
+	[SMS_LANGUAGE_SPANISH]    = spanish_single_shift_utf8,
+	[SMS_LANGUAGE_PORTUGUESE] = portuguese_single_shift_utf8,
+	[SMS_LANGUAGE_BENGALI]    = bengali_single_shift_utf8,
+	[SMS_LANGUAGE_GUJARATI]   = gujarati_single_shift_utf8,
+	[SMS_LANGUAGE_HINDI]      = hindi_single_shift_utf8,
+	[SMS_LANGUAGE_KANNADA]    = kannada_single_shift_utf8,
+	[SMS_LANGUAGE_MALAYALAM]  = malayalam_single_shift_utf8,
+	[SMS_LANGUAGE_ORIYA]      = oriya_single_shift_utf8,
+	[SMS_LANGUAGE_PUNJABI]    = punjabi_single_shift_utf8,
+	[SMS_LANGUAGE_TAMIL]      = tamil_single_shift_utf8,
+	[SMS_LANGUAGE_TELUGU]     = telugu_single_shift_utf8,
+	[SMS_LANGUAGE_URDU]       = urdu_single_shift_utf8,
+};
+static const struct utf8_char*
+LockingShiftUtf8(int language)
+{
+	if (language < 0 || language >= SMS_LANGUAGE_COUNT ||
+	    !locking_shift_utf8[language])
+		return gsm7bits_to_utf8;
+	return locking_shift_utf8[language];
+}
+static const struct utf8_char*
+SingleShiftUtf8(int language)
+{
+	if (language < 0 || language >= SMS_LANGUAGE_COUNT)
+		return gsm7bits_extend_to_utf8;
+	return single_shift_utf8[language];
+}
+
+// Whether any of the 8 septets spread over a word is an escape.
 static int
-G7bitToAscii(int skip, char* buffer, int buffer_length)
+HasEscape(uint64_t septets)
 {
-	char temp[320];
-	int out_pos = skip;
+	const uint64_t t = septets ^ 0x1B1B1B1B1B1B1B1BULL;
 
-	for (int i = skip; i < buffer_length; i++) {
-		unsigned char c = buffer[i];
-		if (c == GSM_7BITS_ESCAPE) {
-			unsigned char next = buffer[i + 1];
-			if (gsm7bits_extend_to_latin1[next]) {
-				temp[out_pos++] = gsm7bits_extend_to_latin1[next];
+	// Bytes are below 0x80, so adding 0x7F sets the top bit unless zero.
+	return ((t + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) !=
+		0x8080808080808080ULL;
+}
+
+/*
+ * Decode count packed septets, starting fill_bits into the first octet,
+ * straight to UTF-8 with the given national language tables. Escapes to
+ * the single shift table are followed across octet boundaries. The text
+ * is cut short when text_size is reached and is NUL terminated. Returns
+ * its length or -1 when the input holds fewer than count septets.
+ */
+static int
+Gsm7ToUtf8(const unsigned char* packed, int packed_length, int fill_bits,
+	   int count, int locking, int single, char* text, int text_size)
+{
+	if (count < 0 || packed_length < 0 || fill_bits < 0 || fill_bits > 6 ||
+	    text_size < 1 || count > (packed_length * 8 - fill_bits) / 7)
+		return -1;
+
+	const struct utf8_char* basic = LockingShiftUtf8(locking);
+	const struct utf8_char* extension = SingleShiftUtf8(single);
+	int escape = 0;
+	int length = 0;
+
+	for (int i = 0, o = 0; i < count; i += 8, o += 7) {
+		uint64_t septets = SpreadSeptets(LoadOctets(packed + o,
+				packed_length - o) >> fill_bits);
+		const int block = count - i < 8 ? count - i : 8;
+
+		// Eight characters without an escape are copied without checks,
+		// 4 bytes at a time. The spare fourth byte is overwritten by what
+		// follows.
+		if (block == 8 && !escape && !HasEscape(septets) &&
+		    text_size - 1 - length >= 8 * (int)sizeof(struct utf8_char)) {
+			for (int k = 0; k < 8; ++k, septets >>= 8) {
+				const struct utf8_char* c = &basic[septets & 0x7F];
+				memcpy(text + length, c, sizeof(*c));
+				length += c->length;
 			}
-			i++;
-		} else if (c >= 0x10 && c <= 0x1A && gsm7bits_to_utf8[c]) {
-			const char* utf8 = gsm7bits_to_utf8[c];
-			while (*utf8) {
-				temp[out_pos++] = *utf8++;
+			continue;
+		}
+
+		for (int k = 0; k < block; ++k, septets >>= 8) {
+			const unsigned int septet = septets & 0x7F;
+			const struct utf8_char* c;
+			if (escape) {
+				escape = 0;
+				c = &extension[septet];
+			} else if (septet == GSM_7BITS_ESCAPE) {
+				escape = 1;
+				continue;
+			} else {
+				c = &basic[septet];
 			}
-		} else {
-			temp[out_pos++] = gsm7bits_to_latin1[c];
+			if (c->length > text_size - 1 - length) {
+				text[length] = 0;
+				return length;
+			}
+			memcpy(text + length, c->bytes, c->length);
+			length += c->length;
 		}
 	}
+	text[length] = 0;
+	return length;
+}
 
-	if (out_pos > buffer_length) out_pos = buffer_length;
-	memcpy(buffer, temp, out_pos);
-
-	return out_pos;
+// Decode packed septets in the default alphabet to UTF-8.
+int
+pdu_decode_gsm7(const unsigned char* packed, int packed_length,
+		int fill_bits, int count, char* text, int text_size)
+{
+	return Gsm7ToUtf8(packed, packed_length, fill_bits, count,
+			  SMS_LANGUAGE_DEFAULT, SMS_LANGUAGE_DEFAULT, text,
+			  text_size);
 }
 
 #define NPC '?'
@@ -218,32 +1744,756 @@ static const int latin1_to_gsm7bits[256] = {
   NPC, 0x7d, 0x08,  NPC,  NPC,  NPC, 0x7c,  NPC, 0x0c, 0x06,  NPC,  NPC, 0x7e,  NPC,  NPC,  NPC,
 };
 
+// Greek capitals of the GSM 7 bit default alphabet.
+static const struct {
+	unsigned short codepoint;
+	unsigned char septet;
+} greek_to_gsm7bits[] = {
+	{ 0x0393, 0x13 }, // Γ
+	{ 0x0394, 0x10 }, // Δ
+	{ 0x0398, 0x19 }, // Θ
+	{ 0x039B, 0x14 }, // Λ
+	{ 0x039E, 0x1A }, // Ξ
+	{ 0x03A0, 0x16 }, // Π
+	{ 0x03A3, 0x18 }, // Σ
+	{ 0x03A6, 0x12 }, // Φ
+	{ 0x03A8, 0x17 }, // Ψ
+	{ 0x03A9, 0x15 }, // Ω
+};
+
+#define GSM_7BITS_EURO 0x65
+
+enum { GSM7_UNREPRESENTABLE = -0x100 };
+
+// Map a code point to a GSM 7 bit septet; negative values are escaped
+// through the extension table. ASCII control characters keep mapping to
+// '?' as before.
+static int
+CodepointToG7bit(unsigned int codepoint)
+{
+	if (codepoint < 0x80)
+		return latin1_to_gsm7bits[codepoint];
+	if (codepoint < 0x100) {
+		const int val = latin1_to_gsm7bits[codepoint];
+		return val == NPC ? GSM7_UNREPRESENTABLE : val;
+	}
+	if (codepoint == 0x20AC)
+		return -GSM_7BITS_EURO;
+	for (size_t i = 0; i < sizeof(greek_to_gsm7bits) / sizeof(greek_to_gsm7bits[0]); ++i) {
+		if (greek_to_gsm7bits[i].codepoint == codepoint)
+			return greek_to_gsm7bits[i].septet;
+	}
+	return GSM7_UNREPRESENTABLE;
+}
+
+// Read one UTF-8 sequence of up to three bytes (the UCS-2 range).
+static int
+Utf8Next(const unsigned char** input, unsigned int* codepoint)
+{
+	const unsigned char* p = *input;
+
+	if (*p < 0x80) {
+		*codepoint = *p++;
+	} else if (*p >= 0xC2 && *p <= 0xDF) {
+		if ((p[1] & 0xC0) != 0x80)
+			return -1;
+		*codepoint = ((*p & 0x1F) << 6) | (p[1] & 0x3F);
+		p += 2;
+	} else if (*p >= 0xE0 && *p <= 0xEF) {
+		if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+			return -1;
+		if ((*p == 0xE0 && p[1] < 0xA0) ||
+		    (*p == 0xED && p[1] >= 0xA0))
+			return -1;
+		*codepoint = ((*p & 0x0F) << 12) |
+			     ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+		p += 3;
+	} else {
+		/* UCS-2 cannot represent four-byte UTF-8 code points. */
+		return -1;
+	}
+
+	*input = p;
+	return 0;
+}
+
+/*
+ * Copy the leading bytes of p that are their own GSM 7 bit septet (letters,
+ * digits, most punctuation, LF and CR) to output, at most n of them.
+ * Returns the number of bytes copied. Blocks of 16 bytes are checked and
+ * copied at once where SIMD is available.
+ */
+static size_t
+Gsm7IdentityRun(const unsigned char* p, size_t n, unsigned char* output)
+{
+	size_t i = 0;
+
+#if defined(PDU_SSE2)
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	for (; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		// A-Z and a-z, folded to lower case.
+		const __m128i lower = _mm_or_si128(v, case_bit);
+		const __m128i letter = _mm_and_si128(
+			_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+		// ' ' to '?' except '$'. Bytes above 0x7F compare as negative.
+		const __m128i punct = _mm_andnot_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('$')),
+			_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ' - 1)),
+				      _mm_cmplt_epi8(v, _mm_set1_epi8('?' + 1))));
+		const __m128i line = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+		const int mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_or_si128(letter, punct), line));
+		_mm_storeu_si128((__m128i*)(output + i), v);
+		if (mask != 0xFFFF)
+			return i + __builtin_ctz(~mask);
+	}
+#elif defined(PDU_NEON)
+	for (; i + 16 <= n; i += 16) {
+		const uint8x16_t v = vld1q_u8(p + i);
+		const uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+		const uint8x16_t letter = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')),
+						   vcleq_u8(lower, vdupq_n_u8('z')));
+		const uint8x16_t punct = vbicq_u8(
+			vandq_u8(vcgeq_u8(v, vdupq_n_u8(' ')),
+				 vcleq_u8(v, vdupq_n_u8('?'))),
+			vceqq_u8(v, vdupq_n_u8('$')));
+		const uint8x16_t line = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')),
+						 vceqq_u8(v, vdupq_n_u8('\r')));
+		if (vminvq_u8(vorrq_u8(vorrq_u8(letter, punct), line)) != 0xFF)
+			break;
+		vst1q_u8(output + i, v);
+	}
+#endif
+	for (; i < n && p[i] < 0x80 && latin1_to_gsm7bits[p[i]] == p[i]; ++i)
+		output[i] = p[i];
+	return i;
+}
+
+/*
+ * Convert UTF-8 text to GSM 7 bit septets, one per octet. Returns the
+ * number of septets, -1 on invalid input or overflow, or
+ * GSM7_UNREPRESENTABLE when a character needs UCS-2.
+ */
 static int
-AsciiToG7bit(const char* buffer, int buffer_length, unsigned char* output_buffer)
+Utf8ToG7bit(const char* input, size_t input_length,
+	    unsigned char* output_buffer, int output_size)
 {
-	int i, j, val;
+	const unsigned char* p = (const unsigned char*)input;
+	const unsigned char* end = p + input_length;
+	int j = 0;
+
+	while (p < end) {
+		// Every septet written must leave room for an escape pair, as
+		// in the per-character path below.
+		if (output_size - j > 1) {
+			const size_t room = output_size - j - 1;
+			const size_t run = Gsm7IdentityRun(p, (size_t)(end - p) < room ?
+							   (size_t)(end - p) : room,
+							   output_buffer + j);
+			p += run;
+			j += run;
+			if (p == end)
+				break;
+		}
 
-	j=0;
-	for (i = 0; i < buffer_length; i++) {
-		val = latin1_to_gsm7bits[buffer[i] & 0xFF];
+		unsigned int codepoint;
+		if (Utf8Next(&p, &codepoint) < 0)
+			return -1;
+		const int val = CodepointToG7bit(codepoint);
+		if (val == GSM7_UNREPRESENTABLE)
+			return GSM7_UNREPRESENTABLE;
+		if (j + 2 > output_size)
+			return -1;
 		if (val < 0) {
 			output_buffer[j++] = GSM_7BITS_ESCAPE;
-			output_buffer[j++] = -1*val;
+			output_buffer[j++] = -val;
 		} else {
-			if (((buffer[i] & 0xFF) & 0xE0) == 0xC0) { /* test for two byte utf8 char */
-				val = NPC;
-				i++;
-			} else if (((buffer[i] & 0xFF) & 0xF0) == 0xE0) { /* test for three byte utf8 char */
-				val = NPC;
-				i++;
-				i++;
-			}
 			output_buffer[j++] = val;
 		}
 	}
 	return j;
 }
 
+/*
+ * The national language tables turned around, for encoding: the code
+ * points of each table that are not at their own ASCII position, sorted
+ * for a binary search. A character listed twice maps to its first septet.
+ */
+struct septet_code {
+	unsigned short codepoint;
+	unsigned char septet;
+};
+
+struct septet_map {
+	const struct septet_code* codes;
+	int count;
+};
+
+#define SEPTET_MAP(codes) { codes, sizeof(codes) / sizeof(codes[0]) }
+
+static const struct septet_code gsm7bits_septets[] = {
+	{ 0x0024, 0x02 }, { 0x0040, 0x00 }, { 0x005F, 0x11 }, { 0x00A1, 0x40 },
+	{ 0x00A3, 0x01 }, { 0x00A4, 0x24 }, { 0x00A5, 0x03 }, { 0x00A7, 0x5F },
+	{ 0x00BF, 0x60 }, { 0x00C4, 0x5B }, { 0x00C5, 0x0E }, { 0x00C6, 0x1C },
+	{ 0x00C7, 0x09 }, { 0x00C9, 0x1F }, { 0x00D1, 0x5D }, { 0x00D6, 0x5C },
+	{ 0x00D8, 0x0B }, { 0x00DC, 0x5E }, { 0x00DF, 0x1E }, { 0x00E0, 0x7F },
+	{ 0x00E4, 0x7B }, { 0x00E5, 0x0F }, { 0x00E6, 0x1D }, { 0x00E8, 0x04 },
+	{ 0x00E9, 0x05 }, { 0x00EC, 0x07 }, { 0x00F1, 0x7D }, { 0x00F2, 0x08 },
+	{ 0x00F6, 0x7C }, { 0x00F8, 0x0C }, { 0x00F9, 0x06 }, { 0x00FC, 0x7E },
+	{ 0x0393, 0x13 }, { 0x0394, 0x10 }, { 0x0398, 0x19 }, { 0x039B, 0x14 },
+	{ 0x039E, 0x1A }, { 0x03A0, 0x16 }, { 0x03A3, 0x18 }, { 0x03A6, 0x12 },
+	{ 0x03A8, 0x17 }, { 0x03A9, 0x15 },
+};
+
+static const struct septet_code gsm7bits_extend_septets[] = {
+	{ 0x000C, 0x0A }, { 0x005B, 0x3C }, { 0x005C, 0x2F }, { 0x005D, 0x3E },
+	{ 0x005E, 0x14 }, { 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 },
+	{ 0x007E, 0x3D }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code turkish_locking_shift_septets[] = {
+	{ 0x0024, 0x02 }, { 0x0040, 0x00 }, { 0x005F, 0x11 }, { 0x00A3, 0x01 },
+	{ 0x00A4, 0x24 }, { 0x00A5, 0x03 }, { 0x00A7, 0x5F }, { 0x00C4, 0x5B },
+	{ 0x00C5, 0x0E }, { 0x00C7, 0x09 }, { 0x00C9, 0x1F }, { 0x00D1, 0x5D },
+	{ 0x00D6, 0x5C }, { 0x00DC, 0x5E }, { 0x00DF, 0x1E }, { 0x00E0, 0x7F },
+	{ 0x00E4, 0x7B }, { 0x00E5, 0x0F }, { 0x00E7, 0x60 }, { 0x00E9, 0x05 },
+	{ 0x00F1, 0x7D }, { 0x00F2, 0x08 }, { 0x00F6, 0x7C }, { 0x00F9, 0x06 },
+	{ 0x00FC, 0x7E }, { 0x011E, 0x0B }, { 0x011F, 0x0C }, { 0x0130, 0x40 },
+	{ 0x0131, 0x07 }, { 0x015E, 0x1C }, { 0x015F, 0x1D }, { 0x0393, 0x13 },
+	{ 0x0394, 0x10 }, { 0x0398, 0x19 }, { 0x039B, 0x14 }, { 0x039E, 0x1A },
+	{ 0x03A0, 0x16 }, { 0x03A3, 0x18 }, { 0x03A6, 0x12 }, { 0x03A8, 0x17 },
+	{ 0x03A9, 0x15 }, { 0x20AC, 0x04 },
+};
+
+static const struct septet_code portuguese_locking_shift_septets[] = {
+	{ 0x0024, 0x02 }, { 0x0040, 0x00 }, { 0x005C, 0x17 }, { 0x005E, 0x16 },
+	{ 0x005F, 0x11 }, { 0x0060, 0x7D }, { 0x007C, 0x1A }, { 0x007E, 0x60 },
+	{ 0x00A3, 0x01 }, { 0x00A5, 0x03 }, { 0x00A7, 0x5F }, { 0x00AA, 0x12 },
+	{ 0x00BA, 0x24 }, { 0x00C0, 0x14 }, { 0x00C1, 0x0E }, { 0x00C2, 0x1C },
+	{ 0x00C3, 0x5B }, { 0x00C7, 0x13 }, { 0x00C9, 0x1F }, { 0x00CA, 0x1E },
+	{ 0x00CD, 0x40 }, { 0x00D3, 0x19 }, { 0x00D4, 0x0B }, { 0x00D5, 0x5C },
+	{ 0x00DA, 0x5D }, { 0x00DC, 0x5E }, { 0x00E0, 0x7F }, { 0x00E1, 0x0F },
+	{ 0x00E2, 0x1D }, { 0x00E3, 0x7B }, { 0x00E7, 0x09 }, { 0x00E9, 0x05 },
+	{ 0x00EA, 0x04 }, { 0x00ED, 0x07 }, { 0x00F3, 0x08 }, { 0x00F4, 0x0C },
+	{ 0x00F5, 0x7C }, { 0x00FA, 0x06 }, { 0x00FC, 0x7E }, { 0x0394, 0x10 },
+	{ 0x20AC, 0x18 }, { 0x221E, 0x15 },
+};
+
+static const struct septet_code bengali_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0981, 0x00 }, { 0x0982, 0x01 },
+	{ 0x0983, 0x02 }, { 0x0985, 0x03 }, { 0x0986, 0x04 }, { 0x0987, 0x05 },
+	{ 0x0988, 0x06 }, { 0x0989, 0x07 }, { 0x098A, 0x08 }, { 0x098B, 0x09 },
+	{ 0x098C, 0x0B }, { 0x098F, 0x0F }, { 0x0990, 0x10 }, { 0x0993, 0x13 },
+	{ 0x0994, 0x14 }, { 0x0995, 0x15 }, { 0x0996, 0x16 }, { 0x0997, 0x17 },
+	{ 0x0998, 0x18 }, { 0x0999, 0x19 }, { 0x099A, 0x1A }, { 0x099B, 0x1C },
+	{ 0x099C, 0x1D }, { 0x099D, 0x1E }, { 0x099E, 0x1F }, { 0x099F, 0x22 },
+	{ 0x09A0, 0x23 }, { 0x09A1, 0x24 }, { 0x09A2, 0x25 }, { 0x09A3, 0x26 },
+	{ 0x09A4, 0x27 }, { 0x09A5, 0x2A }, { 0x09A6, 0x2B }, { 0x09A7, 0x2D },
+	{ 0x09A8, 0x2F }, { 0x09AA, 0x3D }, { 0x09AB, 0x3E }, { 0x09AC, 0x40 },
+	{ 0x09AD, 0x41 }, { 0x09AE, 0x42 }, { 0x09AF, 0x43 }, { 0x09B0, 0x44 },
+	{ 0x09B2, 0x46 }, { 0x09B6, 0x4A }, { 0x09B7, 0x4B }, { 0x09B8, 0x4C },
+	{ 0x09B9, 0x4D }, { 0x09BC, 0x4E }, { 0x09BD, 0x4F }, { 0x09BE, 0x50 },
+	{ 0x09BF, 0x51 }, { 0x09C0, 0x52 }, { 0x09C1, 0x53 }, { 0x09C2, 0x54 },
+	{ 0x09C3, 0x55 }, { 0x09C4, 0x56 }, { 0x09C7, 0x59 }, { 0x09C8, 0x5A },
+	{ 0x09CB, 0x5D }, { 0x09CC, 0x5E }, { 0x09CD, 0x5F }, { 0x09CE, 0x60 },
+	{ 0x09D7, 0x7B }, { 0x09DC, 0x7C }, { 0x09DD, 0x7D }, { 0x09F0, 0x7E },
+	{ 0x09F1, 0x7F },
+};
+
+static const struct septet_code gujarati_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0A81, 0x00 }, { 0x0A82, 0x01 },
+	{ 0x0A83, 0x02 }, { 0x0A85, 0x03 }, { 0x0A86, 0x04 }, { 0x0A87, 0x05 },
+	{ 0x0A88, 0x06 }, { 0x0A89, 0x07 }, { 0x0A8A, 0x08 }, { 0x0A8B, 0x09 },
+	{ 0x0A8C, 0x0B }, { 0x0A8D, 0x0C }, { 0x0A8F, 0x0F }, { 0x0A90, 0x10 },
+	{ 0x0A91, 0x11 }, { 0x0A93, 0x13 }, { 0x0A94, 0x14 }, { 0x0A95, 0x15 },
+	{ 0x0A96, 0x16 }, { 0x0A97, 0x17 }, { 0x0A98, 0x18 }, { 0x0A99, 0x19 },
+	{ 0x0A9A, 0x1A }, { 0x0A9B, 0x1C }, { 0x0A9C, 0x1D }, { 0x0A9D, 0x1E },
+	{ 0x0A9E, 0x1F }, { 0x0A9F, 0x22 }, { 0x0AA0, 0x23 }, { 0x0AA1, 0x24 },
+	{ 0x0AA2, 0x25 }, { 0x0AA3, 0x26 }, { 0x0AA4, 0x27 }, { 0x0AA5, 0x2A },
+	{ 0x0AA6, 0x2B }, { 0x0AA7, 0x2D }, { 0x0AA8, 0x2F }, { 0x0AAA, 0x3D },
+	{ 0x0AAB, 0x3E }, { 0x0AAC, 0x40 }, { 0x0AAD, 0x41 }, { 0x0AAE, 0x42 },
+	{ 0x0AAF, 0x43 }, { 0x0AB0, 0x44 }, { 0x0AB2, 0x46 }, { 0x0AB3, 0x47 },
+	{ 0x0AB5, 0x49 }, { 0x0AB6, 0x4A }, { 0x0AB7, 0x4B }, { 0x0AB8, 0x4C },
+	{ 0x0AB9, 0x4D }, { 0x0ABC, 0x4E }, { 0x0ABD, 0x4F }, { 0x0ABE, 0x50 },
+	{ 0x0ABF, 0x51 }, { 0x0AC0, 0x52 }, { 0x0AC1, 0x53 }, { 0x0AC2, 0x54 },
+	{ 0x0AC3, 0x55 }, { 0x0AC4, 0x56 }, { 0x0AC5, 0x57 }, { 0x0AC7, 0x59 },
+	{ 0x0AC8, 0x5A }, { 0x0AC9, 0x5B }, { 0x0ACB, 0x5D }, { 0x0ACC, 0x5E },
+	{ 0x0ACD, 0x5F }, { 0x0AD0, 0x60 }, { 0x0AE0, 0x7B }, { 0x0AE1, 0x7C },
+	{ 0x0AE2, 0x7D }, { 0x0AE3, 0x7E }, { 0x0AF1, 0x7F },
+};
+
+static const struct septet_code hindi_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0901, 0x00 }, { 0x0902, 0x01 },
+	{ 0x0903, 0x02 }, { 0x0905, 0x03 }, { 0x0906, 0x04 }, { 0x0907, 0x05 },
+	{ 0x0908, 0x06 }, { 0x0909, 0x07 }, { 0x090A, 0x08 }, { 0x090B, 0x09 },
+	{ 0x090C, 0x0B }, { 0x090D, 0x0C }, { 0x090E, 0x0E }, { 0x090F, 0x0F },
+	{ 0x0910, 0x10 }, { 0x0911, 0x11 }, { 0x0912, 0x12 }, { 0x0913, 0x13 },
+	{ 0x0914, 0x14 }, { 0x0915, 0x15 }, { 0x0916, 0x16 }, { 0x0917, 0x17 },
+	{ 0x0918, 0x18 }, { 0x0919, 0x19 }, { 0x091A, 0x1A }, { 0x091B, 0x1C },
+	{ 0x091C, 0x1D }, { 0x091D, 0x1E }, { 0x091E, 0x1F }, { 0x091F, 0x22 },
+	{ 0x0920, 0x23 }, { 0x0921, 0x24 }, { 0x0922, 0x25 }, { 0x0923, 0x26 },
+	{ 0x0924, 0x27 }, { 0x0925, 0x2A }, { 0x0926, 0x2B }, { 0x0927, 0x2D },
+	{ 0x0928, 0x2F }, { 0x0929, 0x3C }, { 0x092A, 0x3D }, { 0x092B, 0x3E },
+	{ 0x092C, 0x40 }, { 0x092D, 0x41 }, { 0x092E, 0x42 }, { 0x092F, 0x43 },
+	{ 0x0930, 0x44 }, { 0x0931, 0x45 }, { 0x0932, 0x46 }, { 0x0933, 0x47 },
+	{ 0x0934, 0x48 }, { 0x0935, 0x49 }, { 0x0936, 0x4A }, { 0x0937, 0x4B },
+	{ 0x0938, 0x4C }, { 0x0939, 0x4D }, { 0x093C, 0x4E }, { 0x093D, 0x4F },
+	{ 0x093E, 0x50 }, { 0x093F, 0x51 }, { 0x0940, 0x52 }, { 0x0941, 0x53 },
+	{ 0x0942, 0x54 }, { 0x0943, 0x55 }, { 0x0944, 0x56 }, { 0x0945, 0x57 },
+	{ 0x0946, 0x58 }, { 0x0947, 0x59 }, { 0x0948, 0x5A }, { 0x0949, 0x5B },
+	{ 0x094A, 0x5C }, { 0x094B, 0x5D }, { 0x094C, 0x5E }, { 0x094D, 0x5F },
+	{ 0x0950, 0x60 }, { 0x0972, 0x7B }, { 0x097B, 0x7C }, { 0x097C, 0x7D },
+	{ 0x097E, 0x7E }, { 0x097F, 0x7F },
+};
+
+static const struct septet_code kannada_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0C82, 0x01 }, { 0x0C83, 0x02 },
+	{ 0x0C85, 0x03 }, { 0x0C86, 0x04 }, { 0x0C87, 0x05 }, { 0x0C88, 0x06 },
+	{ 0x0C89, 0x07 }, { 0x0C8A, 0x08 }, { 0x0C8B, 0x09 }, { 0x0C8C, 0x0B },
+	{ 0x0C8E, 0x0E }, { 0x0C8F, 0x0F }, { 0x0C90, 0x10 }, { 0x0C92, 0x12 },
+	{ 0x0C93, 0x13 }, { 0x0C94, 0x14 }, { 0x0C95, 0x15 }, { 0x0C96, 0x16 },
+	{ 0x0C97, 0x17 }, { 0x0C98, 0x18 }, { 0x0C99, 0x19 }, { 0x0C9A, 0x1A },
+	{ 0x0C9B, 0x1C }, { 0x0C9C, 0x1D }, { 0x0C9D, 0x1E }, { 0x0C9E, 0x1F },
+	{ 0x0C9F, 0x22 }, { 0x0CA0, 0x23 }, { 0x0CA1, 0x24 }, { 0x0CA2, 0x25 },
+	{ 0x0CA3, 0x26 }, { 0x0CA4, 0x27 }, { 0x0CA5, 0x2A }, { 0x0CA6, 0x2B },
+	{ 0x0CA7, 0x2D }, { 0x0CA8, 0x2F }, { 0x0CAA, 0x3D }, { 0x0CAB, 0x3E },
+	{ 0x0CAC, 0x40 }, { 0x0CAD, 0x41 }, { 0x0CAE, 0x42 }, { 0x0CAF, 0x43 },
+	{ 0x0CB0, 0x44 }, { 0x0CB1, 0x45 }, { 0x0CB2, 0x46 }, { 0x0CB3, 0x47 },
+	{ 0x0CB5, 0x49 }, { 0x0CB6, 0x4A }, { 0x0CB7, 0x4B }, { 0x0CB8, 0x4C },
+	{ 0x0CB9, 0x4D }, { 0x0CBC, 0x4E }, { 0x0CBD, 0x4F }, { 0x0CBE, 0x50 },
+	{ 0x0CBF, 0x51 }, { 0x0CC0, 0x52 }, { 0x0CC1, 0x53 }, { 0x0CC2, 0x54 },
+	{ 0x0CC3, 0x55 }, { 0x0CC4, 0x56 }, { 0x0CC6, 0x58 }, { 0x0CC7, 0x59 },
+	{ 0x0CC8, 0x5A }, { 0x0CCA, 0x5C }, { 0x0CCB, 0x5D }, { 0x0CCC, 0x5E },
+	{ 0x0CCD, 0x5F }, { 0x0CD5, 0x60 }, { 0x0CD6, 0x7B }, { 0x0CE0, 0x7C },
+	{ 0x0CE1, 0x7D }, { 0x0CE2, 0x7E }, { 0x0CE3, 0x7F },
+};
+
+static const struct septet_code malayalam_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0D02, 0x01 }, { 0x0D03, 0x02 },
+	{ 0x0D05, 0x03 }, { 0x0D06, 0x04 }, { 0x0D07, 0x05 }, { 0x0D08, 0x06 },
+	{ 0x0D09, 0x07 }, { 0x0D0A, 0x08 }, { 0x0D0B, 0x09 }, { 0x0D0C, 0x0B },
+	{ 0x0D0E, 0x0E }, { 0x0D0F, 0x0F }, { 0x0D10, 0x10 }, { 0x0D12, 0x12 },
+	{ 0x0D13, 0x13 }, { 0x0D14, 0x14 }, { 0x0D15, 0x15 }, { 0x0D16, 0x16 },
+	{ 0x0D17, 0x17 }, { 0x0D18, 0x18 }, { 0x0D19, 0x19 }, { 0x0D1A, 0x1A },
+	{ 0x0D1B, 0x1C }, { 0x0D1C, 0x1D }, { 0x0D1D, 0x1E }, { 0x0D1E, 0x1F },
+	{ 0x0D1F, 0x22 }, { 0x0D20, 0x23 }, { 0x0D21, 0x24 }, { 0x0D22, 0x25 },
+	{ 0x0D23, 0x26 }, { 0x0D24, 0x27 }, { 0x0D25, 0x2A }, { 0x0D26, 0x2B },
+	{ 0x0D27, 0x2D }, { 0x0D28, 0x2F }, { 0x0D2A, 0x3D }, { 0x0D2B, 0x3E },
+	{ 0x0D2C, 0x40 }, { 0x0D2D, 0x41 }, { 0x0D2E, 0x42 }, { 0x0D2F, 0x43 },
+	{ 0x0D30, 0x44 }, { 0x0D31, 0x45 }, { 0x0D32, 0x46 }, { 0x0D33, 0x47 },
+	{ 0x0D34, 0x48 }, { 0x0D35, 0x49 }, { 0x0D36, 0x4A }, { 0x0D37, 0x4B },
+	{ 0x0D38, 0x4C }, { 0x0D39, 0x4D }, { 0x0D3D, 0x4F }, { 0x0D3E, 0x50 },
+	{ 0x0D3F, 0x51 }, { 0x0D40, 0x52 }, { 0x0D41, 0x53 }, { 0x0D42, 0x54 },
+	{ 0x0D43, 0x55 }, { 0x0D44, 0x56 }, { 0x0D46, 0x58 }, { 0x0D47, 0x59 },
+	{ 0x0D48, 0x5A }, { 0x0D4A, 0x5C }, { 0x0D4B, 0x5D }, { 0x0D4C, 0x5E },
+	{ 0x0D4D, 0x5F }, { 0x0D57, 0x60 }, { 0x0D60, 0x7B }, { 0x0D61, 0x7C },
+	{ 0x0D62, 0x7D }, { 0x0D63, 0x7E }, { 0x0D79, 0x7F },
+};
+
+static const struct septet_code oriya_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0B01, 0x00 }, { 0x0B02, 0x01 },
+	{ 0x0B03, 0x02 }, { 0x0B05, 0x03 }, { 0x0B06, 0x04 }, { 0x0B07, 0x05 },
+	{ 0x0B08, 0x06 }, { 0x0B09, 0x07 }, { 0x0B0A, 0x08 }, { 0x0B0B, 0x09 },
+	{ 0x0B0C, 0x0B }, { 0x0B0F, 0x0F }, { 0x0B10, 0x10 }, { 0x0B13, 0x13 },
+	{ 0x0B14, 0x14 }, { 0x0B15, 0x15 }, { 0x0B16, 0x16 }, { 0x0B17, 0x17 },
+	{ 0x0B18, 0x18 }, { 0x0B19, 0x19 }, { 0x0B1A, 0x1A }, { 0x0B1B, 0x1C },
+	{ 0x0B1C, 0x1D }, { 0x0B1D, 0x1E }, { 0x0B1E, 0x1F }, { 0x0B1F, 0x22 },
+	{ 0x0B20, 0x23 }, { 0x0B21, 0x24 }, { 0x0B22, 0x25 }, { 0x0B23, 0x26 },
+	{ 0x0B24, 0x27 }, { 0x0B25, 0x2A }, { 0x0B26, 0x2B }, { 0x0B27, 0x2D },
+	{ 0x0B28, 0x2F }, { 0x0B2A, 0x3D }, { 0x0B2B, 0x3E }, { 0x0B2C, 0x40 },
+	{ 0x0B2D, 0x41 }, { 0x0B2E, 0x42 }, { 0x0B2F, 0x43 }, { 0x0B30, 0x44 },
+	{ 0x0B32, 0x46 }, { 0x0B33, 0x47 }, { 0x0B35, 0x49 }, { 0x0B36, 0x4A },
+	{ 0x0B37, 0x4B }, { 0x0B38, 0x4C }, { 0x0B39, 0x4D }, { 0x0B3C, 0x4E },
+	{ 0x0B3D, 0x4F }, { 0x0B3E, 0x50 }, { 0x0B3F, 0x51 }, { 0x0B40, 0x52 },
+	{ 0x0B41, 0x53 }, { 0x0B42, 0x54 }, { 0x0B43, 0x55 }, { 0x0B44, 0x56 },
+	{ 0x0B47, 0x59 }, { 0x0B48, 0x5A }, { 0x0B4B, 0x5D }, { 0x0B4C, 0x5E },
+	{ 0x0B4D, 0x5F }, { 0x0B56, 0x60 }, { 0x0B57, 0x7B }, { 0x0B60, 0x7C },
+	{ 0x0B61, 0x7D }, { 0x0B62, 0x7E }, { 0x0B63, 0x7F },
+};
+
+static const struct septet_code punjabi_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0A01, 0x00 }, { 0x0A02, 0x01 },
+	{ 0x0A03, 0x02 }, { 0x0A05, 0x03 }, { 0x0A06, 0x04 }, { 0x0A07, 0x05 },
+	{ 0x0A08, 0x06 }, { 0x0A09, 0x07 }, { 0x0A0A, 0x08 }, { 0x0A0F, 0x0F },
+	{ 0x0A10, 0x10 }, { 0x0A13, 0x13 }, { 0x0A14, 0x14 }, { 0x0A15, 0x15 },
+	{ 0x0A16, 0x16 }, { 0x0A17, 0x17 }, { 0x0A18, 0x18 }, { 0x0A19, 0x19 },
+	{ 0x0A1A, 0x1A }, { 0x0A1B, 0x1C }, { 0x0A1C, 0x1D }, { 0x0A1D, 0x1E },
+	{ 0x0A1E, 0x1F }, { 0x0A1F, 0x22 }, { 0x0A20, 0x23 }, { 0x0A21, 0x24 },
+	{ 0x0A22, 0x25 }, { 0x0A23, 0x26 }, { 0x0A24, 0x27 }, { 0x0A25, 0x2A },
+	{ 0x0A26, 0x2B }, { 0x0A27, 0x2D }, { 0x0A28, 0x2F }, { 0x0A2A, 0x3D },
+	{ 0x0A2B, 0x3E }, { 0x0A2C, 0x40 }, { 0x0A2D, 0x41 }, { 0x0A2E, 0x42 },
+	{ 0x0A2F, 0x43 }, { 0x0A30, 0x44 }, { 0x0A32, 0x46 }, { 0x0A33, 0x47 },
+	{ 0x0A35, 0x49 }, { 0x0A36, 0x4A }, { 0x0A38, 0x4C }, { 0x0A39, 0x4D },
+	{ 0x0A3C, 0x4E }, { 0x0A3E, 0x50 }, { 0x0A3F, 0x51 }, { 0x0A40, 0x52 },
+	{ 0x0A41, 0x53 }, { 0x0A42, 0x54 }, { 0x0A47, 0x59 }, { 0x0A48, 0x5A },
+	{ 0x0A4B, 0x5D }, { 0x0A4C, 0x5E }, { 0x0A4D, 0x5F }, { 0x0A51, 0x60 },
+	{ 0x0A70, 0x7B }, { 0x0A71, 0x7C }, { 0x0A72, 0x7D }, { 0x0A73, 0x7E },
+	{ 0x0A74, 0x7F },
+};
+
+static const struct septet_code tamil_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0B82, 0x01 }, { 0x0B83, 0x02 },
+	{ 0x0B85, 0x03 }, { 0x0B86, 0x04 }, { 0x0B87, 0x05 }, { 0x0B88, 0x06 },
+	{ 0x0B89, 0x07 }, { 0x0B8A, 0x08 }, { 0x0B8E, 0x0E }, { 0x0B8F, 0x0F },
+	{ 0x0B90, 0x10 }, { 0x0B92, 0x12 }, { 0x0B93, 0x13 }, { 0x0B94, 0x14 },
+	{ 0x0B95, 0x15 }, { 0x0B99, 0x19 }, { 0x0B9A, 0x1A }, { 0x0B9C, 0x1D },
+	{ 0x0B9E, 0x1F }, { 0x0B9F, 0x22 }, { 0x0BA3, 0x26 }, { 0x0BA4, 0x27 },
+	{ 0x0BA8, 0x2F }, { 0x0BA9, 0x3C }, { 0x0BAA, 0x3D }, { 0x0BAE, 0x42 },
+	{ 0x0BAF, 0x43 }, { 0x0BB0, 0x44 }, { 0x0BB1, 0x45 }, { 0x0BB2, 0x46 },
+	{ 0x0BB3, 0x47 }, { 0x0BB4, 0x48 }, { 0x0BB5, 0x49 }, { 0x0BB6, 0x4A },
+	{ 0x0BB7, 0x4B }, { 0x0BB8, 0x4C }, { 0x0BB9, 0x4D }, { 0x0BBE, 0x50 },
+	{ 0x0BBF, 0x51 }, { 0x0BC0, 0x52 }, { 0x0BC1, 0x53 }, { 0x0BC2, 0x54 },
+	{ 0x0BC6, 0x58 }, { 0x0BC7, 0x59 }, { 0x0BC8, 0x5A }, { 0x0BCA, 0x5C },
+	{ 0x0BCB, 0x5D }, { 0x0BCC, 0x5E }, { 0x0BCD, 0x5F }, { 0x0BD0, 0x60 },
+	{ 0x0BD7, 0x7B }, { 0x0BF0, 0x7C }, { 0x0BF1, 0x7D }, { 0x0BF2, 0x7E },
+	{ 0x0BF9, 0x7F },
+};
+
+static const struct septet_code telugu_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0C01, 0x00 }, { 0x0C02, 0x01 },
+	{ 0x0C03, 0x02 }, { 0x0C05, 0x03 }, { 0x0C06, 0x04 }, { 0x0C07, 0x05 },
+	{ 0x0C08, 0x06 }, { 0x0C09, 0x07 }, { 0x0C0A, 0x08 }, { 0x0C0B, 0x09 },
+	{ 0x0C0C, 0x0B }, { 0x0C0E, 0x0E }, { 0x0C0F, 0x0F }, { 0x0C10, 0x10 },
+	{ 0x0C12, 0x12 }, { 0x0C13, 0x13 }, { 0x0C14, 0x14 }, { 0x0C15, 0x15 },
+	{ 0x0C16, 0x16 }, { 0x0C17, 0x17 }, { 0x0C18, 0x18 }, { 0x0C19, 0x19 },
+	{ 0x0C1A, 0x1A }, { 0x0C1B, 0x1C }, { 0x0C1C, 0x1D }, { 0x0C1D, 0x1E },
+	{ 0x0C1E, 0x1F }, { 0x0C1F, 0x22 }, { 0x0C20, 0x23 }, { 0x0C21, 0x24 },
+	{ 0x0C22, 0x25 }, { 0x0C23, 0x26 }, { 0x0C24, 0x27 }, { 0x0C25, 0x2A },
+	{ 0x0C26, 0x2B }, { 0x0C27, 0x2D }, { 0x0C28, 0x2F }, { 0x0C2A, 0x3D },
+	{ 0x0C2B, 0x3E }, { 0x0C2C, 0x40 }, { 0x0C2D, 0x41 }, { 0x0C2E, 0x42 },
+	{ 0x0C2F, 0x43 }, { 0x0C30, 0x44 }, { 0x0C31, 0x45 }, { 0x0C32, 0x46 },
+	{ 0x0C33, 0x47 }, { 0x0C35, 0x49 }, { 0x0C36, 0x4A }, { 0x0C37, 0x4B },
+	{ 0x0C38, 0x4C }, { 0x0C39, 0x4D }, { 0x0C3D, 0x4F }, { 0x0C3E, 0x50 },
+	{ 0x0C3F, 0x51 }, { 0x0C40, 0x52 }, { 0x0C41, 0x53 }, { 0x0C42, 0x54 },
+	{ 0x0C43, 0x55 }, { 0x0C44, 0x56 }, { 0x0C46, 0x58 }, { 0x0C47, 0x59 },
+	{ 0x0C48, 0x5A }, { 0x0C4A, 0x5C }, { 0x0C4B, 0x5D }, { 0x0C4C, 0x5E },
+	{ 0x0C4D, 0x5F }, { 0x0C55, 0x60 }, { 0x0C56, 0x7B }, { 0x0C60, 0x7C },
+	{ 0x0C61, 0x7D }, { 0x0C62, 0x7E }, { 0x0C63, 0x7F },
+};
+
+static const struct septet_code urdu_locking_shift_septets[] = {
+	{ 0x0028, 0x29 }, { 0x0029, 0x28 }, { 0x0621, 0x58 }, { 0x0622, 0x01 },
+	{ 0x0627, 0x00 }, { 0x0628, 0x02 }, { 0x062A, 0x07 }, { 0x062B, 0x10 },
+	{ 0x062C, 0x11 }, { 0x062D, 0x18 }, { 0x062E, 0x19 }, { 0x062F, 0x1A },
+	{ 0x0630, 0x24 }, { 0x0631, 0x25 }, { 0x0632, 0x2B }, { 0x0633, 0x3D },
+	{ 0x0634, 0x3E }, { 0x0635, 0x40 }, { 0x0636, 0x41 }, { 0x0637, 0x42 },
+	{ 0x0638, 0x43 }, { 0x0639, 0x44 }, { 0x0641, 0x45 }, { 0x0642, 0x46 },
+	{ 0x0644, 0x4D }, { 0x0645, 0x4E }, { 0x0646, 0x4F }, { 0x0648, 0x53 },
+	{ 0x064D, 0x5C }, { 0x064F, 0x5E }, { 0x0650, 0x5D }, { 0x0651, 0x7C },
+	{ 0x0653, 0x7D }, { 0x0654, 0x60 }, { 0x0655, 0x7B }, { 0x0656, 0x7E },
+	{ 0x0657, 0x5F }, { 0x0670, 0x7F }, { 0x0679, 0x0B }, { 0x067A, 0x0E },
+	{ 0x067B, 0x03 }, { 0x067C, 0x0F }, { 0x067D, 0x0C }, { 0x067E, 0x05 },
+	{ 0x067F, 0x09 }, { 0x0680, 0x04 }, { 0x0681, 0x12 }, { 0x0683, 0x14 },
+	{ 0x0684, 0x13 }, { 0x0685, 0x15 }, { 0x0686, 0x16 }, { 0x0687, 0x17 },
+	{ 0x0688, 0x1D }, { 0x0689, 0x1E }, { 0x068A, 0x1F }, { 0x068C, 0x1C },
+	{ 0x068D, 0x23 }, { 0x068F, 0x22 }, { 0x0691, 0x26 }, { 0x0693, 0x27 },
+	{ 0x0696, 0x2D }, { 0x0698, 0x2F }, { 0x0699, 0x2A }, { 0x069A, 0x3C },
+	{ 0x06A6, 0x06 }, { 0x06A9, 0x47 }, { 0x06AA, 0x48 }, { 0x06AB, 0x49 },
+	{ 0x06AF, 0x4A }, { 0x06B1, 0x4C }, { 0x06B3, 0x4B }, { 0x06BA, 0x50 },
+	{ 0x06BB, 0x51 }, { 0x06BC, 0x52 }, { 0x06BE, 0x57 }, { 0x06C1, 0x56 },
+	{ 0x06C2, 0x08 }, { 0x06C4, 0x54 }, { 0x06CC, 0x59 }, { 0x06D0, 0x5A },
+	{ 0x06D2, 0x5B }, { 0x06D5, 0x55 },
+};
+
+static const struct septet_code turkish_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x005B, 0x3C }, { 0x005C, 0x2F }, { 0x005D, 0x3E },
+	{ 0x005E, 0x14 }, { 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 },
+	{ 0x007E, 0x3D }, { 0x00E7, 0x63 }, { 0x011E, 0x47 }, { 0x011F, 0x67 },
+	{ 0x0130, 0x49 }, { 0x0131, 0x69 }, { 0x015E, 0x53 }, { 0x015F, 0x73 },
+	{ 0x20AC, 0x65 },
+};
+
+static const struct septet_code spanish_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x005B, 0x3C }, { 0x005C, 0x2F }, { 0x005D, 0x3E },
+	{ 0x005E, 0x14 }, { 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 },
+	{ 0x007E, 0x3D }, { 0x00C1, 0x41 }, { 0x00CD, 0x49 }, { 0x00D3, 0x4F },
+	{ 0x00DA, 0x55 }, { 0x00E1, 0x61 }, { 0x00E7, 0x09 }, { 0x00ED, 0x69 },
+	{ 0x00F3, 0x6F }, { 0x00FA, 0x75 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code portuguese_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x005B, 0x3C }, { 0x005C, 0x2F }, { 0x005D, 0x3E },
+	{ 0x005E, 0x14 }, { 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 },
+	{ 0x007E, 0x3D }, { 0x00C0, 0x41 }, { 0x00C1, 0x0E }, { 0x00C2, 0x61 },
+	{ 0x00C3, 0x5B }, { 0x00CA, 0x1F }, { 0x00CD, 0x49 }, { 0x00D3, 0x4F },
+	{ 0x00D4, 0x0B }, { 0x00D5, 0x5C }, { 0x00DA, 0x55 }, { 0x00E1, 0x0F },
+	{ 0x00E2, 0x7F }, { 0x00E3, 0x7B }, { 0x00E7, 0x09 }, { 0x00EA, 0x05 },
+	{ 0x00ED, 0x69 }, { 0x00F3, 0x6F }, { 0x00F4, 0x0C }, { 0x00F5, 0x7C },
+	{ 0x00FA, 0x75 }, { 0x0393, 0x13 }, { 0x0398, 0x19 }, { 0x03A0, 0x16 },
+	{ 0x03A3, 0x18 }, { 0x03A6, 0x12 }, { 0x03A8, 0x17 }, { 0x03A9, 0x15 },
+	{ 0x20AC, 0x65 },
+};
+
+static const struct septet_code bengali_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x09E6, 0x1C },
+	{ 0x09E7, 0x1D }, { 0x09E8, 0x1E }, { 0x09E9, 0x1F }, { 0x09EA, 0x20 },
+	{ 0x09EB, 0x21 }, { 0x09EC, 0x22 }, { 0x09ED, 0x23 }, { 0x09EE, 0x24 },
+	{ 0x09EF, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code gujarati_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0AE6, 0x1C },
+	{ 0x0AE7, 0x1D }, { 0x0AE8, 0x1E }, { 0x0AE9, 0x1F }, { 0x0AEA, 0x20 },
+	{ 0x0AEB, 0x21 }, { 0x0AEC, 0x22 }, { 0x0AED, 0x23 }, { 0x0AEE, 0x24 },
+	{ 0x0AEF, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code hindi_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0951, 0x26 }, { 0x0952, 0x27 }, { 0x0953, 0x2A },
+	{ 0x0954, 0x2B }, { 0x0958, 0x2C }, { 0x0959, 0x2D }, { 0x095A, 0x2E },
+	{ 0x095B, 0x30 }, { 0x095C, 0x31 }, { 0x095D, 0x32 }, { 0x095E, 0x33 },
+	{ 0x095F, 0x34 }, { 0x0960, 0x35 }, { 0x0961, 0x36 }, { 0x0962, 0x37 },
+	{ 0x0963, 0x38 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0966, 0x1C },
+	{ 0x0967, 0x1D }, { 0x0968, 0x1E }, { 0x0969, 0x1F }, { 0x096A, 0x20 },
+	{ 0x096B, 0x21 }, { 0x096C, 0x22 }, { 0x096D, 0x23 }, { 0x096E, 0x24 },
+	{ 0x096F, 0x25 }, { 0x0970, 0x39 }, { 0x0971, 0x3A }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code kannada_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0CE6, 0x1C },
+	{ 0x0CE7, 0x1D }, { 0x0CE8, 0x1E }, { 0x0CE9, 0x1F }, { 0x0CEA, 0x20 },
+	{ 0x0CEB, 0x21 }, { 0x0CEC, 0x22 }, { 0x0CED, 0x23 }, { 0x0CEE, 0x24 },
+	{ 0x0CEF, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code malayalam_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0D66, 0x1C },
+	{ 0x0D67, 0x1D }, { 0x0D68, 0x1E }, { 0x0D69, 0x1F }, { 0x0D6A, 0x20 },
+	{ 0x0D6B, 0x21 }, { 0x0D6C, 0x22 }, { 0x0D6D, 0x23 }, { 0x0D6E, 0x24 },
+	{ 0x0D6F, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code oriya_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0B66, 0x1C },
+	{ 0x0B67, 0x1D }, { 0x0B68, 0x1E }, { 0x0B69, 0x1F }, { 0x0B6A, 0x20 },
+	{ 0x0B6B, 0x21 }, { 0x0B6C, 0x22 }, { 0x0B6D, 0x23 }, { 0x0B6E, 0x24 },
+	{ 0x0B6F, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code punjabi_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0A66, 0x1C },
+	{ 0x0A67, 0x1D }, { 0x0A68, 0x1E }, { 0x0A69, 0x1F }, { 0x0A6A, 0x20 },
+	{ 0x0A6B, 0x21 }, { 0x0A6C, 0x22 }, { 0x0A6D, 0x23 }, { 0x0A6E, 0x24 },
+	{ 0x0A6F, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code tamil_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0BE6, 0x1C },
+	{ 0x0BE7, 0x1D }, { 0x0BE8, 0x1E }, { 0x0BE9, 0x1F }, { 0x0BEA, 0x20 },
+	{ 0x0BEB, 0x21 }, { 0x0BEC, 0x22 }, { 0x0BED, 0x23 }, { 0x0BEE, 0x24 },
+	{ 0x0BEF, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code telugu_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0964, 0x19 }, { 0x0965, 0x1A }, { 0x0C66, 0x1C },
+	{ 0x0C67, 0x1D }, { 0x0C68, 0x1E }, { 0x0C69, 0x1F }, { 0x0C6A, 0x20 },
+	{ 0x0C6B, 0x21 }, { 0x0C6C, 0x22 }, { 0x0C6D, 0x23 }, { 0x0C6E, 0x24 },
+	{ 0x0C6F, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_code urdu_single_shift_septets[] = {
+	{ 0x000C, 0x0A }, { 0x0022, 0x05 }, { 0x0023, 0x17 }, { 0x0024, 0x02 },
+	{ 0x0025, 0x07 }, { 0x0026, 0x08 }, { 0x0027, 0x09 }, { 0x002A, 0x0B },
+	{ 0x002B, 0x0C }, { 0x002D, 0x0E }, { 0x002F, 0x0F }, { 0x003C, 0x10 },
+	{ 0x003D, 0x11 }, { 0x003E, 0x12 }, { 0x0040, 0x00 }, { 0x005B, 0x3C },
+	{ 0x005C, 0x2F }, { 0x005D, 0x3E }, { 0x005E, 0x14 }, { 0x005F, 0x16 },
+	{ 0x007B, 0x28 }, { 0x007C, 0x40 }, { 0x007D, 0x29 }, { 0x007E, 0x3D },
+	{ 0x00A1, 0x13 }, { 0x00A3, 0x01 }, { 0x00A4, 0x06 }, { 0x00A5, 0x03 },
+	{ 0x00BF, 0x04 }, { 0x0600, 0x19 }, { 0x0601, 0x1A }, { 0x060C, 0x26 },
+	{ 0x060D, 0x27 }, { 0x060E, 0x2A }, { 0x060F, 0x2B }, { 0x0610, 0x2C },
+	{ 0x0611, 0x2D }, { 0x0612, 0x2E }, { 0x0613, 0x30 }, { 0x0614, 0x31 },
+	{ 0x061B, 0x32 }, { 0x061F, 0x33 }, { 0x0640, 0x34 }, { 0x0652, 0x35 },
+	{ 0x0658, 0x36 }, { 0x066B, 0x37 }, { 0x066C, 0x38 }, { 0x0672, 0x39 },
+	{ 0x0673, 0x3A }, { 0x06CD, 0x3B }, { 0x06D4, 0x3F }, { 0x06F0, 0x1C },
+	{ 0x06F1, 0x1D }, { 0x06F2, 0x1E }, { 0x06F3, 0x1F }, { 0x06F4, 0x20 },
+	{ 0x06F5, 0x21 }, { 0x06F6, 0x22 }, { 0x06F7, 0x23 }, { 0x06F8, 0x24 },
+	{ 0x06F9, 0x25 }, { 0x20AC, 0x65 },
+};
+
+static const struct septet_map locking_shift_septets[SMS_LANGUAGE_COUNT] = {
+	[SMS_LANGUAGE_DEFAULT]    = SEPTET_MAP(gsm7bits_septets),
+	[SMS_LANGUAGE_TURKISH]    = SEPTET_MAP(turkish_locking_shift_septets),
+	[SMS_LANGUAGE_PORTUGUESE] = SEPTET_MAP(portuguese_locking_shift_septets),
+	[SMS_LANGUAGE_BENGALI]    = SEPTET_MAP(bengali_locking_shift_septets),
+	[SMS_LANGUAGE_GUJARATI]   = SEPTET_MAP(gujarati_locking_shift_septets),
+	[SMS_LANGUAGE_HINDI]      = SEPTET_MAP(hindi_locking_shift_septets),
+	[SMS_LANGUAGE_KANNADA]    = SEPTET_MAP(kannada_locking_shift_septets),
+	[SMS_LANGUAGE_MALAYALAM]  = SEPTET_MAP(malayalam_locking_shift_septets),
+	[SMS_LANGUAGE_ORIYA]      = SEPTET_MAP(oriya_locking_shift_septets),
+	[SMS_LANGUAGE_PUNJABI]    = SEPTET_MAP(punjabi_locking_shift_septets),
+	[SMS_LANGUAGE_TAMIL]      = SEPTET_MAP(tamil_locking_shift_septets),
+	[SMS_LANGUAGE_TELUGU]     = SEPTET_MAP(telugu_locking_shift_septets),
+	[SMS_LANGUAGE_URDU]       = SEPTET_MAP(urdu_locking_shift_septets),
+};
+static const struct septet_map single_shift_septets[SMS_LANGUAGE_COUNT] = {
+	[SMS_LANGUAGE_DEFAULT]    = SEPTET_MAP(gsm7bits_extend_septets),
+	[SMS_LANGUAGE_TURKISH]    = SEPTET_MAP(turkish_single_shift_septets),
+	[SMS_LANGUAGE_SPANISH]    = SEPTET_MAP(spanish_single_shift_septets),
+	[SMS_LANGUAGE_PORTUGUESE] = SEPTET_MAP(portuguese_single_shift_septets),
+	[SMS_LANGUAGE_BENGALI]    = SEPTET_MAP(bengali_single_shift_septets),
+	[SMS_LANGUAGE_GUJARATI]   = SEPTET_MAP(gujarati_single_shift_septets),
+	[SMS_LANGUAGE_HINDI]      = SEPTET_MAP(hindi_single_shift_septets),
+	[SMS_LANGUAGE_KANNADA]    = SEPTET_MAP(kannada_single_shift_septets),
+	[SMS_LANGUAGE_MALAYALAM]  = SEPTET_MAP(malayalam_single_shift_septets),
+	[SMS_LANGUAGE_ORIYA]      = SEPTET_MAP(oriya_single_shift_septets),
+	[SMS_LANGUAGE_PUNJABI]    = SEPTET_MAP(punjabi_single_shift_septets),
+	[SMS_LANGUAGE_TAMIL]      = SEPTET_MAP(tamil_single_shift_septets),
+	[SMS_LANGUAGE_TELUGU]     = SEPTET_MAP(telugu_single_shift_septets),
+	[SMS_LANGUAGE_URDU]       = SEPTET_MAP(urdu_single_shift_septets),
+};
+
+static const struct septet_map*
+LockingShiftSeptets(int language)
+{
+	if (language < 0 || language >= SMS_LANGUAGE_COUNT ||
+	    !locking_shift_septets[language].codes)
+		return &locking_shift_septets[SMS_LANGUAGE_DEFAULT];
+	return &locking_shift_septets[language];
+}
+
+static const struct septet_map*
+SingleShiftSeptets(int language)
+{
+	if (language < 0 || language >= SMS_LANGUAGE_COUNT)
+		return &single_shift_septets[SMS_LANGUAGE_DEFAULT];
+	return &single_shift_septets[language];
+}
+
+// Find a code point in a national language table; -1 if it is missing.
+static int
+FindSeptet(const struct utf8_char* table, const struct septet_map* map,
+	   unsigned int codepoint)
+{
+	if (codepoint < 0x80 && table[codepoint].length == 1 &&
+	    table[codepoint].bytes[0] == (char)codepoint)
+		return codepoint;
+	int low = 0;
+	int high = map->count;
+	while (low < high) {
+		const int middle = (low + high) / 2;
+		if (map->codes[middle].codepoint < codepoint)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low < map->count && map->codes[low].codepoint == codepoint)
+		return map->codes[low].septet;
+	return -1;
+}
+
+/*
+ * Same as Utf8ToG7bit(), but with the given locking and single shift
+ * tables. Septets found through the single shift table are escaped.
+ */
+static int
+Utf8ToG7bitShift(const char* input, int locking, int single,
+		 unsigned char* output_buffer, int output_size)
+{
+	if (locking == SMS_LANGUAGE_DEFAULT && single == SMS_LANGUAGE_DEFAULT)
+		return Utf8ToG7bit(input, strlen(input), output_buffer,
+				   output_size);
+
+	const struct utf8_char* basic = LockingShiftUtf8(locking);
+	const struct utf8_char* extension = SingleShiftUtf8(single);
+	const struct septet_map* basic_septets = LockingShiftSeptets(locking);
+	const struct septet_map* extension_septets = SingleShiftSeptets(single);
+	const unsigned char* p = (const unsigned char*)input;
+	int j = 0;
+
+	while (*p) {
+		unsigned int codepoint;
+		if (Utf8Next(&p, &codepoint) < 0)
+			return -1;
+		int val = codepoint ?
+			FindSeptet(basic, basic_septets, codepoint) : -1;
+		int escaped = 0;
+		if (val < 0) {
+			val = codepoint ? FindSeptet(extension, extension_septets,
+						    codepoint) : -1;
+			escaped = 1;
+		}
+		if (val < 0) {
+			if (codepoint >= 0x80)
+				return GSM7_UNREPRESENTABLE;
+			val = '?';
+			escaped = 0;
+		}
+		if (j + 2 > output_size)
+			return -1;
+		if (escaped)
+			output_buffer[j++] = GSM_7BITS_ESCAPE;
+		output_buffer[j++] = val;
+	}
+	return j;
+}
+
 // Encode a digit based phone number for SMS based format.
 static int
 EncodePhoneNumber(const char* phone_number, unsigned char* output_buffer, int buffer_size)
@@ -273,175 +2523,849 @@ EncodePhoneNumber(const char* phone_number, unsigned char* output_buffer, int bu
 	return output_buffer_length;
 }
 
+// Widen the leading ASCII bytes of p to UCS-2, at most n of them. Returns
+// the number of characters converted.
+static size_t
+AsciiToUcs2Run(const unsigned char* p, size_t n, unsigned char* output)
+{
+	size_t i = 0;
+
+#if defined(PDU_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		const int mask = _mm_movemask_epi8(v);
+		// Interleaving zero bytes first gives big-endian UCS-2.
+		_mm_storeu_si128((__m128i*)(output + 2 * i),
+				 _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i*)(output + 2 * i + 16),
+				 _mm_unpackhi_epi8(zero, v));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(PDU_NEON)
+	const uint8x16_t zero = vdupq_n_u8(0);
+	for (; i + 16 <= n; i += 16) {
+		const uint8x16_t v = vld1q_u8(p + i);
+		if (vmaxvq_u8(v) >= 0x80)
+			break;
+		const uint8x16x2_t wide = vzipq_u8(zero, v);
+		vst1q_u8(output + 2 * i, wide.val[0]);
+		vst1q_u8(output + 2 * i + 16, wide.val[1]);
+	}
+#endif
+	for (; i < n && p[i] < 0x80; ++i) {
+		output[2 * i] = 0;
+		output[2 * i + 1] = p[i];
+	}
+	return i;
+}
+
 /*
  * Convert a valid UTF-8 string to UCS-2 (UTF-16BE without surrogate pairs).
  * SMS UCS-2 user data is limited to 140 octets for a single message.
  */
 static int
-Utf8ToUcs2(const char* input, unsigned char* output_buffer, int buffer_size)
+Utf8ToUcs2(const char* input, size_t input_length,
+	   unsigned char* output_buffer, int buffer_size)
 {
 	const unsigned char* p = (const unsigned char*)input;
+	const unsigned char* end = p + input_length;
 	int output_buffer_length = 0;
 
-	while (*p) {
+	while (p < end) {
+		const size_t room = (buffer_size - output_buffer_length) / 2;
+		const size_t run = AsciiToUcs2Run(p, (size_t)(end - p) < room ?
+						  (size_t)(end - p) : room,
+						  output_buffer + output_buffer_length);
+		p += run;
+		output_buffer_length += 2 * run;
+		if (p == end)
+			break;
+
 		unsigned int codepoint;
+		if (Utf8Next(&p, &codepoint) < 0)
+			return -1;
+		if (output_buffer_length + 2 > buffer_size)
+			return -1;
+		output_buffer[output_buffer_length++] = codepoint >> 8;
+		output_buffer[output_buffer_length++] = codepoint & 0xFF;
+	}
+
+	return output_buffer_length;
+}
+
+// Narrow the leading UCS-2 code units of p below 0x80 to ASCII, at most n
+// of them. Returns the number of code units converted.
+static size_t
+Ucs2ToAsciiRun(const unsigned char* p, size_t n, char* output)
+{
+	size_t i = 0;
+
+#if defined(PDU_SSE2)
+	// A big-endian unit below 0x80 reads as a little-endian lane with
+	// none of the bits in 0x80FF set.
+	const __m128i non_ascii = _mm_set1_epi16(0x80FF);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(p + 2 * i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, non_ascii),
+						      zero)) != 0xFFFF)
+			break;
+		const __m128i ascii = _mm_srli_epi16(v, 8);
+		_mm_storel_epi64((__m128i*)(output + i),
+				 _mm_packus_epi16(ascii, ascii));
+	}
+#elif defined(PDU_NEON)
+	for (; i + 8 <= n; i += 8) {
+		const uint16x8_t v =
+			vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(p + 2 * i)));
+		if (vmaxvq_u16(v) >= 0x80)
+			break;
+		vst1_u8((uint8_t*)output + i, vmovn_u16(v));
+	}
+#endif
+	for (; i < n && p[2 * i] == 0 && p[2 * i + 1] < 0x80; ++i)
+		output[i] = p[2 * i + 1];
+	return i;
+}
+
+// Convert the leading UCS-2 code units of p from 0x80 to 0x7FF to two byte
+// UTF-8, at most n of them. Returns the number of code units converted.
+static size_t
+Ucs2ToTwoByteRun(const unsigned char* p, size_t n, char* output)
+{
+	size_t i = 0;
+
+#if defined(PDU_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(p + 2 * i));
+		const __m128i u = _mm_or_si128(_mm_slli_epi16(v, 8),
+					       _mm_srli_epi16(v, 8));
+		const __m128i above = _mm_and_si128(u, _mm_set1_epi16(0xF800));
+		const __m128i below = _mm_and_si128(u, _mm_set1_epi16(0xFF80));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(above, zero)) != 0xFFFF ||
+		    _mm_movemask_epi8(_mm_cmpeq_epi16(below, zero)) != 0)
+			break;
+		const __m128i lead = _mm_or_si128(_mm_srli_epi16(u, 6),
+						  _mm_set1_epi16(0xC0));
+		const __m128i trail = _mm_or_si128(
+			_mm_and_si128(u, _mm_set1_epi16(0x3F)),
+			_mm_set1_epi16(0x80));
+		_mm_storeu_si128((__m128i*)(output + 2 * i),
+				 _mm_or_si128(lead, _mm_slli_epi16(trail, 8)));
+	}
+#elif defined(PDU_NEON)
+	for (; i + 8 <= n; i += 8) {
+		const uint16x8_t u =
+			vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(p + 2 * i)));
+		if (vmaxvq_u16(u) >= 0x800 || vminvq_u16(u) < 0x80)
+			break;
+		const uint16x8_t lead = vorrq_u16(vshrq_n_u16(u, 6),
+						  vdupq_n_u16(0xC0));
+		const uint16x8_t trail = vorrq_u16(vandq_u16(u, vdupq_n_u16(0x3F)),
+						   vdupq_n_u16(0x80));
+		vst1q_u8((uint8_t*)output + 2 * i,
+			 vreinterpretq_u8_u16(vorrq_u16(lead,
+							vshlq_n_u16(trail, 8))));
+	}
+#endif
+	for (; i < n; ++i) {
+		const unsigned int u = (p[2 * i] << 8) | p[2 * i + 1];
+		if (u < 0x80 || u >= 0x800)
+			break;
+		output[2 * i] = 0xC0 | (u >> 6);
+		output[2 * i + 1] = 0x80 | (u & 0x3F);
+	}
+	return i;
+}
+
+// Convert the leading UCS-2 code units of p from 0x800 up, surrogates
+// excluded, to three byte UTF-8, at most n of them. Returns the number of
+// code units converted.
+static size_t
+Ucs2ToThreeByteRun(const unsigned char* p, size_t n, char* output)
+{
+	size_t i = 0;
+
+	for (; i < n; ++i) {
+		const unsigned int u = (p[2 * i] << 8) | p[2 * i + 1];
+		if (u < 0x800 || (u >= 0xD800 && u < 0xE000))
+			break;
+		output[3 * i] = 0xE0 | (u >> 12);
+		output[3 * i + 1] = 0x80 | ((u >> 6) & 0x3F);
+		output[3 * i + 2] = 0x80 | (u & 0x3F);
+	}
+	return i;
+}
+
+// Convert UTF-16BE to UTF-8; see pdu.h.
+size_t
+ucs2be_to_utf8(const uint8_t* ucs2, size_t ucs2_length, char* utf8,
+	       size_t utf8_size)
+{
+	if (utf8_size == 0)
+		return 0;
+
+	const size_t units = ucs2_length / 2;
+	const size_t limit = utf8_size - 1;
+	size_t i = 0;
+	size_t length = 0;
+
+	while (i < units) {
+		unsigned int codepoint = (ucs2[2 * i] << 8) | ucs2[2 * i + 1];
+		const size_t room = limit - length;
+
+		if (codepoint < 0x80) {
+			const size_t run = Ucs2ToAsciiRun(ucs2 + 2 * i,
+				units - i < room ? units - i : room, utf8 + length);
+			if (run == 0)
+				break;
+			i += run;
+			length += run;
+			continue;
+		}
+		if (codepoint < 0x800) {
+			const size_t run = Ucs2ToTwoByteRun(ucs2 + 2 * i,
+				units - i < room / 2 ? units - i : room / 2,
+				utf8 + length);
+			if (run == 0)
+				break;
+			i += run;
+			length += 2 * run;
+			continue;
+		}
+		if (codepoint < 0xD800 || codepoint >= 0xE000) {
+			const size_t run = Ucs2ToThreeByteRun(ucs2 + 2 * i,
+				units - i < room / 3 ? units - i : room / 3,
+				utf8 + length);
+			if (run == 0)
+				break;
+			i += run;
+			length += 3 * run;
+			continue;
+		}
 
-		if (*p < 0x80) {
-			codepoint = *p++;
-		} else if (*p >= 0xC2 && *p <= 0xDF) {
-			if ((p[1] & 0xC0) != 0x80)
-				return -1;
-			codepoint = ((*p & 0x1F) << 6) | (p[1] & 0x3F);
-			p += 2;
-		} else if (*p >= 0xE0 && *p <= 0xEF) {
-			if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
-				return -1;
-			if ((*p == 0xE0 && p[1] < 0xA0) ||
-			    (*p == 0xED && p[1] >= 0xA0))
-				return -1;
-			codepoint = ((*p & 0x0F) << 12) |
-				    ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
-			p += 3;
+		// A surrogate, paired with the next unit when that is a low one.
+		size_t used = 1;
+		if (codepoint < 0xDC00 && i + 1 < units) {
+			const unsigned int low = (ucs2[2 * i + 2] << 8) |
+				ucs2[2 * i + 3];
+			if (low >= 0xDC00 && low < 0xE000) {
+				codepoint = 0x10000 + ((codepoint - 0xD800) << 10) +
+					(low - 0xDC00);
+				used = 2;
+			}
+		}
+		if (codepoint < 0x10000) {
+			// Unpaired surrogates become U+FFFD REPLACEMENT CHARACTER.
+			if (room < 3)
+				break;
+			codepoint = 0xFFFD;
+			utf8[length++] = 0xE0 | (codepoint >> 12);
 		} else {
-			/* UCS-2 cannot represent four-byte UTF-8 code points. */
+			if (room < 4)
+				break;
+			utf8[length++] = 0xF0 | (codepoint >> 18);
+			utf8[length++] = 0x80 | ((codepoint >> 12) & 0x3F);
+		}
+		utf8[length++] = 0x80 | ((codepoint >> 6) & 0x3F);
+		utf8[length++] = 0x80 | (codepoint & 0x3F);
+		i += used;
+	}
+
+	utf8[length] = 0;
+	return length;
+}
+
+// Hex digit values plus one; 0 for anything else.
+static const unsigned char hex_values[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+#if defined(PDU_SSE2)
+// Values of 16 hex digits; *valid is cleared when any character is not
+// one. The compares are signed, so bytes from 0x80 up fail them all.
+static __m128i
+HexNibbles(__m128i c, int* valid)
+{
+	const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	const __m128i digit = _mm_and_si128(
+		_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+		_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	const __m128i letter = _mm_and_si128(
+		_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+		_mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+	*valid &= _mm_movemask_epi8(_mm_or_si128(digit, letter)) == 0xFFFF;
+	return _mm_or_si128(
+		_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+		_mm_and_si128(letter, _mm_sub_epi8(lower,
+						   _mm_set1_epi8('a' - 10))));
+}
+
+// Combine the nibble pairs, high one first, into the low byte of each
+// 16-bit lane.
+static __m128i
+HexPairs(__m128i nibbles)
+{
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xFF)), 4),
+		_mm_srli_epi16(nibbles, 8));
+}
+
+// Hex digits of 16 nibble values.
+static __m128i
+HexDigits(__m128i n)
+{
+	return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+			    _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)),
+					  _mm_set1_epi8('A' - '9' - 1)));
+}
+#elif defined(PDU_NEON)
+// Values of 16 hex digits; lanes of valid are cleared for other characters.
+static uint8x16_t
+HexNibbles(uint8x16_t c, uint8x16_t* valid)
+{
+	const uint8x16_t digit_value = vsubq_u8(c, vdupq_n_u8('0'));
+	const uint8x16_t letter_value = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)),
+						 vdupq_n_u8('a'));
+	const uint8x16_t digit = vcltq_u8(digit_value, vdupq_n_u8(10));
+	const uint8x16_t letter = vcltq_u8(letter_value, vdupq_n_u8(6));
+	*valid = vandq_u8(*valid, vorrq_u8(digit, letter));
+	return vbslq_u8(digit, digit_value,
+			vaddq_u8(letter_value, vdupq_n_u8(10)));
+}
+#endif
+
+// Convert octets to hex; see pdu.h.
+void
+pdu_hex_encode(const unsigned char* data, int length, char* hex)
+{
+	int i = 0;
+
+#if defined(PDU_SSE2)
+	const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+	for (; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+		const __m128i high = HexDigits(_mm_and_si128(_mm_srli_epi16(v, 4),
+							     low_nibbles));
+		const __m128i low = HexDigits(_mm_and_si128(v, low_nibbles));
+		_mm_storeu_si128((__m128i*)(hex + 2 * i),
+				 _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128((__m128i*)(hex + 2 * i + 16),
+				 _mm_unpackhi_epi8(high, low));
+	}
+#elif defined(PDU_NEON)
+	const uint8x16_t digits = vld1q_u8((const uint8_t*)hex_digits);
+	for (; i + 16 <= length; i += 16) {
+		const uint8x16_t v = vld1q_u8(data + i);
+		uint8x16x2_t pairs;
+		pairs.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+		pairs.val[1] = vqtbl1q_u8(digits, vandq_u8(v, vdupq_n_u8(0x0F)));
+		vst2q_u8((uint8_t*)hex + 2 * i, pairs);
+	}
+#endif
+	for (; i < length; ++i) {
+		hex[2 * i] = hex_digits[data[i] >> 4];
+		hex[2 * i + 1] = hex_digits[data[i] & 0x0F];
+	}
+	hex[2 * i] = '\0';
+}
+
+// Convert hex to octets; see pdu.h.
+int
+pdu_hex_decode(const char* hex, int hex_length, unsigned char* output,
+	       int output_size)
+{
+	if (hex_length < 0 || hex_length % 2 || hex_length / 2 > output_size)
+		return -1;
+
+	const unsigned char* p = (const unsigned char*)hex;
+	int i = 0;
+
+#if defined(PDU_SSE2)
+	int valid = 1;
+	for (; i + 32 <= hex_length; i += 32) {
+		const __m128i first = HexPairs(HexNibbles(
+			_mm_loadu_si128((const __m128i*)(p + i)), &valid));
+		const __m128i second = HexPairs(HexNibbles(
+			_mm_loadu_si128((const __m128i*)(p + i + 16)), &valid));
+		_mm_storeu_si128((__m128i*)(output + i / 2),
+				 _mm_packus_epi16(first, second));
+	}
+	if (!valid)
+		return -1;
+#elif defined(PDU_NEON)
+	uint8x16_t valid = vdupq_n_u8(0xFF);
+	for (; i + 32 <= hex_length; i += 32) {
+		// Even characters are the high nibbles, odd ones the low.
+		const uint8x16x2_t c = vld2q_u8(p + i);
+		const uint8x16_t high = HexNibbles(c.val[0], &valid);
+		const uint8x16_t low = HexNibbles(c.val[1], &valid);
+		vst1q_u8(output + i / 2, vorrq_u8(vshlq_n_u8(high, 4), low));
+	}
+	if (vminvq_u8(valid) == 0)
+		return -1;
+#endif
+	// Invalid characters give -1 and make invalid negative.
+	int invalid = 0;
+	for (; i < hex_length; i += 2) {
+		const int high = hex_values[p[i]] - 1;
+		const int low = hex_values[p[i + 1]] - 1;
+		invalid |= high | low;
+		output[i / 2] = (high << 4) | low;
+	}
+	return invalid < 0 ? -1 : hex_length / 2;
+}
+
+static int
+NormalizePhoneNumber(const char* phone_number, const char** digits, int* international)
+{
+	if (!phone_number || !*phone_number)
+		return -1;
+
+	*international = phone_number[0] == '+';
+	*digits = phone_number + *international;
+	if (!**digits)
+		return -1;
+
+	const size_t length = strlen(*digits);
+	if (length > 255)
+		return -1;
+
+	return length;
+}
+
+// Scratch size for LayoutText(): the encoded text needs at most two
+// octets per input byte, and anything longer than SMS_ENCODE_SCRATCH_SIZE
+// would exceed the part limit anyway.
+static int
+EncodeScratchSize(const char* sms_text)
+{
+	const size_t input_length = strlen(sms_text);
+	if (input_length >= SMS_ENCODE_SCRATCH_SIZE / 2)
+		return SMS_ENCODE_SCRATCH_SIZE;
+	return input_length * 2 + 1;
+}
+
+// Find all part boundaries of an encoded text in a single walk. Returns the
+// number of parts, or -1 when more than max_parts would be needed.
+static int
+SplitText(const unsigned char* encoded_text, int encoded_length,
+	  int use_ucs2, int single_udh_length, int udh_length,
+	  int* part_offsets, int* part_lengths, int max_parts)
+{
+	const int single_part_limit = use_ucs2 ?
+		(2 * SMS_MAX_UCS2_TEXT_LENGTH - single_udh_length) & ~1 :
+		SMS_MAX_7BIT_TEXT_LENGTH - (single_udh_length * 8 + 6) / 7;
+	if (encoded_length <= single_part_limit) {
+		if (max_parts < 1)
 			return -1;
+		part_offsets[0] = 0;
+		part_lengths[0] = encoded_length;
+		return 1;
+	}
+
+	// The user data header takes octets (UCS-2) or septets (GSM-7) away
+	// from every part.
+	const int multipart_limit = use_ucs2 ?
+		(2 * SMS_MAX_UCS2_TEXT_LENGTH - udh_length) & ~1 :
+		SMS_MAX_7BIT_TEXT_LENGTH - (udh_length * 8 + 6) / 7;
+	int offset = 0;
+	int count = 0;
+
+	while (offset < encoded_length) {
+		int length = encoded_length - offset;
+		if (length > multipart_limit)
+			length = multipart_limit;
+		/* Keep a GSM extension escape and its character in the same PDU. */
+		if (!use_ucs2 && offset + length < encoded_length &&
+		    encoded_text[offset + length - 1] == GSM_7BITS_ESCAPE)
+			length--;
+		if (length <= 0 || count >= max_parts)
+			return -1;
+		part_offsets[count] = offset;
+		part_lengths[count] = length;
+		count++;
+		offset += length;
+	}
+
+	return count;
+}
+
+// How a text is carried: GSM-7 with national language tables, or UCS-2.
+struct text_layout {
+	int use_ucs2;
+	int locking_shift;  // Language of the locking shift IE, 0 for none.
+	int single_shift;   // Language of the single shift IE, 0 for none.
+	// With PDU_ENCODE_MIXED the text is kept as UCS-2 and each part is
+	// sent as GSM-7 unless part_ucs2 is set.
+	int mixed;
+	unsigned char part_ucs2[SMS_MAX_PARTS];
+};
+
+static int
+ShiftHeaderLength(const struct text_layout* layout)
+{
+	return (layout->locking_shift ? 3 : 0) + (layout->single_shift ? 3 : 0);
+}
+
+static int
+SplitLayout(const unsigned char* encoded_text, int encoded_length,
+	    const struct text_layout* layout, int flags, int* part_offsets,
+	    int* part_lengths)
+{
+	const int shift_length = ShiftHeaderLength(layout);
+	const int concat_udh_length = (flags & PDU_ENCODE_REF16) ?
+		SMS_CONCAT16_UDH_LENGTH : SMS_CONCAT_UDH_LENGTH;
+	return SplitText(encoded_text, encoded_length, layout->use_ucs2,
+			 shift_length ? 1 + shift_length : 0,
+			 concat_udh_length + shift_length, part_offsets,
+			 part_lengths, SMS_MAX_PARTS);
+}
+
+// Write the user data header for one part: the national language shift
+// IEs, then the concatenation IE, which legacy decoders expect last.
+// Returns its length, 0 when no header is needed.
+static int
+EncodeUserDataHeader(const struct text_layout* layout, int reference_number,
+		     int flags, int total_parts, int part_number,
+		     unsigned char* udh)
+{
+	int length = 1;
+
+	if (layout->locking_shift) {
+		udh[length++] = 0x25;  // National language locking shift.
+		udh[length++] = 0x01;
+		udh[length++] = layout->locking_shift;
+	}
+	if (layout->single_shift) {
+		udh[length++] = 0x24;  // National language single shift.
+		udh[length++] = 0x01;
+		udh[length++] = layout->single_shift;
+	}
+	if (total_parts > 1 && (flags & PDU_ENCODE_REF16)) {
+		udh[length++] = 0x08;  // Concatenated message, 16-bit reference.
+		udh[length++] = 0x04;
+		udh[length++] = (reference_number >> 8) & 0xFF;
+		udh[length++] = reference_number & 0xFF;
+		udh[length++] = total_parts;
+		udh[length++] = part_number;
+	} else if (total_parts > 1) {
+		udh[length++] = 0x00;  // Concatenated message, 8-bit reference.
+		udh[length++] = 0x03;
+		udh[length++] = reference_number & 0xFF;
+		udh[length++] = total_parts;
+		udh[length++] = part_number;
+	}
+	if (length == 1)
+		return 0;
+	udh[0] = length - 1;
+	return length;
+}
+
+/*
+ * Split UCS-2 text into parts that are each sent as GSM-7 or UCS-2. Every
+ * part takes whichever encoding reaches farthest from its start. How far
+ * an encoding reaches never decreases as the start moves forward, so this
+ * greedy choice gives the fewest parts. Boundaries fall between characters,
+ * so escape pairs are never split.
+ */
+static int
+SplitMixed(const unsigned char* ucs2, int length, int flags,
+	   struct text_layout* layout, int* part_offsets, int* part_lengths)
+{
+	const int udh_length = (flags & PDU_ENCODE_REF16) ?
+		SMS_CONCAT16_UDH_LENGTH : SMS_CONCAT_UDH_LENGTH;
+	const int gsm7_limit = SMS_MAX_7BIT_TEXT_LENGTH - (udh_length * 8 + 6) / 7;
+	const int ucs2_limit = (2 * SMS_MAX_UCS2_TEXT_LENGTH - udh_length) & ~1;
+	int offset = 0;
+	int count = 0;
+
+	while (offset < length) {
+		int gsm7_end = offset;
+		int septets = 0;
+		while (gsm7_end < length) {
+			const int val = CodepointToG7bit((ucs2[gsm7_end] << 8) |
+							 ucs2[gsm7_end + 1]);
+			const int cost = val < 0 ? 2 : 1;
+			if (val == GSM7_UNREPRESENTABLE || septets + cost > gsm7_limit)
+				break;
+			septets += cost;
+			gsm7_end += 2;
 		}
+		int ucs2_end = offset + ucs2_limit;
+		if (ucs2_end > length)
+			ucs2_end = length;
 
-		if (output_buffer_length + 2 > buffer_size)
+		if (count >= SMS_MAX_PARTS)
 			return -1;
-		output_buffer[output_buffer_length++] = codepoint >> 8;
-		output_buffer[output_buffer_length++] = codepoint & 0xFF;
+		layout->part_ucs2[count] = ucs2_end > gsm7_end;
+		part_offsets[count] = offset;
+		part_lengths[count] = (ucs2_end > gsm7_end ? ucs2_end : gsm7_end) - offset;
+		offset += part_lengths[count];
+		count++;
 	}
 
-	return output_buffer_length;
+	return count;
 }
 
+// Convert a UCS-2 part of a mixed layout to GSM 7 bit septets.
 static int
-NormalizePhoneNumber(const char* phone_number, const char** digits, int* international)
+Ucs2ToG7bit(const unsigned char* ucs2, int length, unsigned char* output_buffer)
 {
-	if (!phone_number || !*phone_number)
-		return -1;
-
-	*international = phone_number[0] == '+';
-	*digits = phone_number + *international;
-	if (!**digits)
-		return -1;
+	int j = 0;
 
-	const size_t length = strlen(*digits);
-	if (length > 255)
-		return -1;
+	for (int i = 0; i + 1 < length; i += 2) {
+		const int val = CodepointToG7bit((ucs2[i] << 8) | ucs2[i + 1]);
+		if (val < 0) {
+			output_buffer[j++] = GSM_7BITS_ESCAPE;
+			output_buffer[j++] = -val;
+		} else {
+			output_buffer[j++] = val;
+		}
+	}
+	return j;
+}
 
-	return length;
+// Bitmasks of the locking and single shift tables holding a code point.
+static void
+ShiftTableMasks(unsigned int codepoint, unsigned int* locking,
+		unsigned int* single)
+{
+	*locking = 0;
+	*single = 0;
+	for (int language = 0; language < SMS_LANGUAGE_COUNT; ++language) {
+		if (locking_shift_septets[language].codes &&
+		    FindSeptet(LockingShiftUtf8(language),
+			       &locking_shift_septets[language], codepoint) >= 0)
+			*locking |= 1u << language;
+		if (FindSeptet(SingleShiftUtf8(language),
+			       &single_shift_septets[language], codepoint) >= 0)
+			*single |= 1u << language;
+	}
 }
 
+// A national language table pair and the septets it encodes a text in.
+struct shift_candidate {
+	int locking_shift;
+	int single_shift;
+	int septets;
+};
+
+/*
+ * Find in one pass over text the table pairs that represent all of it,
+ * other than the default pair. A character is escaped exactly when the
+ * locking shift table lacks it, so every single shift table that holds
+ * the escaped characters gives the same septets; only the lowest one, the
+ * default if it does, is kept for each locking shift table. ASCII outside
+ * the default alphabet is left out: a pair lacking it sends '?', and the
+ * septets counted are then a lower bound. Returns the number of
+ * candidates.
+ */
 static int
-EncodeSmsText(const char* sms_text, unsigned char** encoded_text, int* use_ucs2)
+ShiftCandidates(const char* text, struct shift_candidate* candidates)
 {
-	const size_t input_length = strlen(sms_text);
-	if (input_length > (size_t)(INT_MAX - 1) / 2)
-		return -1;
+	const unsigned int all = (1u << SMS_LANGUAGE_COUNT) - 1;
+	unsigned int singles[SMS_LANGUAGE_COUNT];  // Per locking shift table.
+	int escapes[SMS_LANGUAGE_COUNT] = { 0 };
+	unsigned int lockings = 0;
+	// Masks of recent code points; text repeats its characters.
+	struct {
+		unsigned int codepoint;
+		unsigned short locking;
+		unsigned short single;
+	} cache[128] = { { 0 } };
+	int characters = 0;
+
+	for (int language = 0; language < SMS_LANGUAGE_COUNT; ++language) {
+		singles[language] = all;
+		if (locking_shift_septets[language].codes)
+			lockings |= 1u << language;
+	}
 
-	*use_ucs2 = 0;
-	for (const unsigned char* p = (const unsigned char*)sms_text; *p; ++p) {
-		if (*p & 0x80) {
-			*use_ucs2 = 1;
-			break;
+	const unsigned char* p = (const unsigned char*)text;
+	while (*p && lockings) {
+		unsigned int codepoint;
+		unsigned int locking, single;
+		if (Utf8Next(&p, &codepoint) < 0)
+			return 0;
+		characters++;
+		const unsigned int slot = codepoint % 128;
+		if (cache[slot].codepoint != codepoint) {
+			ShiftTableMasks(codepoint, &locking, &single);
+			cache[slot].codepoint = codepoint;
+			cache[slot].locking = locking;
+			cache[slot].single = single;
+		}
+		locking = cache[slot].locking;
+		single = cache[slot].single;
+		if (codepoint >= 0x80 && !locking && !single)
+			return 0;
+		// As with the default alphabet, '?' may stand in for ASCII.
+		if (codepoint < 0x80 && !(locking & 1) && !(single & 1))
+			continue;
+		for (unsigned int rest = lockings & ~locking; rest; rest &= rest - 1) {
+			const int language = __builtin_ctz(rest);
+			escapes[language]++;
+			singles[language] &= single;
+			if (!singles[language])
+				lockings &= ~(1u << language);
 		}
 	}
 
-	const size_t buffer_size = input_length * 2 + 1;
-	*encoded_text = malloc(buffer_size);
-	if (!*encoded_text)
-		return -1;
-
-	int length;
-	if (*use_ucs2) {
-		length = Utf8ToUcs2(sms_text, *encoded_text, buffer_size);
-	} else {
-		length = AsciiToG7bit(sms_text, input_length, *encoded_text);
-	}
-	if (length < 0) {
-		free(*encoded_text);
-		*encoded_text = NULL;
+	int count = 0;
+	for (; lockings; lockings &= lockings - 1) {
+		const int language = __builtin_ctz(lockings);
+		const int single = __builtin_ctz(singles[language]);
+		// The default pair is Utf8ToG7bit(), which the caller tries.
+		if (!language && !single)
+			continue;
+		candidates[count].locking_shift = language;
+		candidates[count].single_shift = single;
+		candidates[count].septets = characters + escapes[language];
+		count++;
 	}
+	return count;
+}
 
-	return length;
+// Fewest parts that septets can take with the given shift header.
+static int
+MinimumParts(int septets, int shift_length, int flags)
+{
+	const int concat_udh_length = (flags & PDU_ENCODE_REF16) ?
+		SMS_CONCAT16_UDH_LENGTH : SMS_CONCAT_UDH_LENGTH;
+	const int single_limit = SMS_MAX_7BIT_TEXT_LENGTH -
+		(shift_length ? ((1 + shift_length) * 8 + 6) / 7 : 0);
+	const int part_limit = SMS_MAX_7BIT_TEXT_LENGTH -
+		((concat_udh_length + shift_length) * 8 + 6) / 7;
+	if (septets <= single_limit)
+		return 1;
+	return (septets + part_limit - 1) / part_limit;
 }
 
+/*
+ * Transcode text into a caller buffer and find its part boundaries.
+ * GSM-7 is tried with the default alphabet and then with the national
+ * language table pairs that represent the text, and the pair giving the
+ * fewest parts wins; ties go to the smaller user data header. A pair is
+ * only encoded when its septet count could beat the best so far. UCS-2 is
+ * used only when no table can represent the text. Returns the number of
+ * parts or -1.
+ */
 static int
-GetTextPart(const unsigned char* encoded_text, int encoded_length,
-	    int use_ucs2, int part_number, int* total_parts,
-	    int* part_offset, int* part_length)
+LayoutText(const char* sms_text, int flags, unsigned char* encoded_text,
+	   int buffer_size, struct text_layout* layout, int* part_offsets,
+	   int* part_lengths)
 {
-	if (part_number < 1)
+	const size_t input_length = strlen(sms_text);
+	if (input_length > (size_t)(INT_MAX - 1) / 2)
 		return -1;
 
-	const int single_part_limit = use_ucs2 ?
-		2 * SMS_MAX_UCS2_TEXT_LENGTH : SMS_MAX_7BIT_TEXT_LENGTH;
-	if (encoded_length <= single_part_limit) {
-		*total_parts = 1;
-		if (part_number != 1)
-			return -1;
-		*part_offset = 0;
-		*part_length = encoded_length;
-		return 0;
-	}
-
-	const int multipart_limit = use_ucs2 ?
-		2 * SMS_MAX_UCS2_PART_LENGTH : SMS_MAX_7BIT_PART_LENGTH;
-	int offset = 0;
-	int count = 0;
-	int requested_offset = -1;
-	int requested_length = -1;
-
-	while (offset < encoded_length) {
-		int length = encoded_length - offset;
-		if (length > multipart_limit)
-			length = multipart_limit;
-		/* Keep a GSM extension escape and its character in the same PDU. */
-		if (!use_ucs2 && offset + length < encoded_length &&
-		    encoded_text[offset + length - 1] == GSM_7BITS_ESCAPE)
-			length--;
-		if (length <= 0 || ++count > 255)
-			return -1;
-		if (count == part_number) {
-			requested_offset = offset;
-			requested_length = length;
+	memset(layout, 0, sizeof(*layout));
+	int length = Utf8ToG7bit(sms_text, input_length, encoded_text,
+				 buffer_size);
+	if (length == -1)
+		return -1;
+	// Without escapes the default alphabet needs one septet per
+	// character and no header, so no national table can do better.
+	if (length >= 0 && !memchr(encoded_text, GSM_7BITS_ESCAPE, length))
+		return SplitLayout(encoded_text, length, layout, flags,
+				   part_offsets, part_lengths);
+
+	struct text_layout best = { .use_ucs2 = 1 };
+	int best_count = length >= 0 ?
+		SplitLayout(encoded_text, length, layout, flags,
+			    part_offsets, part_lengths) : -1;
+	if (best_count > 0)
+		best.use_ucs2 = 0;
+	// Every pair takes a septet or more per character and a header of
+	// 3 octets or more, so it cannot beat what the default gives as few.
+	int characters = 0;
+	for (size_t i = 0; i < input_length; ++i)
+		characters += ((unsigned char)sms_text[i] & 0xC0) != 0x80;
+	struct shift_candidate candidates[SMS_LANGUAGE_COUNT];
+	const int candidate_count = best_count > 0 &&
+		MinimumParts(characters, 3, flags) >= best_count ? 0 :
+		ShiftCandidates(sms_text, candidates);
+	for (int i = 0; i < candidate_count; ++i) {
+		const struct text_layout candidate = {
+			.locking_shift = candidates[i].locking_shift,
+			.single_shift = candidates[i].single_shift,
+		};
+		const int minimum = MinimumParts(candidates[i].septets,
+				ShiftHeaderLength(&candidate), flags);
+		if (best_count > 0 && (minimum > best_count ||
+		    (minimum == best_count && ShiftHeaderLength(&candidate) >=
+		     ShiftHeaderLength(&best))))
+			continue;
+		length = Utf8ToG7bitShift(sms_text, candidate.locking_shift,
+					  candidate.single_shift,
+					  encoded_text, buffer_size);
+		if (length < 0)
+			continue;
+		const int count = SplitLayout(encoded_text, length, &candidate,
+					      flags, part_offsets, part_lengths);
+		if (count > 0 && (best_count <= 0 || count < best_count ||
+		    (count == best_count && ShiftHeaderLength(&candidate) <
+		     ShiftHeaderLength(&best)))) {
+			best = candidate;
+			best_count = count;
 		}
-		offset += length;
 	}
 
-	*total_parts = count;
-	if (requested_offset < 0)
+	*layout = best;
+	if (best.use_ucs2)
+		length = Utf8ToUcs2(sms_text, input_length, encoded_text,
+				    buffer_size);
+	else
+		length = Utf8ToG7bitShift(sms_text, best.locking_shift,
+					  best.single_shift, encoded_text,
+					  buffer_size);
+	if (length < 0)
 		return -1;
-	*part_offset = requested_offset;
-	*part_length = requested_length;
-	return 0;
+	const int count = SplitLayout(encoded_text, length, layout, flags,
+				      part_offsets, part_lengths);
+	if (!best.use_ucs2 || !(flags & PDU_ENCODE_MIXED) || count == 1)
+		return count;
+
+	// Mixed parts only pay off when the whole text would be UCS-2.
+	int mixed_offsets[SMS_MAX_PARTS];
+	int mixed_lengths[SMS_MAX_PARTS];
+	struct text_layout mixed = { .use_ucs2 = 1, .mixed = 1 };
+	const int mixed_count = SplitMixed(encoded_text, length, flags, &mixed,
+					   mixed_offsets, mixed_lengths);
+	if (mixed_count < 0 || (count > 0 && mixed_count >= count))
+		return count;
+	*layout = mixed;
+	memcpy(part_offsets, mixed_offsets, mixed_count * sizeof(*part_offsets));
+	memcpy(part_lengths, mixed_lengths, mixed_count * sizeof(*part_lengths));
+	return mixed_count;
 }
 
 static int
 EncodeMultipartGsm7(const unsigned char* text, int text_length,
-		    const unsigned char* udh, unsigned char* output_buffer,
-		    int buffer_size)
+		    const unsigned char* udh, int udh_length,
+		    unsigned char* output_buffer, int buffer_size)
 {
-	const int header_septets = (SMS_CONCAT_UDH_LENGTH * 8 + 6) / 7;
+	const int header_septets = (udh_length * 8 + 6) / 7;
 	const int user_data_length = header_septets + text_length;
 	const int output_length = (user_data_length * 7 + 7) / 8;
 	if (output_length > buffer_size)
 		return -1;
 
-	memset(output_buffer, 0, output_length);
-	memcpy(output_buffer, udh, SMS_CONCAT_UDH_LENGTH);
-
-	for (int i = 0; i < text_length; ++i) {
-		const int bit_position = header_septets * 7 + i * 7;
-		const int byte_position = bit_position / 8;
-		const int shift = bit_position % 8;
-		output_buffer[byte_position] |= (text[i] & BITMASK_7BITS) << shift;
-		if (shift > 1)
-			output_buffer[byte_position + 1] |=
-				(text[i] & BITMASK_7BITS) >> (8 - shift);
-	}
+	memcpy(output_buffer, udh, udh_length);
+	// The text starts on the septet boundary after the header.
+	if (pdu_pack_septets(text, text_length, header_septets * 7 - udh_length * 8,
+			     output_buffer + udh_length,
+			     buffer_size - udh_length) < 0)
+		return -1;
 
 	return output_length;
 }
@@ -461,33 +3385,29 @@ DecodePhoneNumber(const unsigned char* buffer, int phone_number_length, char* ou
 	return phone_number_length;
 }
 
-// Encode one part of an SMS message to PDU.
-int
-pdu_encode_multipart(const char* service_center_number,
-		     const char* phone_number, const char* sms_text,
-		     unsigned char reference_number, int part_number,
-		     int* total_parts, unsigned char* output_buffer,
-		     int buffer_size)
-{	
-	if (!phone_number || !sms_text || !total_parts || !output_buffer ||
-	    buffer_size < 2)
-		return -1;
-
-	unsigned char* encoded_text = NULL;
-	int use_ucs2;
-	const int encoded_length = EncodeSmsText(sms_text, &encoded_text, &use_ucs2);
-	if (encoded_length < 0)
-		return -1;
-
-	int part_offset;
-	int part_length;
-	if (GetTextPart(encoded_text, encoded_length, use_ucs2, part_number,
-			total_parts, &part_offset, &part_length) < 0) {
-		free(encoded_text);
-		return -1;
-	}
-	const int multipart = *total_parts > 1;
+// Decode a TP-SCTS/TP-DT service centre time stamp (time zone ignored).
+static time_t
+DecodeTimestamp(const unsigned char* buffer)
+{
+	struct tm sms_broken_time;
+	memset(&sms_broken_time, 0, sizeof(sms_broken_time));
+	sms_broken_time.tm_year = 100 + SwapDecimalNibble(buffer[0]);
+	sms_broken_time.tm_mon  = SwapDecimalNibble(buffer[1]) - 1;
+	sms_broken_time.tm_mday = SwapDecimalNibble(buffer[2]);
+	sms_broken_time.tm_hour = SwapDecimalNibble(buffer[3]);
+	sms_broken_time.tm_min  = SwapDecimalNibble(buffer[4]);
+	sms_broken_time.tm_sec  = SwapDecimalNibble(buffer[5]);
+	return timegm(&sms_broken_time);
+}
 
+// Build an SMS-SUBMIT PDU for one part of an encoded text. udh is NULL for
+// single part messages.
+static int
+EncodeSubmitPdu(const char* service_center_number, const char* phone_number,
+		int use_ucs2, int flags, const unsigned char* udh,
+		int udh_length, const unsigned char* text, int text_length,
+		unsigned char* output_buffer, int buffer_size)
+{
 	int output_buffer_length = 0;
 
 	// 1. Set SMS center number.
@@ -497,21 +3417,22 @@ pdu_encode_multipart(const char* service_center_number,
 		int service_center_international;
 		if (NormalizePhoneNumber(service_center_number, &service_center_digits,
 					 &service_center_international) < 0)
-			goto error;
+			return -1;
 		output_buffer[1] = TYPE_OF_ADDRESS_INTERNATIONAL_PHONE;
 		length = EncodePhoneNumber(service_center_digits,
 					   output_buffer + 2, buffer_size - 2);
 		if (length < 0 || length >= 254)
-			goto error;
+			return -1;
 		length++;  // Add type of address.
 	}
 	output_buffer[0] = length;
 	output_buffer_length = length + 1;
 	if (output_buffer_length + 4 > buffer_size)
-		goto error;
+		return -1;
 
 	// 2. Set type of message.
-	output_buffer[output_buffer_length++] = SMS_SUBMIT | (multipart ? 0x40 : 0);
+	output_buffer[output_buffer_length++] = SMS_SUBMIT | (udh ? 0x40 : 0) |
+		((flags & PDU_ENCODE_STATUS_REPORT) ? SMS_STATUS_REPORT_REQUEST : 0);
 	output_buffer[output_buffer_length++] = 0x00;  // Message reference.
 
 	// 3. Set phone number.
@@ -521,7 +3442,7 @@ pdu_encode_multipart(const char* service_center_number,
 							    &phone_number_digits,
 							    &phone_number_international);
 	if (phone_number_length < 0)
-		goto error;
+		return -1;
 	output_buffer[output_buffer_length] = phone_number_length;
 
 	if (!phone_number_international && phone_number_length < 6) {
@@ -534,10 +3455,10 @@ pdu_encode_multipart(const char* service_center_number,
 				   output_buffer + output_buffer_length + 2,
 				   buffer_size - output_buffer_length - 2);
 	if (length < 0)
-		goto error;
+		return -1;
 	output_buffer_length += length + 2;
 	if (output_buffer_length + 4 > buffer_size)
-		goto error;
+		return -1;
 
 	// 4. Protocol identifiers.
 	output_buffer[output_buffer_length++] = 0x00;  // TP-PID: Protocol identifier.
@@ -545,52 +3466,237 @@ pdu_encode_multipart(const char* service_center_number,
 	output_buffer[output_buffer_length++] = 0xB0;  // TP-VP: Validity: 10 days
 
 	// 5. SMS message.
-	unsigned char udh[SMS_CONCAT_UDH_LENGTH] = {
-		0x05, 0x00, 0x03, reference_number, *total_parts, part_number,
-	};
-	int user_data_header_length = multipart ? SMS_CONCAT_UDH_LENGTH : 0;
 	if (use_ucs2) {
-		const int user_data_length = user_data_header_length + part_length;
+		const int user_data_length = (udh ? udh_length : 0) + text_length;
 		if (output_buffer_length + 1 + user_data_length > buffer_size)
-			goto error;
+			return -1;
 		output_buffer[output_buffer_length++] = user_data_length;
-		if (multipart) {
+		if (udh) {
 			memcpy(output_buffer + output_buffer_length, udh,
-			       sizeof(udh));
-			output_buffer_length += sizeof(udh);
+			       udh_length);
+			output_buffer_length += udh_length;
 		}
-		memcpy(output_buffer + output_buffer_length,
-		       encoded_text + part_offset, part_length);
-		output_buffer_length += part_length;
-		free(encoded_text);
-		return output_buffer_length;
+		memcpy(output_buffer + output_buffer_length, text, text_length);
+		return output_buffer_length + text_length;
 	}
 
-	if (multipart) {
-		const int header_septets = (SMS_CONCAT_UDH_LENGTH * 8 + 6) / 7;
-		output_buffer[output_buffer_length++] = header_septets + part_length;
-		length = EncodeMultipartGsm7(encoded_text + part_offset, part_length,
-					     udh,
+	if (udh) {
+		const int header_septets = (udh_length * 8 + 6) / 7;
+		output_buffer[output_buffer_length++] = header_septets + text_length;
+		length = EncodeMultipartGsm7(text, text_length, udh, udh_length,
 					     output_buffer + output_buffer_length,
 					     buffer_size - output_buffer_length);
 	} else {
-		output_buffer[output_buffer_length++] = part_length;
-		length = EncodePDUMessage((const char*)encoded_text, part_length,
+		output_buffer[output_buffer_length++] = text_length;
+		length = EncodePDUMessage((const char*)text, text_length,
 					  output_buffer + output_buffer_length,
 					  buffer_size - output_buffer_length);
 	}
 	if (length < 0)
-		goto error;
-	output_buffer_length += length;
-	free(encoded_text);
+		return -1;
+	return output_buffer_length + length;
+}
 
-	return output_buffer_length;
+// Encode part i of a laid out text.
+static int
+EncodeLayoutPart(const char* service_center_number, const char* phone_number,
+		 const struct text_layout* layout, int reference_number,
+		 int flags, int total_parts, int i,
+		 const unsigned char* encoded_text, const int* part_offsets,
+		 const int* part_lengths, unsigned char* output_buffer,
+		 int buffer_size)
+{
+	unsigned char udh[SMS_MAX_UDH_LENGTH];
+	unsigned char septets[SMS_MAX_7BIT_TEXT_LENGTH];
+	const int udh_length = EncodeUserDataHeader(layout, reference_number,
+						    flags, total_parts, i + 1,
+						    udh);
+	const unsigned char* text = encoded_text + part_offsets[i];
+	int text_length = part_lengths[i];
+	int use_ucs2 = layout->use_ucs2;
+
+	if (layout->mixed && !layout->part_ucs2[i]) {
+		text_length = Ucs2ToG7bit(text, text_length, septets);
+		text = septets;
+		use_ucs2 = 0;
+	}
+	return EncodeSubmitPdu(service_center_number, phone_number, use_ucs2,
+			       flags, udh_length ? udh : NULL, udh_length,
+			       text, text_length, output_buffer, buffer_size);
+}
 
-error:
-	free(encoded_text);
+// Encode all parts of an SMS message; the text is transcoded only once.
+int
+pdu_encode_parts_scratch(const char* service_center_number,
+			 const char* phone_number, const char* sms_text,
+			 int reference_number, int flags,
+			 unsigned char (*pdus)[SMS_MAX_PDU_LENGTH],
+			 int* pdu_lengths, int max_parts,
+			 unsigned char* encoded_text, int scratch_size)
+{
+	if (!phone_number || !sms_text || (pdus && !pdu_lengths) ||
+	    !encoded_text)
+		return -1;
+
+	struct text_layout layout;
+	int part_offsets[SMS_MAX_PARTS];
+	int part_lengths[SMS_MAX_PARTS];
+	const int total_parts = LayoutText(sms_text, flags, encoded_text,
+					   scratch_size, &layout, part_offsets,
+					   part_lengths);
+	if (total_parts < 0 || (pdus && total_parts > max_parts))
+		return -1;
+
+	for (int i = 0; pdus && i < total_parts; ++i) {
+		pdu_lengths[i] = EncodeLayoutPart(service_center_number,
+						  phone_number, &layout,
+						  reference_number, flags,
+						  total_parts, i, encoded_text,
+						  part_offsets, part_lengths,
+						  pdus[i], SMS_MAX_PDU_LENGTH);
+		if (pdu_lengths[i] < 0)
+			return -1;
+	}
+
+	return total_parts;
+}
+
+// Octets of the TP-VP of an SMS-SUBMIT, from its TP-VPF.
+static int
+ValidityPeriodLength(const unsigned char first_octet)
+{
+	switch ((first_octet >> 3) & 0x03) {
+	case 0x02:
+		return 1;  // Relative.
+	case 0x01:
+	case 0x03:
+		return 7;  // Enhanced or absolute.
+	default:
+		return 0;
+	}
+}
+
+// Find the concatenation IE of an SMS-SUBMIT and write the reference into
+// it, 8 or 16 bits as the IE was encoded.
+int
+pdu_set_reference(unsigned char* pdu, int pdu_len, int reference_number)
+{
+	if (pdu_len < 1)
+		return -1;
+	const int first_octet = 1 + pdu[0];
+	if (first_octet + 3 > pdu_len || !(pdu[first_octet] & SMS_UDHI))
+		return -1;
+	// TP-MR, TP-DA with its length in digits and type, TP-PID, TP-DCS.
+	int offset = first_octet + 2;
+	offset += 2 + (pdu[offset] + 1) / 2 + 2;
+	offset += ValidityPeriodLength(pdu[first_octet]);
+	const int udh = offset + 1;  // After TP-UDL.
+	if (udh >= pdu_len || udh + 1 + pdu[udh] > pdu_len)
+		return -1;
+
+	const int udh_end = udh + 1 + pdu[udh];
+	for (int ie = udh + 1; ie + 2 <= udh_end &&
+		     ie + 2 + pdu[ie + 1] <= udh_end; ie += 2 + pdu[ie + 1]) {
+		if (pdu[ie] == SMS_IE_CONCAT && pdu[ie + 1] == 3) {
+			pdu[ie + 2] = reference_number & 0xFF;
+			return 0;
+		}
+		if (pdu[ie] == SMS_IE_CONCAT16 && pdu[ie + 1] == 4) {
+			pdu[ie + 2] = (reference_number >> 8) & 0xFF;
+			pdu[ie + 3] = reference_number & 0xFF;
+			return 0;
+		}
+	}
 	return -1;
 }
 
+// FNV-1a over the digits, so that "+48..." and "48..." hash alike.
+unsigned int
+pdu_number_hash(const char* number)
+{
+	unsigned int hash = 2166136261u;
+
+	if (*number == '+')
+		number++;
+	while (*number)
+		hash = (hash ^ (unsigned char)*number++) * 16777619u;
+	return hash;
+}
+
+int
+pdu_encode_parts(const char* service_center_number, const char* phone_number,
+		 const char* sms_text, int reference_number, int flags,
+		 unsigned char (*pdus)[SMS_MAX_PDU_LENGTH], int* pdu_lengths,
+		 int max_parts)
+{
+	if (!sms_text)
+		return -1;
+
+	const int scratch_size = EncodeScratchSize(sms_text);
+	unsigned char* scratch = malloc(scratch_size);
+	if (!scratch)
+		return -1;
+	const int total_parts = pdu_encode_parts_scratch(service_center_number,
+							 phone_number, sms_text,
+							 reference_number, flags,
+							 pdus, pdu_lengths,
+							 max_parts, scratch,
+							 scratch_size);
+	free(scratch);
+	return total_parts;
+}
+
+// Encode one part of an SMS message to PDU.
+int
+pdu_encode_multipart_ex(const char* service_center_number,
+			const char* phone_number, const char* sms_text,
+			int reference_number, int flags, int part_number,
+			int* total_parts, unsigned char* output_buffer,
+			int buffer_size)
+{
+	if (!phone_number || !sms_text || !total_parts || !output_buffer ||
+	    buffer_size < 2)
+		return -1;
+
+	const int scratch_size = EncodeScratchSize(sms_text);
+	unsigned char* encoded_text = malloc(scratch_size);
+	if (!encoded_text)
+		return -1;
+	struct text_layout layout;
+	int part_offsets[SMS_MAX_PARTS];
+	int part_lengths[SMS_MAX_PARTS];
+	const int count = LayoutText(sms_text, flags, encoded_text, scratch_size,
+				     &layout, part_offsets, part_lengths);
+	if (count < 0 || part_number < 1 || part_number > count) {
+		if (count > 0)
+			*total_parts = count;
+		free(encoded_text);
+		return -1;
+	}
+	*total_parts = count;
+
+	const int length = EncodeLayoutPart(service_center_number, phone_number,
+					    &layout, reference_number, flags,
+					    count, part_number - 1, encoded_text,
+					    part_offsets, part_lengths,
+					    output_buffer, buffer_size);
+	free(encoded_text);
+	return length;
+}
+
+int
+pdu_encode_multipart(const char* service_center_number,
+		     const char* phone_number, const char* sms_text,
+		     unsigned char reference_number, int part_number,
+		     int* total_parts, unsigned char* output_buffer,
+		     int buffer_size)
+{
+	return pdu_encode_multipart_ex(service_center_number, phone_number,
+				       sms_text, reference_number, 0,
+				       part_number, total_parts,
+				       output_buffer, buffer_size);
+}
+
 // Encode a single-part SMS message to PDU.
 int
 pdu_encode(const char* service_center_number, const char* phone_number,
@@ -605,6 +3711,180 @@ pdu_encode(const char* service_center_number, const char* phone_number,
 	return length;
 }
 
+int pdu_view_parse(struct sms_pdu_view* view, const unsigned char* buffer,
+		   int buffer_length)
+{
+	if (buffer_length <= 0)
+		return -1;
+
+	memset(view, 0, sizeof(*view));
+	view->pdu = buffer;
+	view->length = buffer_length;
+	view->smsc = 0;
+	view->first_octet = 1 + buffer[0];
+	if (view->first_octet >= buffer_length)
+		return -2;
+	const int mti = buffer[view->first_octet] & SMS_MTI_MASK;
+	if (mti != SMS_MTI_DELIVER && mti != SMS_MTI_SUBMIT)
+		return -2;
+	// A submit has TP-MR before its TP-DA, which takes the place of TP-OA.
+	view->originator = view->first_octet + (mti == SMS_MTI_SUBMIT ? 2 : 1);
+	// TP-OA length and type of address.
+	if (view->originator + 2 > buffer_length)
+		return -2;
+
+	view->pid = view->originator + 2 + (buffer[view->originator] + 1) / 2;
+	view->dcs = view->pid + 1;
+	if (mti == SMS_MTI_SUBMIT) {
+		view->scts = -1;
+		view->udl = view->dcs + 1 +
+			    ValidityPeriodLength(buffer[view->first_octet]);
+	} else {
+		view->scts = view->dcs + 1;
+		view->udl = view->scts + 7;
+	}
+	if (view->udl + 1 > buffer_length)
+		return -1;
+
+	const int dcs = buffer[view->dcs];
+	const int udl = buffer[view->udl];
+	view->alphabet = (dcs / 4) % 4;
+	const int user_data_octets = view->alphabet == SMS_ALPHABET_GSM7 ?
+				     (udl * 7 + 7) / 8 : udl;
+	if (view->udl + 1 + user_data_octets > buffer_length)
+		return -1;
+
+	view->udh = -1;
+	view->locking_shift = SMS_LANGUAGE_DEFAULT;
+	view->single_shift = SMS_LANGUAGE_DEFAULT;
+	if (buffer[view->first_octet] & SMS_UDHI) {
+		if (user_data_octets < 1)
+			return -1;
+		view->udh = view->udl + 1;
+		view->udh_length = buffer[view->udh] + 1;
+		if (view->udh_length > user_data_octets)
+			return -1;
+	}
+	view->destination_port = -1;
+	view->source_port = -1;
+
+	struct sms_udh_iterator it;
+	struct sms_udh_ie ie;
+	pdu_udh_begin(&it, view);
+	while (pdu_udh_next(&it, &ie)) {
+		const unsigned char* d = ie.data;
+		if (ie.id == SMS_IE_CONCAT && ie.length == 3) {
+			view->ref_number = d[0];
+			view->total_parts = d[1];
+			view->part_number = d[2];
+		} else if (ie.id == SMS_IE_CONCAT16 && ie.length == 4) {
+			view->ref_number = (d[0] << 8) | d[1];
+			view->total_parts = d[2];
+			view->part_number = d[3];
+		} else if (ie.id == SMS_IE_PORT8 && ie.length == 2) {
+			view->destination_port = d[0];
+			view->source_port = d[1];
+		} else if (ie.id == SMS_IE_PORT16 && ie.length == 4) {
+			view->destination_port = (d[0] << 8) | d[1];
+			view->source_port = (d[2] << 8) | d[3];
+		} else if (ie.id == SMS_IE_SINGLE_SHIFT && ie.length == 1) {
+			view->single_shift = d[0];
+		} else if (ie.id == SMS_IE_LOCKING_SHIFT && ie.length == 1) {
+			view->locking_shift = d[0];
+		}
+	}
+
+	view->user_data = view->udl + 1 + view->udh_length;
+	view->user_data_length = user_data_octets - view->udh_length;
+	if (view->alphabet == SMS_ALPHABET_GSM7) {
+		// The text starts at the septet boundary after the header.
+		const int header_septets = (view->udh_length * 8 + 6) / 7;
+		if (header_septets > udl)
+			return -1;
+		view->text_length = udl - header_septets;
+		view->fill_bits = header_septets * 7 - view->udh_length * 8;
+	} else {
+		view->text_length = view->user_data_length;
+	}
+	return 0;
+}
+
+void pdu_udh_begin(struct sms_udh_iterator* it,
+		   const struct sms_pdu_view* view)
+{
+	it->udh = view->udh < 0 ? NULL : view->pdu + view->udh;
+	it->length = view->udh_length;
+	it->offset = 1;  // After the UDH length octet.
+}
+
+int pdu_udh_next(struct sms_udh_iterator* it, struct sms_udh_ie* ie)
+{
+	if (it->offset + 2 > it->length ||
+	    it->offset + 2 + it->udh[it->offset + 1] > it->length)
+		return 0;
+	ie->id = it->udh[it->offset];
+	ie->length = it->udh[it->offset + 1];
+	ie->data = it->udh + it->offset + 2;
+	it->offset += 2 + ie->length;
+	return 1;
+}
+
+int pdu_view_sender(const struct sms_pdu_view* view, char* sender,
+		    int sender_size)
+{
+	const unsigned char* address = view->pdu + view->originator;
+	const int sender_number_length = address[0];
+	if (sender_number_length + 1 > sender_size)
+		return -3;  // Buffer too small to hold decoded phone number.
+
+	if (address[1] == TYPE_OF_ADDRESS_ALPHANUMERIC) {
+		// The length counts the semi-octets holding septets.
+		const int length = Gsm7ToUtf8(address + 2,
+					      (sender_number_length + 1) / 2, 0,
+					      sender_number_length * 4 / 7,
+					      SMS_LANGUAGE_DEFAULT,
+					      SMS_LANGUAGE_DEFAULT,
+					      sender, sender_size);
+		return length < 0 ? -2 : length;
+	}
+	return DecodePhoneNumber(address + 2, sender_number_length, sender);
+}
+
+time_t pdu_view_time(const struct sms_pdu_view* view, int* tz_minutes)
+{
+	if (view->scts < 0) {
+		if (tz_minutes)
+			*tz_minutes = 0;
+		return 0;
+	}
+	const unsigned char* scts = view->pdu + view->scts;
+	if (tz_minutes) {
+		// Quarters of an hour, the sign in bit 3 of the swapped tens.
+		const int quarters = (scts[6] & 0x07) * 10 + (scts[6] >> 4);
+		*tz_minutes = (scts[6] & 0x08) ? -quarters * 15 : quarters * 15;
+	}
+	return DecodeTimestamp(scts);
+}
+
+int pdu_view_text(const struct sms_pdu_view* view, char* text, int text_size)
+{
+	if (text_size < 1)
+		return -1;
+
+	switch (view->alphabet) {
+	case SMS_ALPHABET_GSM7:
+		return Gsm7ToUtf8(view->pdu + view->user_data,
+				  view->user_data_length, view->fill_bits,
+				  view->text_length, view->locking_shift,
+				  view->single_shift, text, text_size);
+	case SMS_ALPHABET_UCS2:
+		return ucs2be_to_utf8(view->pdu + view->user_data,
+				      view->user_data_length, text, text_size);
+	default:
+		return -1;
+	}
+}
+
 int pdu_decode(const unsigned char* buffer, int buffer_length,
 	       time_t* output_sms_time,
 	       char* output_sender_phone_number, int sender_phone_number_size,
@@ -615,87 +3895,35 @@ int pdu_decode(const unsigned char* buffer, int buffer_length,
 	       int* part_number,
 	       int* skip_bytes)
 {
-	
-	if (buffer_length <= 0)
+	struct sms_pdu_view view;
+	if (pdu_view_parse(&view, buffer, buffer_length) < 0)
 		return -1;
 
-	const int sms_deliver_start = 1 + buffer[0];
-	if (sms_deliver_start + 1 > buffer_length)
-		return -2;
-
-	const int user_data_header_length = (buffer[sms_deliver_start]>>4);
-
-	const int sender_number_length = buffer[sms_deliver_start + 1];
-	if (sender_number_length + 1 > sender_phone_number_size)
-		return -3;  // Buffer too small to hold decoded phone number.
+	const int sender_length = pdu_view_sender(&view, output_sender_phone_number,
+						  sender_phone_number_size);
+	if (sender_length < 0)
+		return sender_length;
 
-	const int sender_type_of_address = buffer[sms_deliver_start + 2];
-	if (sender_type_of_address == TYPE_OF_ADDRESS_ALPHANUMERIC) {
-		int sender_len1 = DecodePDUMessage_GSM_7bit(buffer + sms_deliver_start + 3, ceil(sender_number_length * 1.0 / 2), output_sender_phone_number, sender_number_length);
-		if (output_sender_phone_number[sender_len1 - 1] == '\0')
-			sender_len1--;
-		int sender_len2 = G7bitToAscii(0, output_sender_phone_number, sender_len1);
-		output_sender_phone_number[sender_len2] = 0;
-	} else {
-		DecodePhoneNumber(buffer + sms_deliver_start + 3, sender_number_length, output_sender_phone_number);
-	}
+	*output_sms_time = pdu_view_time(&view, NULL);
+	*tp_dcs = buffer[view.dcs];
+	*ref_number = view.ref_number;
+	*total_parts = view.total_parts;
+	*part_number = view.part_number;
+	*skip_bytes = view.udh_length;
 
-	const int sms_pid_start = sms_deliver_start + 3 + (buffer[sms_deliver_start + 1] + 1) / 2;
+	if (sms_text_size < buffer[view.udl]) return -1;  // Cannot hold decoded buffer.
 
-	// Decode timestamp.
-	struct tm sms_broken_time;
-	sms_broken_time.tm_year = 100 + SwapDecimalNibble(buffer[sms_pid_start + 2]);
-	sms_broken_time.tm_mon  = SwapDecimalNibble(buffer[sms_pid_start + 3]) - 1;
-	sms_broken_time.tm_mday = SwapDecimalNibble(buffer[sms_pid_start + 4]);
-	sms_broken_time.tm_hour = SwapDecimalNibble(buffer[sms_pid_start + 5]);
-	sms_broken_time.tm_min  = SwapDecimalNibble(buffer[sms_pid_start + 6]);
-	sms_broken_time.tm_sec  = SwapDecimalNibble(buffer[sms_pid_start + 7]);
-	(*output_sms_time) = timegm(&sms_broken_time);
-
-	const int sms_start = sms_pid_start + 2 + 7;
-	if (sms_start + 1 > buffer_length) return -1;  // Invalid input buffer.
-
-	int tmp;
-	if((user_data_header_length&0x04)==0x04) {
-		tmp = buffer[sms_start + 1] + 1;
-		*skip_bytes = tmp;
-		*ref_number = 0x000000FF&buffer[sms_start + tmp - 2];
-		*total_parts = 0x000000FF&buffer[sms_start + tmp - 1];
-		*part_number = 0x000000FF&buffer[sms_start + tmp];
+	int output_sms_text_length;
+	if (view.alphabet == SMS_ALPHABET_GSM7) {
+		output_sms_text_length = pdu_view_text(&view, output_sms_text,
+						       sms_text_size);
 	} else {
-		tmp = 0;
-		*skip_bytes = tmp;
-		*ref_number = tmp;
-		*total_parts = tmp;
-		*part_number = tmp;
-	}
-
-	int output_sms_text_length = buffer[sms_start];
-	if (sms_text_size < output_sms_text_length) return -1;  // Cannot hold decoded buffer.
-
-	const int sms_tp_dcs_start = sms_pid_start + 1;
-	*tp_dcs = buffer[sms_tp_dcs_start];
-
-	switch((*tp_dcs / 4) % 4)
-	{
-		case 0:
-			{
-				// GSM 7 bit
-				int decoded_sms_text_size = DecodePDUMessage_GSM_7bit(buffer + sms_start + 1, buffer_length - (sms_start + 1),
-							   output_sms_text, output_sms_text_length);
-				if (decoded_sms_text_size != output_sms_text_length) return -1;  // Decoder length is not as expected.
-				output_sms_text_length = G7bitToAscii(tmp, output_sms_text, output_sms_text_length);
-				break;
-			}
-		case 2:
-			{
-				// UCS2
-				memcpy(output_sms_text, buffer + sms_start + 1, output_sms_text_length);
-				break;
-			}
-		default:
-		break;
+		// UCS-2 and 8-bit data are returned as they are.
+		output_sms_text_length = view.text_length;
+		memcpy(output_sms_text, buffer + view.user_data,
+		       output_sms_text_length);
 	}
+	if (output_sms_text_length < 0) return -1;
 
 	// Add a C string end.
 	if (output_sms_text_length < sms_text_size)
@@ -705,3 +3933,33 @@ int pdu_decode(const unsigned char* buffer, int buffer_length,
 
 	return output_sms_text_length;
 }
+
+int pdu_decode_status_report(const unsigned char* buffer, int buffer_length,
+			     int* message_reference,
+			     char* recipient, int recipient_size,
+			     time_t* discharge_time, int* status)
+{
+	if (buffer_length <= 0)
+		return -1;
+
+	const int report_start = 1 + buffer[0];
+	if (report_start + 4 > buffer_length)
+		return -1;
+	if ((buffer[report_start] & SMS_MTI_MASK) != SMS_MTI_STATUS_REPORT)
+		return -1;
+
+	*message_reference = buffer[report_start + 1];
+
+	const int recipient_length = buffer[report_start + 2];
+	if (recipient_length + 1 > recipient_size)
+		return -1;
+	const int scts_start = report_start + 4 + (recipient_length + 1) / 2;
+	// TP-SCTS, TP-DT and TP-ST.
+	if (scts_start + 7 + 7 + 1 > buffer_length)
+		return -1;
+	DecodePhoneNumber(buffer + report_start + 4, recipient_length, recipient);
+
+	*discharge_time = DecodeTimestamp(buffer + scts_start + 7);
+	*status = buffer[scts_start + 14];
+	return 0;
+}
@@ -8,9 +8,21 @@
 #ifndef SMS_PDU_H_
 #define SMS_PDU_H_
 
+#include <stdint.h>
 #include <time.h>
 
 enum { SMS_MAX_PDU_LENGTH  = 256 };
+enum { SMS_MAX_PARTS = 255 };
+/* Scratch space that fits the encoded text of any message of up to
+ * SMS_MAX_PARTS parts. */
+enum { SMS_ENCODE_SCRATCH_SIZE = SMS_MAX_PARTS * 160 };
+
+/* Flags for pdu_encode_multipart_ex(). */
+enum {
+	PDU_ENCODE_REF16 = 0x01,	/* 16-bit concatenation reference (IEI 0x08) */
+	PDU_ENCODE_STATUS_REPORT = 0x02,	/* request a status report (TP-SRR) */
+	PDU_ENCODE_MIXED = 0x04,	/* choose GSM-7 or UCS-2 for each part */
+};
 
 /* 
  * Encode an SMS message. Output the encoded message into output pdu buffer.
@@ -31,11 +43,60 @@ int pdu_encode_multipart(const char* service_center_number,
 			 unsigned char reference_number, int part_number,
 			 int* total_parts, unsigned char* pdu, int pdu_size);
 
+/*
+ * Same as pdu_encode_multipart() with PDU_ENCODE_* flags. With
+ * PDU_ENCODE_REF16 the reference_number may use 16 bits; the longer header
+ * leaves 152 GSM-7 or 66 UCS-2 characters per part.
+ */
+int pdu_encode_multipart_ex(const char* service_center_number,
+			    const char* phone_number, const char* text,
+			    int reference_number, int flags, int part_number,
+			    int* total_parts, unsigned char* pdu, int pdu_size);
+
+/*
+ * Encode all parts of an SMS message at once: the text is transcoded a single
+ * time and every part boundary is found in one walk. Part i is written to
+ * pdus[i] with its length in pdu_lengths[i]. With pdus set to NULL only the
+ * number of parts is computed. Returns the total number of parts or a
+ * negative number in case encoding failed or max_parts is too small.
+ */
+int pdu_encode_parts(const char* service_center_number,
+		     const char* phone_number, const char* text,
+		     int reference_number, int flags,
+		     unsigned char (*pdus)[SMS_MAX_PDU_LENGTH], int* pdu_lengths,
+		     int max_parts);
+
+/*
+ * Same as pdu_encode_parts(), but the text is transcoded into the caller
+ * supplied scratch buffer and nothing is allocated on the heap. A scratch
+ * buffer of SMS_ENCODE_SCRATCH_SIZE octets is enough for every message.
+ */
+int pdu_encode_parts_scratch(const char* service_center_number,
+			     const char* phone_number, const char* text,
+			     int reference_number, int flags,
+			     unsigned char (*pdus)[SMS_MAX_PDU_LENGTH],
+			     int* pdu_lengths, int max_parts,
+			     unsigned char* scratch, int scratch_size);
+
+/*
+ * Set the concatenation reference of an SMS-SUBMIT part in place, so that
+ * a message can be encoded before its reference is allocated. Returns 0,
+ * or a negative number when the PDU has no concatenation header.
+ */
+int pdu_set_reference(unsigned char* pdu, int pdu_len, int reference_number);
+
+/*
+ * Hash of a phone number, ignoring a leading '+'. sms_tool and pdu_encoder
+ * key their concatenation references per recipient on it.
+ */
+unsigned int pdu_number_hash(const char* number);
+
 /* 
  * Decode an SMS message. Output the decoded message into the sms text buffer.
  * Returns the length of the SMS dencoded message or a negative number in
  * case encoding failed (for example provided output buffer has not enough
- * space).
+ * space). The text does not include the user data header; skip_bytes is set
+ * to its length in octets, or 0 when there is none.
  */
 int pdu_decode(const unsigned char* pdu, int pdu_len,
 	       time_t* sms_time,
@@ -47,13 +108,177 @@ int pdu_decode(const unsigned char* pdu, int pdu_len,
 	       int* part_number,
 	       int* skip_bytes);
 
+/* Alphabet of the user data, from TP-DCS. */
+enum {
+	SMS_ALPHABET_GSM7 = 0,
+	SMS_ALPHABET_8BIT = 1,
+	SMS_ALPHABET_UCS2 = 2,
+	SMS_ALPHABET_RESERVED = 3,
+};
+
+/*
+ * An SMS-DELIVER parsed once. The PDU is not copied: every field except
+ * the last ones is an offset into pdu, checked to lie within length when
+ * the view was parsed. Headers can be read from it without decoding the
+ * text.
+ */
+struct sms_pdu_view {
+	const unsigned char* pdu;
+	int length;
+	int smsc;		/* SMSC address length octet */
+	int first_octet;	/* TP-MTI, TP-UDHI, ... */
+	int originator;		/* TP-OA, or TP-DA of a submit, length octet */
+	int pid;		/* TP-PID */
+	int dcs;		/* TP-DCS */
+	int scts;		/* TP-SCTS, 7 octets with the time zone, or -1 */
+	int udl;		/* TP-UDL */
+	int udh;		/* UDH length octet, or -1 without a header */
+	int udh_length;		/* UDH octets with its length octet, or 0 */
+	int user_data;		/* first octet of the text, after the UDH */
+	int user_data_length;	/* octets of text from user_data on */
+	int text_length;	/* GSM-7 septets or octets, without the UDH */
+	int fill_bits;		/* GSM-7 bits before the first septet */
+	int alphabet;		/* SMS_ALPHABET_* */
+	int ref_number;		/* concatenation, all 0 for a single part */
+	int total_parts;
+	int part_number;
+	int locking_shift;	/* national language tables */
+	int single_shift;
+	int destination_port;	/* application port addressing, or -1 */
+	int source_port;
+};
+
+/* User data header information element identifiers. */
+enum {
+	SMS_IE_CONCAT = 0x00,		/* 8-bit reference */
+	SMS_IE_PORT8 = 0x04,		/* 8-bit application port addresses */
+	SMS_IE_PORT16 = 0x05,		/* 16-bit application port addresses */
+	SMS_IE_CONCAT16 = 0x08,		/* 16-bit reference */
+	SMS_IE_SINGLE_SHIFT = 0x24,	/* national language single shift */
+	SMS_IE_LOCKING_SHIFT = 0x25,	/* national language locking shift */
+};
+
+/* One information element; data points into the PDU. */
+struct sms_udh_ie {
+	int id;
+	int length;
+	const unsigned char* data;
+};
+
+/* Walks the information elements of a user data header in place. */
+struct sms_udh_iterator {
+	const unsigned char* udh;
+	int length;
+	int offset;
+};
+
+/*
+ * Start at the first information element of the view's header, if any.
+ * pdu_udh_next() then returns 1 and fills ie for each element in turn, and
+ * 0 at the end of the header or at an element that runs past it.
+ */
+void pdu_udh_begin(struct sms_udh_iterator* it,
+		   const struct sms_pdu_view* view);
+int pdu_udh_next(struct sms_udh_iterator* it, struct sms_udh_ie* ie);
+
+/*
+ * Parse an SMS-DELIVER, or an SMS-SUBMIT as kept in storage, into view.
+ * A submit has no time stamp, scts is -1, and its recipient stands in for
+ * the originator. Returns 0, or a negative number when the PDU is neither
+ * or any of its fields lies outside pdu_len.
+ */
+int pdu_view_parse(struct sms_pdu_view* view, const unsigned char* pdu,
+		   int pdu_len);
+
+/*
+ * Decode the originator address, or the recipient of a submit, digits or
+ * alphanumeric, to a NUL terminated string. Returns its length or a
+ * negative number.
+ */
+int pdu_view_sender(const struct sms_pdu_view* view, char* sender,
+		    int sender_size);
+
+/*
+ * Decode the service centre time stamp. The time is as sent by the service
+ * centre, in its local time; tz_minutes, when not NULL, is set to the
+ * offset of that time from UTC. A submit has none and gives 0.
+ */
+time_t pdu_view_time(const struct sms_pdu_view* view, int* tz_minutes);
+
+/*
+ * Decode GSM-7 or UCS-2 text to NUL terminated UTF-8, cut short at a
+ * character boundary to fit text_size. Returns its length in bytes or -1,
+ * as for 8-bit data.
+ */
+int pdu_view_text(const struct sms_pdu_view* view, char* text, int text_size);
+
+/*
+ * Decode an SMS-STATUS-REPORT, as carried by +CDS or read from storage.
+ * Returns 0 on success or a negative number when the PDU is not a status
+ * report. status is the raw TP-ST value: 0x00-0x1F transaction completed,
+ * 0x20-0x3F temporary error with retries still pending, 0x40 and above
+ * permanent failure.
+ */
+int pdu_decode_status_report(const unsigned char* pdu, int pdu_len,
+			     int* message_reference,
+			     char* recipient, int recipient_size,
+			     time_t* discharge_time, int* status);
+
 int ucs2_to_utf8 (int ucs2, unsigned char * utf8);
 
+/*
+ * Convert UCS-2 (UTF-16BE, surrogate pairs included) user data to NUL
+ * terminated UTF-8. Unpaired surrogates become U+FFFD and an odd trailing
+ * octet is ignored. The text is cut short at a character boundary to fit
+ * utf8_size. Returns its length in bytes.
+ */
+size_t ucs2be_to_utf8(const uint8_t* ucs2, size_t ucs2_length, char* utf8,
+		      size_t utf8_size);
+
+/*
+ * Convert length octets to upper case hex, NUL terminated. hex must hold
+ * 2 * length + 1 bytes.
+ */
+void pdu_hex_encode(const unsigned char* data, int length, char* hex);
+
+/*
+ * Convert hex_length hex digits, either case, to octets. Returns the number
+ * of octets, or -1 for an odd length, any other character or output_size
+ * too small.
+ */
+int pdu_hex_decode(const char* hex, int hex_length, unsigned char* output,
+		   int output_size);
+
 int DecodePDUMessage_GSM_7bit(const unsigned char* buffer,
 			      int buffer_length,
 			      char* output_sms_text,
 			      int sms_text_length);
 
+/*
+ * Pack count septets (the low 7 bits of each byte) into octets. The first
+ * fill_bits (0-6) bits of the output stay zero, as after a user data
+ * header. Returns the number of octets written or -1.
+ */
+int pdu_pack_septets(const unsigned char* septets, int count, int fill_bits,
+		     unsigned char* output, int output_size);
+
+/*
+ * Unpack up to count septets from packed octets, skipping the first
+ * fill_bits (0-6) bits as after a user data header. Returns the number of
+ * septets written, fewer than count when the input is short, or -1.
+ */
+int pdu_unpack_septets(const unsigned char* packed, int packed_length,
+		       int fill_bits, unsigned char* septets, int count);
+
+/*
+ * Decode count packed septets of the default alphabet, escapes included,
+ * to NUL terminated UTF-8, skipping fill_bits (0-6) of the first octet.
+ * The text is cut short to fit text_size. Returns its length in bytes or
+ * -1 when the input holds fewer than count septets.
+ */
+int pdu_decode_gsm7(const unsigned char* packed, int packed_length,
+		    int fill_bits, int count, char* text, int text_size);
+
 int EncodePDUMessage(const char* sms_text,
 		     int sms_text_length,
 		     unsigned char* output_buffer,
@@ -0,0 +1,489 @@
+/*
+ * Encoder and decoder micro benchmarks, run with "make bench".
+ */
+#include "pdu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+static int pdu_lengths[SMS_MAX_PARTS];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Encode every part with one pdu_encode_multipart_ex() call per part. */
+static int encode_per_part(const char* text)
+{
+	int total_parts = 1;
+
+	for (int part = 1; part <= total_parts; ++part) {
+		if (pdu_encode_multipart_ex("", "+1234567890", text, 0x42, 0, part,
+					    &total_parts, pdus[part - 1],
+					    SMS_MAX_PDU_LENGTH) < 0)
+			return -1;
+	}
+	return total_parts;
+}
+
+static int encode_all_parts(const char* text)
+{
+	return pdu_encode_parts("", "+1234567890", text, 0x42, 0, pdus,
+				pdu_lengths, SMS_MAX_PARTS);
+}
+
+/* Run fn repeatedly for at least 0.2 s; returns microseconds per call. */
+static double measure(int (*fn)(const char*), const char* text, int* parts)
+{
+	long iterations = 0;
+	double start = now();
+	double elapsed;
+
+	do {
+		*parts = fn(text);
+		iterations++;
+		elapsed = now() - start;
+	} while (elapsed < 0.2);
+	return elapsed * 1e6 / iterations;
+}
+
+static char* make_text(const char* unit, int parts, int per_part)
+{
+	const size_t unit_length = strlen(unit);
+	const size_t count = (size_t)parts * per_part;
+	char* text = malloc(count * unit_length + 1);
+
+	if (!text)
+		exit(1);
+	for (size_t i = 0; i < count; ++i)
+		memcpy(text + i * unit_length, unit, unit_length);
+	text[count * unit_length] = '\0';
+	return text;
+}
+
+static void bench_encode(void)
+{
+	static const int part_counts[] = { 10, 50, 255 };
+	static const struct {
+		const char* name;
+		const char* unit;
+		int per_part;
+	} alphabets[] = {
+		{ "GSM-7", "a", 153 },
+		{ "UCS-2", "\xC5\xBC", 67 },
+	};
+
+	printf("%-8s %6s %14s %14s %8s\n", "alphabet", "parts",
+	       "per part (us)", "all parts (us)", "speedup");
+	for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); ++a) {
+		for (size_t p = 0; p < sizeof(part_counts) / sizeof(part_counts[0]); ++p) {
+			char* text = make_text(alphabets[a].unit, part_counts[p],
+					       alphabets[a].per_part);
+			int parts_old, parts_new;
+			double old_us = measure(encode_per_part, text, &parts_old);
+			double new_us = measure(encode_all_parts, text, &parts_new);
+			if (parts_old != part_counts[p] || parts_new != part_counts[p])
+				printf("unexpected part count %d/%d\n", parts_old, parts_new);
+			printf("%-8s %6d %14.1f %14.1f %7.1fx\n", alphabets[a].name,
+			       part_counts[p], old_us, new_us, old_us / new_us);
+			free(text);
+		}
+	}
+}
+
+/* The former per-septet packer of EncodeMultipartGsm7(), as a baseline. */
+static int pack_bitwise(const unsigned char* septets, int count, int fill_bits,
+			unsigned char* output)
+{
+	const int length = (fill_bits + count * 7 + 7) / 8;
+
+	memset(output, 0, length);
+	for (int i = 0; i < count; ++i) {
+		const int bit_position = fill_bits + i * 7;
+		const int byte_position = bit_position / 8;
+		const int shift = bit_position % 8;
+		output[byte_position] |= (septets[i] & 0x7F) << shift;
+		if (shift > 1)
+			output[byte_position + 1] |= (septets[i] & 0x7F) >> (8 - shift);
+	}
+	return length;
+}
+
+static void bench_pack(void)
+{
+	static const int lengths[] = { 16, 153, 160 };
+	unsigned char septets[160];
+	unsigned char output[141];
+	volatile unsigned char sink = 0;
+
+	for (int i = 0; i < 160; ++i)
+		septets[i] = 'a' + i % 26;
+	printf("\n%-8s %6s %14s %14s %8s\n", "pack", "septets",
+	       "bitwise (ns)", "word (ns)", "speedup");
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+		const long iterations = 2000000;
+		double start = now();
+		for (long n = 0; n < iterations; ++n) {
+			pack_bitwise(septets, lengths[l], n % 7, output);
+			sink ^= output[0];
+		}
+		const double bitwise_ns = (now() - start) * 1e9 / iterations;
+		start = now();
+		for (long n = 0; n < iterations; ++n) {
+			pdu_pack_septets(septets, lengths[l], n % 7, output,
+					 sizeof(output));
+			sink ^= output[0];
+		}
+		const double word_ns = (now() - start) * 1e9 / iterations;
+		printf("%-8s %6d %14.1f %14.1f %7.1fx\n", "", lengths[l],
+		       bitwise_ns, word_ns, bitwise_ns / word_ns);
+	}
+}
+
+/* The former DecodePDUMessage_GSM_7bit(), as a baseline. */
+static int unpack_bitwise(const unsigned char* buffer, int buffer_length,
+			  char* output, int count)
+{
+	int length = 0;
+	if (buffer_length > 0)
+		output[length++] = 0x7F & buffer[0];
+
+	if (count > 1) {
+		int carry_on_bits = 1;
+		int i = 1;
+		for (; i < buffer_length; ++i) {
+			output[length++] = 0x7F & ((buffer[i] << carry_on_bits) |
+					(buffer[i - 1] >> (8 - carry_on_bits)));
+			if (length == count)
+				break;
+			carry_on_bits++;
+			if (carry_on_bits == 8) {
+				carry_on_bits = 1;
+				output[length++] = buffer[i] & 0x7F;
+				if (length == count)
+					break;
+			}
+		}
+		if (length < count)
+			output[length++] = buffer[i - 1] >> (8 - carry_on_bits);
+	}
+	return length;
+}
+
+/*
+ * SMS-DELIVER PDUs as read from modems: a plain 7-bit message, a 160
+ * character one, an alphanumeric sender, Turkish and Portuguese shift
+ * tables and a three part Turkish message.
+ */
+static const char* const deliver_corpus[] = {
+	"07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07",
+	"0791447758100650040B914477286153F40000428051214365009AD9775D0E8287E5E3321B44BBC562A07B9ACD0689CB2072999DB697E5653288FE6EBFE5F2F71D242ED3EFE5B21B1483E9603050D84D06C5683A18CC059296E1EC3C684A7D4241F437E80DA783DE753AE86D0691CBECB4BD2CCF83DC6F7ADA9C1E87E9E9B77BEE0251E5E1F11A94A683DE6E76DA5D0685E9A0B03B0FA2A7DB6516888E0EBBD7F310",
+	"00040DD049B7F93D6D4E0100004280512143650025D9775D0E1ABFC965507A0EA2E164B9D8CC0522BE41EE371D344787E565509AEE02",
+	"00440A9121436587090000428051214365002903240101D84CD39B393B7D2297419BF4E64CDEA4E52CD026A96FA7E5277219B419873767",
+	"00440A9121436587090000428051214365001A03240103986EF66F90F2BDD9BF419B720D340E9B0B2008",
+	"00440A912143658709000042805121436500A0082501010003F10301E070381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E",
+	"00440A912143658709000042805121436500A0082501010003F10302E070381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E",
+	"00440A91214365870900004280512143650071082501010003F10303E070381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E87C3E170381C0E07",
+};
+
+#define CORPUS_SIZE (sizeof(deliver_corpus) / sizeof(deliver_corpus[0]))
+
+static void bench_unpack(void)
+{
+	static unsigned char corpus[CORPUS_SIZE][SMS_MAX_PDU_LENGTH + 16];
+	int lengths[CORPUS_SIZE];
+	int user_data[CORPUS_SIZE];
+	int headers[CORPUS_SIZE];
+	int total_septets = 0;
+	char text[3 * 160 + 1];
+	unsigned char septets[160];
+	volatile unsigned char sink = 0;
+
+	for (size_t m = 0; m < CORPUS_SIZE; ++m) {
+		lengths[m] = strlen(deliver_corpus[m]) / 2;
+		for (int i = 0; i < lengths[m]; ++i)
+			sscanf(deliver_corpus[m] + 2 * i, "%2hhx", &corpus[m][i]);
+		const unsigned char* pdu = corpus[m];
+		const int deliver = 1 + pdu[0];
+		user_data[m] = deliver + 3 + (pdu[deliver + 1] + 1) / 2 + 9;
+		headers[m] = (pdu[deliver] & 0x40) ? pdu[user_data[m] + 1] + 1 : 0;
+		total_septets += pdu[user_data[m]];
+	}
+
+	const long iterations = 200000;
+	double start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t m = 0; m < CORPUS_SIZE; ++m) {
+			const unsigned char* ud = corpus[m] + user_data[m];
+			unpack_bitwise(ud + 1, lengths[m] - user_data[m] - 1,
+				       (char*)septets, ud[0]);
+			sink ^= septets[0];
+		}
+	}
+	const double bitwise_ns = (now() - start) * 1e9 / iterations;
+
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t m = 0; m < CORPUS_SIZE; ++m) {
+			const unsigned char* ud = corpus[m] + user_data[m];
+			const int header = headers[m];
+			const int header_septets = (header * 8 + 6) / 7;
+			pdu_unpack_septets(ud + 1 + header,
+					   lengths[m] - user_data[m] - 1 - header,
+					   header_septets * 7 - header * 8,
+					   septets, ud[0] - header_septets);
+			sink ^= septets[0];
+		}
+	}
+	const double word_ns = (now() - start) * 1e9 / iterations;
+
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t m = 0; m < CORPUS_SIZE; ++m) {
+			char sender[32];
+			time_t time;
+			int dcs, reference, total, part, skip;
+			pdu_decode(corpus[m], lengths[m], &time, sender,
+				   sizeof(sender), text, sizeof(text), &dcs,
+				   &reference, &total, &part, &skip);
+			sink ^= text[0];
+		}
+	}
+	const double decode_ns = (now() - start) * 1e9 / iterations;
+
+	// Headers only, as for filtering and reassembly.
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t m = 0; m < CORPUS_SIZE; ++m) {
+			struct sms_pdu_view view;
+			pdu_view_parse(&view, corpus[m], lengths[m]);
+			sink ^= view.part_number + (int)pdu_view_time(&view, NULL);
+		}
+	}
+	const double view_ns = (now() - start) * 1e9 / iterations;
+
+	printf("\n%-8s %6s %14s %14s %8s\n", "unpack", "PDUs",
+	       "bitwise (ns)", "word (ns)", "speedup");
+	printf("%-8s %6d %14.1f %14.1f %7.1fx\n", "", (int)CORPUS_SIZE,
+	       bitwise_ns, word_ns, bitwise_ns / word_ns);
+	printf("%-8s %6d septets, %.0f Mseptets/s unpacked, %.2f M PDUs/s decoded\n",
+	       "", total_septets, total_septets * 1e3 / word_ns,
+	       CORPUS_SIZE * 1e3 / decode_ns);
+	printf("%-8s %6s %.2f M PDUs/s headers parsed into a view\n", "", "",
+	       CORPUS_SIZE * 1e3 / view_ns);
+}
+
+/* The former per-character conversion of recv and pdu_decoder. */
+static int ucs2_per_char(const unsigned char* ucs2, int length, char* output)
+{
+	int output_length = 0;
+
+	for (int i = 0; i + 1 < length; i += 2) {
+		unsigned char utf8_char[5];
+		const int len = ucs2_to_utf8((ucs2[i] << 8) | ucs2[i + 1],
+					     utf8_char);
+		for (int j = 0; j < len; j++)
+			output[output_length++] = utf8_char[j];
+	}
+	return output_length;
+}
+
+static void bench_ucs2(void)
+{
+	static const struct {
+		const char* name;
+		unsigned int first;
+		unsigned int span;
+	} corpora[] = {
+		{ "ASCII", 0x20, 0x5F },
+		{ "Cyrillic", 0x0410, 0x40 },
+		{ "CJK", 0x4E00, 0x5000 },
+	};
+	unsigned char ucs2[140];
+	char output[3 * 70 + 1];
+	volatile char sink = 0;
+
+	printf("\n%-8s %6s %14s %14s %8s\n", "ucs2", "units",
+	       "per char (ns)", "buffer (ns)", "speedup");
+	for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); ++c) {
+		for (int i = 0; i < 70; ++i) {
+			/* Every eighth character a space, as in running text. */
+			const unsigned int u = i % 8 == 7 ? 0x20 :
+				corpora[c].first + (i * 7919) % corpora[c].span;
+			ucs2[2 * i] = u >> 8;
+			ucs2[2 * i + 1] = u;
+		}
+		const long iterations = 1000000;
+		double start = now();
+		for (long n = 0; n < iterations; ++n) {
+			ucs2_per_char(ucs2, sizeof(ucs2), output);
+			sink ^= output[0];
+		}
+		const double per_char_ns = (now() - start) * 1e9 / iterations;
+		start = now();
+		for (long n = 0; n < iterations; ++n) {
+			ucs2be_to_utf8(ucs2, sizeof(ucs2), output, sizeof(output));
+			sink ^= output[0];
+		}
+		const double buffer_ns = (now() - start) * 1e9 / iterations;
+		printf("%-8s %6d %14.1f %14.1f %7.1fx\n", corpora[c].name, 70,
+		       per_char_ns, buffer_ns, per_char_ns / buffer_ns);
+	}
+}
+
+/* The former per-octet conversions of send, recv and pdu_decoder. */
+static void hex_sprintf(const unsigned char* data, int length, char* hex)
+{
+	for (int i = 0; i < length; ++i)
+		sprintf(hex + 2 * i, "%02X", data[i]);
+}
+
+static void hex_strtol(const char* hex, int length, unsigned char* output)
+{
+	char t[3] = { 0 };
+
+	for (int i = 0; i < length; i += 2) {
+		t[0] = hex[i];
+		t[1] = hex[i + 1];
+		output[i / 2] = strtol(t, NULL, 16);
+	}
+}
+
+static void bench_hex(void)
+{
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char hex[2 * SMS_MAX_PDU_LENGTH + 1];
+	volatile char sink = 0;
+	const int length = 160;  /* a full single part PDU */
+
+	for (int i = 0; i < length; ++i)
+		pdu[i] = i * 37 + 11;
+	const long iterations = 1000000;
+
+	double start = now();
+	for (long n = 0; n < iterations; ++n) {
+		hex_sprintf(pdu, length, hex);
+		sink ^= hex[0];
+	}
+	const double sprintf_ns = (now() - start) * 1e9 / iterations;
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		pdu_hex_encode(pdu, length, hex);
+		sink ^= hex[0];
+	}
+	const double encode_ns = (now() - start) * 1e9 / iterations;
+
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		hex_strtol(hex, 2 * length, pdu);
+		sink ^= pdu[0];
+	}
+	const double strtol_ns = (now() - start) * 1e9 / iterations;
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		pdu_hex_decode(hex, 2 * length, pdu, sizeof(pdu));
+		sink ^= pdu[0];
+	}
+	const double decode_ns = (now() - start) * 1e9 / iterations;
+
+	printf("\n%-8s %6s %14s %14s %8s\n", "hex", "octets",
+	       "libc (ns)", "codec (ns)", "speedup");
+	printf("%-8s %6d %14.1f %14.1f %7.1fx\n", "encode", length,
+	       sprintf_ns, encode_ns, sprintf_ns / encode_ns);
+	printf("%-8s %6d %14.1f %14.1f %7.1fx\n", "decode", length,
+	       strtol_ns, decode_ns, strtol_ns / decode_ns);
+}
+
+static int count_parts(const char* text)
+{
+	return pdu_encode_parts("", "+1234567890", text, 0x42, 0, NULL, NULL, 0);
+}
+
+/*
+ * Choosing the alphabet and national language tables, against plain ASCII
+ * of the same length: an escaped character, Turkish letters, which need a
+ * shift table, and CJK, which falls back to UCS-2.
+ */
+static void bench_layout(void)
+{
+	static const struct {
+		const char* name;
+		const char* unit;
+	} corpora[] = {
+		{ "ASCII", "Meeting moved to 10:00, room 4. " },
+		{ "braces", "Meeting moved to {10:00} room 4. " },
+		{ "Turkish", "Toplantı 10:00'a alındı, oda 4. " },
+		{ "CJK", "会議は十時に変更、四号室です。" },
+	};
+	double ascii_us = 0;
+
+	printf("\n%-8s %6s %14s %8s\n", "layout", "parts", "per text (us)",
+	       "vs ASCII");
+	for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); ++c) {
+		char* text = make_text(corpora[c].unit, 10, 1);
+		int parts;
+		const double us = measure(count_parts, text, &parts);
+		if (c == 0)
+			ascii_us = us;
+		printf("%-8s %6d %14.2f %7.1fx\n", corpora[c].name, parts, us,
+		       us / ascii_us);
+		free(text);
+	}
+}
+
+/* Part counts of mixed-script messages with and without PDU_ENCODE_MIXED. */
+static void report_mixed(void)
+{
+	static const struct {
+		const char* name;
+		const char* text;
+		int repeat;
+	} corpora[] = {
+		{ "ASCII, CJK signature", "Meeting moved to 10:00, room 4. ", 10 },
+		{ "Latin and Cyrillic", "Hello, see you tomorrow. Привет, до завтра. ", 6 },
+		{ "Latin and Arabic", "Order 4711 shipped today. تم شحن الطلب ", 5 },
+		{ "mostly CJK", "東京で会いましょう。", 12 },
+	};
+	int total_uniform = 0, total_mixed = 0;
+
+	printf("\n%-22s %8s %8s\n", "corpus", "whole", "per part");
+	for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); ++i) {
+		char* text = make_text(corpora[i].text, corpora[i].repeat, 1);
+		if (i == 0) {
+			char* signed_text = malloc(strlen(text) + 16);
+			if (!signed_text)
+				exit(1);
+			sprintf(signed_text, "%s田中", text);
+			free(text);
+			text = signed_text;
+		}
+		const int uniform = pdu_encode_parts("", "+1234567890", text, 0x42,
+						     0, NULL, NULL, 0);
+		const int mixed = pdu_encode_parts("", "+1234567890", text, 0x42,
+						   PDU_ENCODE_MIXED, NULL, NULL, 0);
+		printf("%-22s %8d %8d\n", corpora[i].name, uniform, mixed);
+		total_uniform += uniform;
+		total_mixed += mixed;
+		free(text);
+	}
+	printf("%-22s %8d %8d (%.0f%% fewer parts)\n", "total", total_uniform,
+	       total_mixed, 100.0 * (total_uniform - total_mixed) / total_uniform);
+}
+
+int main(void)
+{
+	bench_encode();
+	bench_pack();
+	bench_unpack();
+	bench_ucs2();
+	bench_hex();
+	bench_layout();
+	report_mixed();
+	return 0;
+}
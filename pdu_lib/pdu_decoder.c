@@ -1,50 +1,88 @@
 /*
  * 2014 lovewilliam <ztong@vt.edu>
  * SMS PDU Decoder
+ *
+ * Without arguments one hex PDU is read from stdin and printed. Given a file
+ * of hex PDUs, one per line as written by sms_tool recv -r, every line is
+ * decoded to one NDJSON object, in input order.
  */
 #include "pdu.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
-#include <wchar.h>
+#include <unistd.h>
 
-int ucs2_to_utf8 (int ucs2, unsigned char * utf8);
+/* Input handed to a worker at a time, and chunks in flight per thread. */
+enum { CHUNK_SIZE = 256 * 1024, CHUNKS_PER_THREAD = 4 };
+
+struct chunk {
+	char* output;
+	size_t output_length;
+	size_t output_size;
+	long messages;
+	long failed;
+	int done;
+};
+
+struct batch {
+	const char* data;
+	size_t length;
+	size_t offset;		/* start of the next chunk to hand out */
+	long next;		/* number of that chunk */
+	long written;		/* chunks written to stdout so far */
+	int writing;
+	int window;
+	struct chunk* chunks;	/* ring of window chunks */
+	long messages;
+	long failed;
+	int write_error;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: pdu_decoder [options] [file]\n"
+		"options:\n"
+		"\t-t <threads> (default: number of CPUs)\n"
+		);
+	exit(2);
+}
 
 int sms_decode()
 {
-	char buffer[2*SMS_MAX_PDU_LENGTH+4];
-	char *p = buffer;
-	char t[2];
-	int d;
-	do
-	{
-		t[0] = getchar();
-		if(t[0]=='\n')
-		{
-			break;
-		}
-		t[1] = getchar();
-		if(t[1]=='\n')
-		{
-			break;
-		}
-		*p = strtol(t,NULL,16);
-		p++;
-	}while(1);
+	char line[2 * SMS_MAX_PDU_LENGTH + 4];
+	unsigned char buffer[SMS_MAX_PDU_LENGTH];
+
+	if (!fgets(line, sizeof(line), stdin))
+		return 1;
+	size_t line_length = strcspn(line, "\r\n");
+	const int length = pdu_hex_decode(line, line_length, buffer,
+					  sizeof(buffer));
+	if (length < 0) {
+		fprintf(stderr, "invalid hex PDU\n");
+		return 1;
+	}
 
 	time_t sms_time;
 	char sms_phone[40];
-	char sms_text[161];
+	char sms_text[3 * 160 + 1];
 	int tp_dcs_type;
 	int ref_number;
 	int total_parts;
 	int part_number;
 	int skip_bytes;
 
-	int sms_text_length = pdu_decode((const unsigned char*)buffer,
-					sizeof(buffer),
+	int sms_text_length = pdu_decode(buffer,
+					length,
 					&sms_time,
 					sms_phone, sizeof(sms_phone),
 					sms_text, sizeof(sms_text),
@@ -53,12 +91,21 @@ int sms_decode()
 					&total_parts,
 					&part_number,
 					&skip_bytes);
+	if (sms_text_length < 0) {
+		fprintf(stderr, "error decoding pdu\n");
+		return 1;
+	}
 
-	printf("From:%s\n",sms_phone);
+	// A stored submit has its recipient and no time stamp.
+	struct sms_pdu_view view;
+	pdu_view_parse(&view, buffer, length);
+	printf(view.scts < 0 ? "To:%s\n" : "From:%s\n", sms_phone);
 	printf("Textlen=%d\n",sms_text_length);
-	char time_data_str[64];
-	strftime(time_data_str,64,"%D %T", localtime(&sms_time));
-	printf("Date/Time:%s\n",time_data_str);
+	if (view.scts >= 0) {
+		char time_data_str[64];
+		strftime(time_data_str,64,"%D %T", localtime(&sms_time));
+		printf("Date/Time:%s\n",time_data_str);
+	}
 
 	if (total_parts > 0) {
 		printf("Reference number: %d\n", ref_number);
@@ -70,9 +117,7 @@ int sms_decode()
 		case 0:
 			{
 				// GSM7 bit
-				int i = skip_bytes;
-				if(skip_bytes > 0) i = (skip_bytes*8+6)/7;
-				for(;i<sms_text_length;i++)
+				for(int i = 0;i<sms_text_length;i++)
 				{
 					printf("%c", sms_text[i]);
 				}
@@ -81,18 +126,10 @@ int sms_decode()
 		case 2:
 			{
 				// UCS2
-				for(int i = skip_bytes;i<sms_text_length;i+=2)
-				{
-					int ucs2_char = 0x000000FF&sms_text[i+1];
-					ucs2_char|=(0x0000FF00&(sms_text[i]<<8));
-					unsigned char utf8_char[5];
-					int len = ucs2_to_utf8(ucs2_char,utf8_char);
-					int j;
-					for(j=0;j<len;j++)
-					{
-						printf("%c",utf8_char[j]);
-					}
-				}
+				char utf8_text[3 * 160 + 1];
+				ucs2be_to_utf8((const uint8_t*)sms_text, sms_text_length,
+					       utf8_text, sizeof(utf8_text));
+				fputs(utf8_text, stdout);
 				break;
 			}
 		default:
@@ -104,8 +141,332 @@ int sms_decode()
 	return 0;
 }
 
-int main()
+static int append(struct chunk* c, const char* data, size_t length)
 {
-	return sms_decode();
+	if (c->output_length + length > c->output_size) {
+		size_t size = c->output_size ? c->output_size : 65536;
+		while (size < c->output_length + length)
+			size *= 2;
+		char* output = realloc(c->output, size);
+		if (!output)
+			return -1;
+		c->output = output;
+		c->output_size = size;
+	}
+	memcpy(c->output + c->output_length, data, length);
+	c->output_length += length;
+	return 0;
 }
 
+/* Append a JSON string, UTF-8 passed through and control characters escaped. */
+static int append_string(struct chunk* c, const char* s, size_t length)
+{
+	char escaped[8];
+	size_t start = 0;
+
+	if (append(c, "\"", 1) < 0)
+		return -1;
+	for (size_t i = 0; i < length; ++i) {
+		const unsigned char ch = s[i];
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+			continue;
+		int n;
+		if (ch == '"' || ch == '\\')
+			n = snprintf(escaped, sizeof(escaped), "\\%c", ch);
+		else if (ch == '\n')
+			n = snprintf(escaped, sizeof(escaped), "\\n");
+		else
+			n = snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+		if (append(c, s + start, i - start) < 0 ||
+		    append(c, escaped, (size_t)n) < 0)
+			return -1;
+		start = i + 1;
+	}
+	if (append(c, s + start, length - start) < 0)
+		return -1;
+	return append(c, "\"", 1);
+}
+
+/* ISO 8601 with the offset from UTC. */
+static void format_time(time_t time, int tz_minutes, char* output, size_t size)
+{
+	struct tm tm;
+	const int offset = tz_minutes < 0 ? -tz_minutes : tz_minutes;
+
+	gmtime_r(&time, &tm);
+	snprintf(output, size, "%04d-%02d-%02dT%02d:%02d:%02d%c%02d:%02d",
+		 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+		 tm.tm_min, tm.tm_sec, tz_minutes < 0 ? '-' : '+',
+		 offset / 60, offset % 60);
+}
+
+static int decode_status_report(struct chunk* c, const unsigned char* pdu,
+				int length)
+{
+	char recipient[40];
+	char timestamp[64];
+	char line[160];
+	time_t discharge_time;
+	int message_reference;
+	int status;
+
+	if (pdu_decode_status_report(pdu, length, &message_reference,
+				     recipient, sizeof(recipient),
+				     &discharge_time, &status) < 0)
+		return -1;
+	format_time(discharge_time, 0, timestamp, sizeof(timestamp));
+	const int n = snprintf(line, sizeof(line),
+			       "{\"type\":\"status_report\",\"recipient\":\"%s\","
+			       "\"message_reference\":%d,\"timestamp\":\"%s\","
+			       "\"status\":%d}\n", recipient, message_reference,
+			       timestamp, status);
+	return append(c, line, (size_t)n);
+}
+
+static int decode_deliver(struct chunk* c, const unsigned char* pdu,
+			  int length)
+{
+	struct sms_pdu_view view;
+	char sender[40];
+	char text[4 * 160 + 1];
+	char timestamp[64];
+	char line[256];
+	int tz_minutes;
+
+	if (pdu_view_parse(&view, pdu, length) < 0 ||
+	    pdu_view_sender(&view, sender, sizeof(sender)) < 0)
+		return -1;
+
+	// A stored submit has its recipient and no time stamp.
+	int n = snprintf(line, sizeof(line), view.scts < 0 ?
+			 "{\"recipient\":" : "{\"sender\":");
+	if (append(c, line, (size_t)n) < 0 ||
+	    append_string(c, sender, strlen(sender)) < 0)
+		return -1;
+	n = 0;
+	if (view.scts >= 0) {
+		const time_t sms_time = pdu_view_time(&view, &tz_minutes);
+		format_time(sms_time, tz_minutes, timestamp, sizeof(timestamp));
+		n = snprintf(line, sizeof(line), ",\"timestamp\":\"%s\"",
+			     timestamp);
+	}
+	if (view.total_parts > 0)
+		n += snprintf(line + n, sizeof(line) - n,
+			      ",\"reference\":%d,\"part\":%d,\"total\":%d",
+			      view.ref_number, view.part_number,
+			      view.total_parts);
+	if (view.destination_port >= 0)
+		n += snprintf(line + n, sizeof(line) - n,
+			      ",\"destination_port\":%d,\"source_port\":%d",
+			      view.destination_port, view.source_port);
+	if (append(c, line, (size_t)n) < 0)
+		return -1;
+
+	const int text_length = pdu_view_text(&view, text, sizeof(text));
+	if (text_length >= 0) {
+		if (append(c, ",\"content\":", 11) < 0 ||
+		    append_string(c, text, (size_t)text_length) < 0)
+			return -1;
+	} else {
+		// 8-bit data as hex.
+		pdu_hex_encode(pdu + view.user_data, view.user_data_length, text);
+		if (append(c, ",\"data\":\"", 9) < 0 ||
+		    append(c, text, 2 * (size_t)view.user_data_length) < 0 ||
+		    append(c, "\"", 1) < 0)
+			return -1;
+	}
+	return append(c, "}\n", 2);
+}
+
+/* Decode the lines from start to end into the chunk's output. */
+static void decode_chunk(struct chunk* c, const char* start, const char* end)
+{
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+
+	c->output_length = 0;
+	c->messages = 0;
+	c->failed = 0;
+	while (start < end) {
+		const char* eol = memchr(start, '\n', (size_t)(end - start));
+		if (!eol)
+			eol = end;
+		const char* line = start;
+		size_t length = (size_t)(eol - line);
+		start = eol + 1;
+		while (length > 0 && (line[length - 1] == '\r' ||
+				      line[length - 1] == ' ' ||
+				      line[length - 1] == '\t'))
+			length--;
+		if (length == 0)
+			continue;
+
+		c->messages++;
+		const size_t mark = c->output_length;
+		const int pdu_length = pdu_hex_decode(line, length, pdu,
+						      sizeof(pdu));
+		if (pdu_length > 0 &&
+		    (decode_status_report(c, pdu, pdu_length) == 0 ||
+		     decode_deliver(c, pdu, pdu_length) == 0))
+			continue;
+
+		c->output_length = mark;
+		c->failed++;
+		append(c, "{\"error\":\"error decoding pdu\",\"pdu\":", 36);
+		append_string(c, line, length);
+		append(c, "}\n", 2);
+	}
+}
+
+/*
+ * Take chunks of whole lines in turn and decode them. Whichever thread
+ * finds the oldest chunk done writes it out, so the output stays in input
+ * order and at most window chunks are held in memory.
+ */
+static void* batch_worker(void* arg)
+{
+	struct batch* b = arg;
+
+	pthread_mutex_lock(&b->lock);
+	for (;;) {
+		while (b->offset < b->length &&
+		       b->next >= b->written + b->window)
+			pthread_cond_wait(&b->cond, &b->lock);
+		if (b->offset >= b->length)
+			break;
+
+		const size_t start = b->offset;
+		size_t end = start + CHUNK_SIZE;
+		if (end >= b->length) {
+			end = b->length;
+		} else {
+			const char* eol = memchr(b->data + end, '\n',
+						 b->length - end);
+			end = eol ? (size_t)(eol - b->data) + 1 : b->length;
+		}
+		struct chunk* c = &b->chunks[b->next % b->window];
+		b->offset = end;
+		b->next++;
+		pthread_mutex_unlock(&b->lock);
+
+		decode_chunk(c, b->data + start, b->data + end);
+
+		pthread_mutex_lock(&b->lock);
+		c->done = 1;
+		while (!b->writing && b->written < b->next &&
+		       b->chunks[b->written % b->window].done) {
+			struct chunk* w = &b->chunks[b->written % b->window];
+			b->writing = 1;
+			pthread_mutex_unlock(&b->lock);
+			const int error = fwrite(w->output, 1, w->output_length,
+						 stdout) != w->output_length;
+			pthread_mutex_lock(&b->lock);
+			b->write_error |= error;
+			b->messages += w->messages;
+			b->failed += w->failed;
+			w->done = 0;
+			b->written++;
+			b->writing = 0;
+			pthread_cond_broadcast(&b->cond);
+		}
+	}
+	pthread_mutex_unlock(&b->lock);
+	return NULL;
+}
+
+static int decode_file(const char* path, int threads)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "open(%s): %s\n", path, strerror(errno));
+		return 1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "stat(%s): %s\n", path, strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	struct batch b;
+	memset(&b, 0, sizeof(b));
+	b.length = (size_t)st.st_size;
+	if (b.length > 0) {
+		void* data = mmap(NULL, b.length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "mmap(%s): %s\n", path, strerror(errno));
+			close(fd);
+			return 1;
+		}
+		madvise(data, b.length, MADV_SEQUENTIAL);
+		b.data = data;
+	}
+	close(fd);
+
+	b.window = threads * CHUNKS_PER_THREAD;
+	b.chunks = calloc((size_t)b.window, sizeof(*b.chunks));
+	pthread_t* workers = calloc((size_t)threads, sizeof(*workers));
+	if (!b.chunks || !workers) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.cond, NULL);
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int started = 0;
+	for (; started < threads; ++started) {
+		if (pthread_create(&workers[started], NULL, batch_worker, &b) != 0)
+			break;
+	}
+	/* Work in this thread as well if no thread could be started. */
+	if (started == 0)
+		batch_worker(&b);
+	for (int i = 0; i < started; ++i)
+		pthread_join(workers[i], NULL);
+	if (fflush(stdout) != 0)
+		b.write_error = 1;
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	const double seconds = (stop.tv_sec - start.tv_sec) +
+			       (stop.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "%ld messages, %ld failed, %.3f s, %.0f messages/s\n",
+		b.messages, b.failed, seconds,
+		seconds > 0 ? b.messages / seconds : 0.0);
+
+	for (int i = 0; i < b.window; ++i)
+		free(b.chunks[i].output);
+	free(b.chunks);
+	free(workers);
+	if (b.length > 0)
+		munmap((void*)b.data, b.length);
+	if (b.write_error) {
+		fprintf(stderr, "error writing output\n");
+		return 1;
+	}
+	return b.failed > 0;
+}
+
+int main(int argc, char* argv[])
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus > 0 ? (int)cpus : 1;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "t:")) != -1) {
+		switch (ch) {
+		case 't':
+			threads = atoi(optarg);
+			if (threads < 1 || threads > 256)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argv += optind; argc -= optind;
+
+	if (argc > 0)
+		return decode_file(argv[0], threads);
+	return sms_decode();
+}
@@ -0,0 +1,494 @@
+/*
+ * SMS PDU Encoder
+ *
+ * Encodes NDJSON messages, one {"id":1,"number":"+48...","text":"..."}
+ * object per line, into ready to send PDUs. Every part is written as
+ * "id<TAB>part/total<TAB>hex PDU", the input of sms_tool sendpdu.
+ */
+#include "pdu.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct message {
+	char* line;
+	int line_number;
+	long id;
+	char* number;
+	char* text;
+	int reference;
+	int failed;
+};
+
+struct worker {
+	pthread_t thread;
+	struct message* messages;
+	int count;
+	int flags;
+	char* output;
+	size_t output_length;
+	size_t output_size;
+	unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	int pdu_lengths[SMS_MAX_PARTS];
+	unsigned char scratch[SMS_ENCODE_SCRATCH_SIZE];
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: pdu_encoder [options] [file]\n"
+		"options:\n"
+		"\t-l use 16-bit concatenation references\n"
+		"\t-m choose GSM-7 or UCS-2 for each part\n"
+		"\t-r request status reports\n"
+		"\t-t <threads> (default: number of CPUs)\n"
+		);
+	exit(2);
+}
+
+static char* skip_space(char* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r')
+		p++;
+	return p;
+}
+
+static int parse_u16(const char* p)
+{
+	unsigned char octets[2];
+
+	if (strnlen(p, 4) < 4 || pdu_hex_decode(p, 4, octets, 2) != 2)
+		return -1;
+	return (octets[0] << 8) | octets[1];
+}
+
+/*
+ * Unescape the JSON string starting after the opening quote in place.
+ * Returns the position after the closing quote or NULL.
+ */
+static char* parse_string(char* p)
+{
+	char* out = p;
+
+	while (*p != '"') {
+		if (*p == '\0' || (unsigned char)*p < 0x20)
+			return NULL;
+		if (*p != '\\') {
+			*out++ = *p++;
+			continue;
+		}
+		p++;
+		switch (*p++) {
+		case '"': *out++ = '"'; break;
+		case '\\': *out++ = '\\'; break;
+		case '/': *out++ = '/'; break;
+		case 'b': *out++ = '\b'; break;
+		case 'f': *out++ = '\f'; break;
+		case 'n': *out++ = '\n'; break;
+		case 'r': *out++ = '\r'; break;
+		case 't': *out++ = '\t'; break;
+		case 'u':
+		{
+			int codepoint = parse_u16(p);
+			if (codepoint < 0)
+				return NULL;
+			p += 4;
+			if (codepoint >= 0xD800 && codepoint < 0xDC00 &&
+			    p[0] == '\\' && p[1] == 'u') {
+				int low = parse_u16(p + 2);
+				if (low >= 0xDC00 && low < 0xE000) {
+					codepoint = 0x10000 +
+						((codepoint - 0xD800) << 10) +
+						(low - 0xDC00);
+					p += 6;
+				}
+			}
+			if (codepoint == 0)
+				return NULL;
+			if (codepoint < 0x80) {
+				*out++ = codepoint;
+			} else if (codepoint < 0x800) {
+				*out++ = 0xC0 | (codepoint >> 6);
+				*out++ = 0x80 | (codepoint & 0x3F);
+			} else if (codepoint < 0x10000) {
+				*out++ = 0xE0 | (codepoint >> 12);
+				*out++ = 0x80 | ((codepoint >> 6) & 0x3F);
+				*out++ = 0x80 | (codepoint & 0x3F);
+			} else {
+				*out++ = 0xF0 | (codepoint >> 18);
+				*out++ = 0x80 | ((codepoint >> 12) & 0x3F);
+				*out++ = 0x80 | ((codepoint >> 6) & 0x3F);
+				*out++ = 0x80 | (codepoint & 0x3F);
+			}
+			break;
+		}
+		default:
+			return NULL;
+		}
+	}
+	*out = '\0';
+	return p + 1;
+}
+
+/* Parse a flat JSON object with "id", "number" and "text" members. */
+static int parse_message(struct message* m)
+{
+	char* p = skip_space(m->line);
+
+	m->id = m->line_number;
+	m->number = NULL;
+	m->text = NULL;
+	if (*p++ != '{')
+		return -1;
+	p = skip_space(p);
+	if (*p == '}')
+		return -1;
+	for (;;) {
+		if (*p++ != '"')
+			return -1;
+		char* key = p;
+		p = parse_string(p);
+		if (!p)
+			return -1;
+		p = skip_space(p);
+		if (*p++ != ':')
+			return -1;
+		p = skip_space(p);
+
+		if (*p == '"') {
+			char* value = p + 1;
+			p = parse_string(value);
+			if (!p)
+				return -1;
+			if (!strcmp(key, "number"))
+				m->number = value;
+			else if (!strcmp(key, "text"))
+				m->text = value;
+			else if (!strcmp(key, "id"))
+				m->id = strtol(value, NULL, 10);
+		} else {
+			char* end;
+			long value = strtol(p, &end, 10);
+			if (end == p) {
+				/* true, false or null */
+				while (*end >= 'a' && *end <= 'z')
+					end++;
+				if (end == p)
+					return -1;
+			} else if (!strcmp(key, "id")) {
+				m->id = value;
+			}
+			p = end;
+		}
+
+		p = skip_space(p);
+		if (*p == '}')
+			break;
+		if (*p++ != ',')
+			return -1;
+		p = skip_space(p);
+	}
+	return m->number && m->text ? 0 : -1;
+}
+
+static int append(struct worker* w, const char* data, size_t length)
+{
+	if (w->output_length + length > w->output_size) {
+		size_t size = w->output_size ? w->output_size : 65536;
+		while (size < w->output_length + length)
+			size *= 2;
+		char* output = realloc(w->output, size);
+		if (!output)
+			return -1;
+		w->output = output;
+		w->output_size = size;
+	}
+	memcpy(w->output + w->output_length, data, length);
+	w->output_length += length;
+	return 0;
+}
+
+static int encode_message(struct worker* w, struct message* m)
+{
+	char line[2 * SMS_MAX_PDU_LENGTH + 64];
+	const int total_parts = pdu_encode_parts_scratch("", m->number, m->text,
+							 m->reference, w->flags,
+							 w->pdus, w->pdu_lengths,
+							 SMS_MAX_PARTS, w->scratch,
+							 sizeof(w->scratch));
+	if (total_parts < 0)
+		return -1;
+
+	for (int i = 0; i < total_parts; ++i) {
+		int n = snprintf(line, sizeof(line), "%ld\t%d/%d\t", m->id,
+				 i + 1, total_parts);
+		pdu_hex_encode(w->pdus[i], w->pdu_lengths[i], line + n);
+		n += 2 * w->pdu_lengths[i];
+		line[n++] = '\n';
+		if (append(w, line, (size_t)n) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void* parse_worker(void* arg)
+{
+	struct worker* w = arg;
+
+	for (int i = 0; i < w->count; ++i)
+		w->messages[i].failed = parse_message(&w->messages[i]) < 0;
+	return NULL;
+}
+
+static void* encode_worker(void* arg)
+{
+	struct worker* w = arg;
+
+	for (int i = 0; i < w->count; ++i) {
+		struct message* m = &w->messages[i];
+		const size_t mark = w->output_length;
+		if (!m->failed && encode_message(w, m) < 0) {
+			m->failed = 1;
+			w->output_length = mark;
+		}
+	}
+	return NULL;
+}
+
+static int run_workers(struct worker* workers, int threads,
+		       void* (*fn)(void*))
+{
+	int started = 0;
+
+	for (; started < threads; ++started) {
+		if (pthread_create(&workers[started].thread, NULL, fn,
+				   &workers[started]) != 0)
+			break;
+	}
+	/* Run whatever could not be started in this thread. */
+	for (int i = started; i < threads; ++i)
+		fn(&workers[i]);
+	for (int i = 0; i < started; ++i)
+		pthread_join(workers[i].thread, NULL);
+	return 0;
+}
+
+/*
+ * Per recipient reference counters, kept for the whole input so that
+ * references do not repeat for the same recipient within it. Each counter
+ * starts at a random point per run.
+ */
+struct references {
+	struct reference_slot {
+		char* number;
+		unsigned int next;
+	}* slot;
+	size_t size;
+	size_t used;
+	unsigned int seed;
+};
+
+static struct reference_slot* find_reference(struct references* r,
+					     const char* number,
+					     unsigned int hash)
+{
+	size_t i = hash & (r->size - 1);
+	while (r->slot[i].number && strcmp(r->slot[i].number, number))
+		i = (i + 1) & (r->size - 1);
+	return &r->slot[i];
+}
+
+static int grow_references(struct references* r)
+{
+	struct references grown = *r;
+	grown.size = r->size ? r->size * 2 : 1024;
+	grown.slot = calloc(grown.size, sizeof(*grown.slot));
+	if (!grown.slot)
+		return -1;
+	for (size_t i = 0; i < r->size; ++i) {
+		if (r->slot[i].number)
+			*find_reference(&grown, r->slot[i].number,
+					pdu_number_hash(r->slot[i].number)) = r->slot[i];
+	}
+	free(r->slot);
+	*r = grown;
+	return 0;
+}
+
+static int assign_references(struct references* r, struct message* messages,
+			     int count)
+{
+	for (int i = 0; i < count; ++i) {
+		struct message* m = &messages[i];
+		if (m->failed)
+			continue;
+		if ((r->used + 1) * 2 > r->size && grow_references(r) < 0)
+			return -1;
+		const char* number = m->number + (m->number[0] == '+');
+		const unsigned int hash = pdu_number_hash(number);
+		struct reference_slot* slot = find_reference(r, number, hash);
+		if (!slot->number) {
+			slot->number = strdup(number);
+			if (!slot->number)
+				return -1;
+			slot->next = (hash ^ r->seed) * 2654435761u >> 16;
+			r->used++;
+		}
+		m->reference = slot->next++ & 0xFFFF;
+	}
+	return 0;
+}
+
+/* Messages read, parsed and encoded at a time. */
+enum { BATCH_LINES = 16384 };
+
+struct input {
+	FILE* file;
+	char* line;
+	size_t line_size;
+	int line_number;
+	char* data;		/* the lines of the batch */
+	size_t size;
+	size_t offsets[BATCH_LINES];
+};
+
+/*
+ * Read up to BATCH_LINES non-empty lines. Returns the number of messages
+ * read, 0 at the end of the input or -1.
+ */
+static int read_batch(struct input* in, struct message* messages)
+{
+	size_t length = 0;
+	int count = 0;
+
+	while (count < BATCH_LINES) {
+		ssize_t n = getline(&in->line, &in->line_size, in->file);
+		if (n < 0)
+			break;
+		in->line_number++;
+		if (n > 0 && in->line[n - 1] == '\n')
+			in->line[--n] = '\0';
+		if (*skip_space(in->line) == '\0')
+			continue;
+		if (length + n + 1 > in->size) {
+			size_t size = in->size ? in->size : 65536;
+			while (size < length + n + 1)
+				size *= 2;
+			char* data = realloc(in->data, size);
+			if (!data)
+				return -1;
+			in->data = data;
+			in->size = size;
+		}
+		memcpy(in->data + length, in->line, (size_t)n + 1);
+		messages[count].line_number = in->line_number;
+		in->offsets[count++] = length;
+		length += (size_t)n + 1;
+	}
+	if (ferror(in->file))
+		return -1;
+	for (int i = 0; i < count; ++i)
+		messages[i].line = in->data + in->offsets[i];
+	return count;
+}
+
+int main(int argc, char* argv[])
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus > 0 ? (int)cpus : 1;
+	int flags = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "lmrt:")) != -1) {
+		switch (ch) {
+		case 'l': flags |= PDU_ENCODE_REF16; break;
+		case 'm': flags |= PDU_ENCODE_MIXED; break;
+		case 'r': flags |= PDU_ENCODE_STATUS_REPORT; break;
+		case 't':
+			threads = atoi(optarg);
+			if (threads < 1 || threads > 256)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argv += optind; argc -= optind;
+
+	FILE* input = stdin;
+	if (argc > 0 && strcmp("-", argv[0])) {
+		input = fopen(argv[0], "r");
+		if (!input) {
+			fprintf(stderr, "open(%s): %s\n", argv[0], strerror(errno));
+			return 1;
+		}
+	}
+
+	static struct input in;
+	in.file = input;
+	struct message* messages = calloc(BATCH_LINES, sizeof(*messages));
+	struct worker* workers = calloc((size_t)threads, sizeof(*workers));
+	struct references references = {
+		.seed = (unsigned int)(time(NULL) ^ getpid()),
+	};
+	if (!messages || !workers) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	int failed = 0;
+	int count;
+	while ((count = read_batch(&in, messages)) > 0) {
+		const int active = threads < count ? threads : count;
+		for (int i = 0, first = 0; i < active; ++i) {
+			int n = count / active + (i < count % active);
+			workers[i].messages = messages + first;
+			workers[i].count = n;
+			workers[i].flags = flags;
+			workers[i].output_length = 0;
+			first += n;
+		}
+
+		run_workers(workers, active, parse_worker);
+		if (assign_references(&references, messages, count) < 0) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		run_workers(workers, active, encode_worker);
+
+		for (int i = 0; i < count; ++i) {
+			if (messages[i].failed) {
+				fprintf(stderr, "line %d: cannot encode message\n",
+					messages[i].line_number);
+				failed = 1;
+			}
+		}
+		for (int i = 0; i < active; ++i) {
+			if (fwrite(workers[i].output, 1, workers[i].output_length,
+				   stdout) != workers[i].output_length) {
+				fprintf(stderr, "error writing output\n");
+				return 1;
+			}
+		}
+	}
+	if (count < 0) {
+		fprintf(stderr, "error reading input\n");
+		return 1;
+	}
+
+	for (int i = 0; i < threads; ++i)
+		free(workers[i].output);
+	for (size_t i = 0; i < references.size; ++i)
+		free(references.slot[i].number);
+	free(references.slot);
+	free(workers);
+	free(messages);
+	free(in.data);
+	free(in.line);
+	return failed;
+}
@@ -4,6 +4,45 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* pdu.c built with PDU_SCALAR_ONLY, see the Makefile. */
+int pdu_encode_parts_scratch_scalar(const char* service_center_number,
+				    const char* phone_number, const char* text,
+				    int reference_number, int flags,
+				    unsigned char (*pdus)[SMS_MAX_PDU_LENGTH],
+				    int* pdu_lengths, int max_parts,
+				    unsigned char* scratch, int scratch_size);
+size_t ucs2be_to_utf8_scalar(const uint8_t* ucs2, size_t ucs2_length,
+			     char* utf8, size_t utf8_size);
+void pdu_hex_encode_scalar(const unsigned char* data, int length, char* hex);
+int pdu_hex_decode_scalar(const char* hex, int hex_length,
+			  unsigned char* output, int output_size);
+
+/* The test is linked with --wrap for the allocator entry points so that
+ * allocation-free code paths can be checked. */
+static int allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	++allocations;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	++allocations;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	++allocations;
+	return __real_realloc(ptr, size);
+}
+
 static int expect_pdu(const char* name, const char* number, const char* text,
 		      const unsigned char* expected, size_t expected_length)
 {
@@ -37,8 +76,8 @@ static int test_ucs2_multipart(void)
 	int total_parts;
 
 	for (int i = 0; i < 71; ++i) {
-		text[2 * i] = (char)0xC2;
-		text[2 * i + 1] = (char)0xA3;
+		text[2 * i] = (char)0xC4;
+		text[2 * i + 1] = (char)0x85;
 	}
 	text[sizeof(text) - 1] = '\0';
 
@@ -52,7 +91,7 @@ static int test_ucs2_multipart(void)
 		failed = 1;
 	}
 	for (int i = 0; i < 67; ++i) {
-		if (pdu[20 + 2 * i] != 0x00 || pdu[21 + 2 * i] != 0xA3) {
+		if (pdu[20 + 2 * i] != 0x01 || pdu[21 + 2 * i] != 0x05) {
 			fprintf(stderr, "invalid UCS-2 payload in first part\n");
 			failed = 1;
 			break;
@@ -63,7 +102,7 @@ static int test_ucs2_multipart(void)
 				      &total_parts, pdu, sizeof(pdu));
 	static const unsigned char second_data[] = {
 		0x05, 0x00, 0x03, 0x42, 0x02, 0x02,
-		0x00, 0xA3, 0x00, 0xA3, 0x00, 0xA3, 0x00, 0xA3,
+		0x01, 0x05, 0x01, 0x05, 0x01, 0x05, 0x01, 0x05,
 	};
 	if (length != 28 || pdu[13] != sizeof(second_data) ||
 	    memcmp(pdu + 14, second_data, sizeof(second_data)) != 0) {
@@ -142,6 +181,965 @@ static int test_gsm7_escape_boundary(void)
 	return 0;
 }
 
+static int test_utf8_to_gsm7(void)
+{
+	static const struct {
+		const char* text;
+		int dcs;
+		int septets;
+		unsigned char first[4];
+	} cases[] = {
+		{ "café", 0x00, 4, { 'c', 'a', 'f', 0x05 } },
+		{ "Zürich", 0x00, 6, { 'Z', 0x7E, 'r', 'i' } },
+		{ "ΔΦΓΛ", 0x00, 4, { 0x10, 0x12, 0x13, 0x14 } },
+		{ "ΩΠΨΣΘΞ", 0x00, 6, { 0x15, 0x16, 0x17, 0x18 } },
+		{ "5€", 0x00, 3, { '5', 0x1B, 0x65 } },
+		{ "¡¿£¥§ÄÖÑÜäöñüàÇÉ", 0x00, 16, { 0x40, 0x60, 0x01, 0x03 } },
+		{ "łódź", 0x08, 8, { 0 } },
+		{ "日本", 0x08, 4, { 0 } },
+	};
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char long_text[160 * 2 + 1];
+	int failed = 0;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		const int length = pdu_encode("", "+1234567890", cases[i].text,
+					      pdu, sizeof(pdu));
+		int ok = length > 14 && pdu[11] == cases[i].dcs &&
+			pdu[13] == cases[i].septets;
+		for (int j = 0; ok && cases[i].dcs == 0 && j < 4 &&
+		     j < cases[i].septets; ++j) {
+			const int bit = j * 7;
+			unsigned int value = pdu[14 + bit / 8] >> (bit % 8);
+			if (bit % 8 > 1)
+				value |= pdu[15 + bit / 8] << (8 - bit % 8);
+			ok = (value & 0x7F) == cases[i].first[j];
+		}
+		if (!ok) {
+			fprintf(stderr, "UTF-8 text \"%s\" was not encoded as expected\n",
+				cases[i].text);
+			failed = 1;
+		}
+	}
+
+	/* 160 accented characters still fit a single GSM-7 message. */
+	for (int i = 0; i < 160; ++i) {
+		long_text[2 * i] = (char)0xC3;
+		long_text[2 * i + 1] = (char)0xA9;
+	}
+	long_text[sizeof(long_text) - 1] = '\0';
+	if (pdu_encode("", "+1234567890", long_text, pdu, sizeof(pdu)) < 0) {
+		fprintf(stderr, "160 accented characters did not fit one part\n");
+		failed = 1;
+	}
+	if (pdu_encode("", "+1234567890", "caf\xC3", pdu, sizeof(pdu)) >= 0) {
+		fprintf(stderr, "invalid UTF-8 was accepted\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+/* Turn an encoded SMS-SUBMIT for "+1234567890" into an SMS-DELIVER. */
+static int submit_to_deliver(const unsigned char* submit, int length,
+			     unsigned char* deliver)
+{
+	static const unsigned char timestamp[] = {
+		0x42, 0x80, 0x51, 0x21, 0x43, 0x65, 0x00,
+	};
+	int n = 0;
+
+	deliver[n++] = 0x00;
+	deliver[n++] = (submit[1] & 0x40) | 0x04;
+	memcpy(deliver + n, submit + 3, 7);
+	n += 7;
+	deliver[n++] = submit[10];
+	deliver[n++] = submit[11];
+	memcpy(deliver + n, timestamp, sizeof(timestamp));
+	n += sizeof(timestamp);
+	memcpy(deliver + n, submit + 13, length - 13);
+	return n + length - 13;
+}
+
+static int decode_text(const unsigned char* submit, int length, char* text,
+		       int text_size, int* total_parts, int* part_number)
+{
+	unsigned char deliver[SMS_MAX_PDU_LENGTH + 8];
+	char sender[32];
+	time_t time;
+	int dcs, reference, skip;
+
+	const int text_length = pdu_decode(deliver,
+					   submit_to_deliver(submit, length, deliver),
+					   &time, sender, sizeof(sender), text,
+					   text_size, &dcs, &reference,
+					   total_parts, part_number, &skip);
+	if (text_length < 0 || dcs != 0)
+		return -1;
+	return text_length;
+}
+
+static int has_ie(const unsigned char* pdu, int id, int value)
+{
+	if (!(pdu[1] & 0x40))
+		return 0;
+	for (int i = 15; i + 2 <= 15 + pdu[14]; i += 2 + pdu[i + 1]) {
+		if (pdu[i] == id && pdu[i + 2] == value)
+			return 1;
+	}
+	return 0;
+}
+
+static int test_national_language_tables(void)
+{
+	static const char* texts[] = {
+		"Şişli'de ığdır, İzmir'de çağ",
+		"¿Ácido? Sí, Ústed está aquí",
+		"São João, coração e ação",
+		"नमस्ते दुनिया, १२३!",
+		"வணக்கம் உலகம்",
+		"سلام دنیا۔",
+		"Hello World नमस्ते",  /* capitals only in the single shift */
+	};
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char text[3 * SMS_MAX_PDU_LENGTH];
+	char turkish[400 * 2 + 1];
+	int total_parts, part_number;
+	int failed = 0;
+
+	for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+		const int length = pdu_encode("", "+1234567890", texts[i], pdu,
+					      sizeof(pdu));
+		if (length < 0 || pdu[11] != 0x00 || !(pdu[1] & 0x40) ||
+		    decode_text(pdu, length, text, sizeof(text), &total_parts,
+				&part_number) < 0 || strcmp(text, texts[i]) != 0) {
+			fprintf(stderr, "national language text \"%s\" did not round trip\n",
+				texts[i]);
+			failed = 1;
+		}
+	}
+
+	/* 150 Turkish letters fit one part with the locking shift table. */
+	for (int i = 0; i < 150; ++i) {
+		turkish[2 * i] = (char)0xC5;
+		turkish[2 * i + 1] = (char)0x9F;
+	}
+	turkish[300] = '\0';
+	int length = pdu_encode_multipart("", "+1234567890", turkish, 0x21, 1,
+					  &total_parts, pdu, sizeof(pdu));
+	if (length < 0 || total_parts != 1 || pdu[11] != 0x00 ||
+	    !has_ie(pdu, 0x25, 0x01)) {
+		fprintf(stderr, "Turkish locking shift was not used\n");
+		failed = 1;
+	}
+
+	length = pdu_encode("", "+1234567890", texts[3], pdu, sizeof(pdu));
+	if (length < 0 || !has_ie(pdu, 0x25, 0x06) || !has_ie(pdu, 0x24, 0x06)) {
+		fprintf(stderr, "Hindi shift tables were not used\n");
+		failed = 1;
+	}
+
+	/* The shift IEs come before the concatenation IE in every part. */
+	for (int i = 0; i < 400; ++i) {
+		turkish[2 * i] = (char)0xC4;
+		turkish[2 * i + 1] = (char)0xB1;
+	}
+	turkish[sizeof(turkish) - 1] = '\0';
+	length = pdu_encode_multipart("", "+1234567890", turkish, 0x21, 2,
+				      &total_parts, pdu, sizeof(pdu));
+	if (length < 0 || total_parts != 3 || !has_ie(pdu, 0x25, 0x01) ||
+	    pdu[15 + pdu[14] - 5] != 0x00 ||
+	    decode_text(pdu, length, text, sizeof(text), &total_parts,
+			&part_number) != 149 * 2 ||
+	    total_parts != 3 || part_number != 2 ||
+	    memcmp(text, turkish, 149 * 2) != 0) {
+		fprintf(stderr, "multipart Turkish message is invalid\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_mixed_encoding(void)
+{
+	static unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static int lengths[SMS_MAX_PARTS];
+	static char corpora[4][2048];
+	/* Expected parts: whole-message encoding, then per-part encoding. */
+	static const int expected[4][2] = { { 5, 3 }, { 6, 4 }, { 2, 2 }, { 5, 3 } };
+	char text[3 * SMS_MAX_PDU_LENGTH];
+	int total_parts, part_number;
+	int failed = 0;
+
+	/* A long ASCII message signed with a CJK name. */
+	memset(corpora[0], 'a', 300);
+	strcpy(corpora[0] + 300, " 日本語");
+	/* Paragraphs alternating between Cyrillic and Latin script. */
+	for (int i = 0; i < 4; ++i) {
+		strcat(corpora[1], i % 2 ? "Привет, как дела? Всё хорошо, спасибо. "
+			"Увидимся завтра в офисе. " :
+			"Hello, this is a longer English paragraph that explains "
+			"the plan for tomorrow's meeting in the office at ten. ");
+	}
+	/* Mostly CJK with a short Latin phrase: nothing to gain. */
+	for (int i = 0; i < 60; ++i)
+		strcat(corpora[2], "東京");
+	strcat(corpora[2], " ok");
+	/* Escapes next to the GSM-7 part boundary. */
+	memset(corpora[3], 'b', 152);
+	strcpy(corpora[3] + 152, "{}[]");
+	memset(corpora[3] + 156, 'c', 150);
+	strcpy(corpora[3] + 306, "ĳ");
+
+	for (int t = 0; t < 4; ++t) {
+		const int uniform = pdu_encode_parts("", "+1234567890", corpora[t],
+						     7, 0, NULL, NULL, 0);
+		const int mixed = pdu_encode_parts("", "+1234567890", corpora[t],
+						   7, PDU_ENCODE_MIXED, pdus,
+						   lengths, SMS_MAX_PARTS);
+		if (uniform != expected[t][0] || mixed != expected[t][1]) {
+			fprintf(stderr, "corpus %d: unexpected part counts\n", t);
+			failed = 1;
+		}
+	}
+
+	/* Parts of the first corpus: GSM-7, GSM-7, then UCS-2. */
+	pdu_encode_parts("", "+1234567890", corpora[0], 7, PDU_ENCODE_MIXED,
+			 pdus, lengths, SMS_MAX_PARTS);
+	if (pdus[0][11] != 0x00 || pdus[1][11] != 0x00 || pdus[2][11] != 0x08 ||
+	    decode_text(pdus[1], lengths[1], text, sizeof(text), &total_parts,
+			&part_number) != 148 || total_parts != 3 ||
+	    part_number != 2 || memcmp(text, corpora[0] + 153, 148) != 0 ||
+	    pdus[2][13] != 6 + 6 || memcmp(pdus[2] + 20, "\x65\xE5", 2) != 0) {
+		fprintf(stderr, "mixed parts carry the wrong encoding\n");
+		failed = 1;
+	}
+
+	/* An escape pair that does not fit is moved to the next part. */
+	pdu_encode_parts("", "+1234567890", corpora[3], 7, PDU_ENCODE_MIXED,
+			 pdus, lengths, SMS_MAX_PARTS);
+	if (pdus[0][13] != 7 + 152 || pdus[1][11] != 0x00 ||
+	    decode_text(pdus[1], lengths[1], text, sizeof(text), &total_parts,
+			&part_number) < 4 || memcmp(text, "{}[]", 4) != 0) {
+		fprintf(stderr, "mixed parts split an escape pair\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_ref16_multipart(void)
+{
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char text[162];
+	int failed = 0;
+	int total_parts;
+
+	memset(text, 'A', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	int length = pdu_encode_multipart_ex("", "+1234567890", text, 0x1234,
+					     PDU_ENCODE_REF16, 1, &total_parts,
+					     pdu, sizeof(pdu));
+	static const unsigned char header[] = {
+		0x06, 0x08, 0x04, 0x12, 0x34, 0x02, 0x01,
+	};
+	if (length != 154 || total_parts != 2 || pdu[13] != 160 ||
+	    memcmp(pdu + 14, header, sizeof(header)) != 0) {
+		fprintf(stderr, "invalid first 16-bit reference GSM-7 PDU\n");
+		failed = 1;
+	}
+	/* Eight header septets leave the first text septet at bit 56. */
+	if ((pdu[21] & 0x7F) != 'A') {
+		fprintf(stderr, "invalid 16-bit reference GSM-7 fill bits\n");
+		failed = 1;
+	}
+
+	char ucs2[71 * 2 + 1];
+	for (int i = 0; i < 71; ++i) {
+		ucs2[2 * i] = (char)0xC4;
+		ucs2[2 * i + 1] = (char)0x85;
+	}
+	ucs2[sizeof(ucs2) - 1] = '\0';
+	length = pdu_encode_multipart_ex("", "+1234567890", ucs2, 0xBEEF,
+					 PDU_ENCODE_REF16, 2, &total_parts,
+					 pdu, sizeof(pdu));
+	if (length != 31 || total_parts != 2 || pdu[13] != 17 ||
+	    pdu[17] != 0xBE || pdu[18] != 0xEF || pdu[21] != 0x01 ||
+	    pdu[22] != 0x05) {
+		fprintf(stderr, "invalid second 16-bit reference UCS-2 PDU\n");
+		failed = 1;
+	}
+
+	/* The decoded text starts after the user data header. */
+	unsigned char deliver[SMS_MAX_PDU_LENGTH + 8];
+	char sender[32];
+	time_t time;
+	int dcs, reference, part_number, skip;
+	length = pdu_decode(deliver, submit_to_deliver(pdu, length, deliver),
+			    &time, sender, sizeof(sender), text, sizeof(text),
+			    &dcs, &reference, &total_parts, &part_number, &skip);
+	if (length != 10 || dcs != 0x08 || reference != 0xBEEF ||
+	    part_number != 2 || skip != 7 || text[0] != 0x01 ||
+	    text[1] != 0x05) {
+		fprintf(stderr, "invalid decoded 16-bit reference UCS-2 part\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_status_report(void)
+{
+	static const unsigned char report[] = {
+		0x00, 0x06, 0x2A, 0x0B, 0x91, 0x84, 0x06, 0x00, 0x00, 0x00,
+		0xF1, 0x42, 0x80, 0x51, 0x21, 0x43, 0x65, 0x00, 0x42, 0x80,
+		0x51, 0x21, 0x44, 0x05, 0x00, 0x00,
+	};
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char recipient[40];
+	time_t discharge_time;
+	int message_reference;
+	int status;
+	int total_parts;
+	int failed = 0;
+
+	if (pdu_decode_status_report(report, sizeof(report), &message_reference,
+				     recipient, sizeof(recipient),
+				     &discharge_time, &status) < 0 ||
+	    message_reference != 0x2A || strcmp(recipient, "48600000001") ||
+	    status != 0 || discharge_time != 1723725890) {
+		fprintf(stderr, "invalid status report decoding\n");
+		failed = 1;
+	}
+	if (pdu_decode_status_report(report, sizeof(report) - 1,
+				     &message_reference, recipient,
+				     sizeof(recipient), &discharge_time,
+				     &status) >= 0) {
+		fprintf(stderr, "truncated status report was accepted\n");
+		failed = 1;
+	}
+
+	if (pdu_encode_multipart_ex("", "+1234567890", "hello", 0,
+				    PDU_ENCODE_STATUS_REPORT, 1, &total_parts,
+				    pdu, sizeof(pdu)) < 0 || pdu[1] != 0x31) {
+		fprintf(stderr, "status report request not encoded\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_encode_parts(void)
+{
+	static unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static int lengths[SMS_MAX_PARTS];
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char gsm7[1001];
+	char ucs2[301 * 2 + 1];
+	const char* texts[] = { "hello", gsm7, ucs2 };
+	int failed = 0;
+
+	for (int i = 0; i < 1000; ++i)
+		gsm7[i] = i % 7 == 0 ? '{' : 'a' + i % 26;
+	gsm7[1000] = '\0';
+	for (int i = 0; i < 301; ++i) {
+		ucs2[2 * i] = (char)0xC4;
+		ucs2[2 * i + 1] = (char)0x85;
+	}
+	ucs2[sizeof(ucs2) - 1] = '\0';
+
+	for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); ++t) {
+		for (int flags = 0; flags <= PDU_ENCODE_REF16; flags += PDU_ENCODE_REF16) {
+			int total = pdu_encode_parts("", "+1234567890", texts[t],
+						     0x1234, flags, pdus,
+						     lengths, SMS_MAX_PARTS);
+			if (total < 1 || pdu_encode_parts("", "+1234567890", texts[t],
+						0x1234, flags, NULL, NULL, 0) != total) {
+				fprintf(stderr, "pdu_encode_parts failed for text %zu\n", t);
+				failed = 1;
+				continue;
+			}
+			for (int part = 1; part <= total; ++part) {
+				int total_parts;
+				int length = pdu_encode_multipart_ex("", "+1234567890",
+						texts[t], 0x1234, flags, part,
+						&total_parts, pdu, sizeof(pdu));
+				if (length != lengths[part - 1] || total_parts != total ||
+				    memcmp(pdu, pdus[part - 1], length) != 0) {
+					fprintf(stderr, "part %d/%d of text %zu differs\n",
+						part, total, t);
+					failed = 1;
+				}
+			}
+			/* Encoded with reference 0, then given its reference. */
+			for (int part = 1; total > 1 && part <= total; ++part) {
+				int total_parts;
+				int length = pdu_encode_multipart_ex("", "+1234567890",
+						texts[t], 0, flags, part,
+						&total_parts, pdu, sizeof(pdu));
+				if (pdu_set_reference(pdu, length, 0x1234) < 0 ||
+				    memcmp(pdu, pdus[part - 1], length) != 0) {
+					fprintf(stderr, "reference of part %d/%d of text %zu not set\n",
+						part, total, t);
+					failed = 1;
+				}
+			}
+			if (pdu_encode_parts("", "+1234567890", "hello", 0, flags,
+					     pdus, lengths, 1) != 1 ||
+			    pdu_set_reference(pdus[0], lengths[0], 0x1234) >= 0) {
+				fprintf(stderr, "reference set without a header\n");
+				failed = 1;
+			}
+			if (total > 1 && pdu_encode_parts("", "+1234567890", texts[t],
+						0x1234, flags, pdus, lengths,
+						total - 1) >= 0) {
+				fprintf(stderr, "too small part array was accepted\n");
+				failed = 1;
+			}
+		}
+	}
+	return failed;
+}
+
+static int test_encode_parts_scratch(void)
+{
+	static unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static unsigned char expected[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static unsigned char scratch[SMS_ENCODE_SCRATCH_SIZE];
+	static char long_text[153 * 255 + 1];
+	static int lengths[SMS_MAX_PARTS];
+	static int expected_lengths[SMS_MAX_PARTS];
+	const char* texts[] = { "hello", "Дима, пишет тебе NL678",
+				"{[~]}|\\^€", long_text };
+	int failed = 0;
+
+	memset(long_text, 'A', sizeof(long_text) - 1);
+	for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); ++t) {
+		const int total = pdu_encode_parts("", "+1234567890", texts[t],
+						   0x1234, PDU_ENCODE_REF16,
+						   expected, expected_lengths,
+						   SMS_MAX_PARTS);
+		const int before = allocations;
+		for (int round = 0; round < 100; ++round) {
+			if (pdu_encode_parts_scratch("", "+1234567890", texts[t],
+						     0x1234, PDU_ENCODE_REF16,
+						     pdus, lengths, SMS_MAX_PARTS,
+						     scratch, sizeof(scratch)) != total)
+				failed = 1;
+		}
+		if (allocations != before) {
+			fprintf(stderr, "scratch encoder allocated memory\n");
+			failed = 1;
+		}
+		for (int i = 0; i < total; ++i) {
+			if (lengths[i] != expected_lengths[i] ||
+			    memcmp(pdus[i], expected[i], lengths[i]) != 0)
+				failed = 1;
+		}
+		if (failed) {
+			fprintf(stderr, "scratch encoding of text %zu differs\n", t);
+			return failed;
+		}
+	}
+
+	if (pdu_encode_parts_scratch("", "+1234567890", "hello world", 0, 0,
+				     pdus, lengths, SMS_MAX_PARTS,
+				     scratch, 5) >= 0) {
+		fprintf(stderr, "too small scratch buffer was accepted\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+/* Random texts must encode identically with and without the SIMD paths. */
+static int test_simd_transcoder(void)
+{
+	static const char* pieces[] = {
+		"a", "Z", "0", " ", "?", "\n", "\r", "\t", "$", "@", "_", "`",
+		"{", "}", "[", "]", "~", "\\", "^", "|", "\x7F", "é", "Ü", "£",
+		"Δ", "€", "ş", "ł", "日", "\xC3", "\xE2\x82",
+	};
+	static unsigned char pdus[2][SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static unsigned char scratch[2][SMS_ENCODE_SCRATCH_SIZE];
+	static int lengths[2][SMS_MAX_PARTS];
+	static char text[4096];
+	const int piece_count = sizeof(pieces) / sizeof(pieces[0]);
+	unsigned int seed = 12345;
+	int failed = 0;
+
+	for (int round = 0; round < 3000 && !failed; ++round) {
+		size_t length = 0;
+		seed = seed * 1103515245 + 12345;
+		const int target = (seed >> 16) % 700;
+		/* Mostly long ASCII runs, so that blocks and tails are hit. */
+		const int ascii_weight = 80 + (round % 20);
+		while ((int)length < target) {
+			seed = seed * 1103515245 + 12345;
+			const char* piece = (int)((seed >> 16) % 100) < ascii_weight ?
+				pieces[(seed >> 8) % 5] :
+				pieces[(seed >> 8) % piece_count];
+			if (round % 7 == 0 && strlen(piece) > 1)
+				piece = "x";
+			if (round % 11 == 0 && piece[0] & 0x80)
+				piece = "y";
+			memcpy(text + length, piece, strlen(piece));
+			length += strlen(piece);
+		}
+		text[length] = '\0';
+
+		for (int flags = 0; flags <= PDU_ENCODE_MIXED; flags += PDU_ENCODE_MIXED) {
+			/* Small scratch sizes check the overflow behaviour too. */
+			const int scratch_size = round % 5 == 0 ?
+				(int)(seed >> 20) % 300 : SMS_ENCODE_SCRATCH_SIZE;
+			const int expected = pdu_encode_parts_scratch_scalar("",
+					"+1234567890", text, 3, flags, pdus[0],
+					lengths[0], SMS_MAX_PARTS, scratch[0],
+					scratch_size);
+			const int actual = pdu_encode_parts_scratch("",
+					"+1234567890", text, 3, flags, pdus[1],
+					lengths[1], SMS_MAX_PARTS, scratch[1],
+					scratch_size);
+			if (actual != expected)
+				failed = 1;
+			for (int i = 0; !failed && i < actual; ++i) {
+				if (lengths[0][i] != lengths[1][i] ||
+				    memcmp(pdus[0][i], pdus[1][i], lengths[0][i]) != 0)
+					failed = 1;
+			}
+			if (failed)
+				fprintf(stderr, "SIMD transcoder differs for \"%s\"\n",
+					text);
+		}
+	}
+	return failed;
+}
+
+static int test_ucs2_to_utf8(void)
+{
+	/* A, é, €, 😀 as a surrogate pair, a lone high surrogate, then Z. */
+	static const uint8_t ucs2[] = {
+		0x00, 0x41, 0x00, 0xE9, 0x20, 0xAC, 0xD8, 0x3D, 0xDE, 0x00,
+		0xD8, 0x3D, 0x00, 0x5A, 0x01,
+	};
+	static const char expected[] = "A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80"
+		"\xEF\xBF\xBDZ";
+	/* Units picked so that runs of each length class start everywhere. */
+	static const unsigned int units[] = {
+		0x0041, 0x0020, 0x007F, 0x0000, 0x00E9, 0x0416, 0x07FF, 0x0080,
+		0x4E2D, 0x20AC, 0xD83D, 0xDE00, 0xDC00, 0xFFFF,
+	};
+	static uint8_t input[2 * 300 + 1];
+	static char utf8[2][4 * 300 + 1];
+	char text[32];
+	unsigned int seed = 99;
+
+	if (ucs2be_to_utf8(ucs2, sizeof(ucs2), text, sizeof(text)) !=
+	    strlen(expected) || strcmp(text, expected) != 0 ||
+	    ucs2be_to_utf8(ucs2, sizeof(ucs2), text, 9) != 6 ||
+	    strcmp(text, "A\xC3\xA9\xE2\x82\xAC") != 0) {
+		fprintf(stderr, "UCS-2 to UTF-8 failed\n");
+		return 1;
+	}
+
+	for (int round = 0; round < 3000; ++round) {
+		seed = seed * 1103515245 + 12345;
+		const size_t count = (seed >> 16) % 300;
+		const int mostly = (seed >> 8) % 3;
+		for (size_t i = 0; i < count; ++i) {
+			seed = seed * 1103515245 + 12345;
+			/* Long runs of one class, sometimes broken by another. */
+			unsigned int u = (seed >> 16) % 16 ?
+				units[mostly * 4 + (seed >> 8) % 4] :
+				units[(seed >> 8) % (sizeof(units) / sizeof(units[0]))];
+			if (mostly == 0 && u >= 0x80)
+				u = 'a';
+			input[2 * i] = u >> 8;
+			input[2 * i + 1] = u;
+		}
+		const size_t size = round % 4 == 0 ? (seed >> 20) % 200 + 1 :
+			sizeof(utf8[0]);
+		const size_t expected_length = ucs2be_to_utf8_scalar(input,
+				2 * count + round % 2, utf8[0], size);
+		const size_t length = ucs2be_to_utf8(input, 2 * count + round % 2,
+						     utf8[1], size);
+		if (length != expected_length ||
+		    memcmp(utf8[0], utf8[1], length + 1) != 0) {
+			fprintf(stderr, "SIMD UCS-2 to UTF-8 differs in round %d\n",
+				round);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Pack every length with every fill offset and unpack it again. A header
+ * of 7 - fill octets leaves exactly fill bits before the next septet
+ * boundary, as a user data header does.
+ */
+static int test_pack_septets(void)
+{
+	unsigned char septets[160];
+	unsigned char packed[8 + 140];
+	char unpacked[8 + 160];
+	unsigned int seed = 7;
+
+	for (int length = 0; length <= 160; ++length) {
+		for (int fill = 0; fill <= 6; ++fill) {
+			const int header = fill ? 7 - fill : 0;
+			const int header_septets = (header * 8 + fill) / 7;
+			for (int i = 0; i < length; ++i) {
+				seed = seed * 1103515245 + 12345;
+				septets[i] = (seed >> 16) & 0x7F;
+			}
+			memset(packed, 0xA5, sizeof(packed));
+			const int octets = pdu_pack_septets(septets, length, fill,
+							    packed + header,
+							    sizeof(packed) - header);
+			if (octets != (fill + length * 7 + 7) / 8 ||
+			    (length && (packed[header] & ((1 << fill) - 1)))) {
+				fprintf(stderr, "packing %d septets with fill %d failed\n",
+					length, fill);
+				return 1;
+			}
+			if (length == 0)
+				continue;
+			const int count = DecodePDUMessage_GSM_7bit(packed,
+					header + octets, unpacked,
+					header_septets + length);
+			if (count != header_septets + length ||
+			    memcmp(unpacked + header_septets, septets, length) != 0) {
+				fprintf(stderr, "%d septets with fill %d do not round trip\n",
+					length, fill);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int test_unpack_septets(void)
+{
+	unsigned char septets[160];
+	unsigned char packed[141];
+	unsigned char unpacked[160 + 1];
+	unsigned int seed = 11;
+
+	for (int length = 0; length <= 160; ++length) {
+		for (int fill = 0; fill <= 6; ++fill) {
+			for (int i = 0; i < length; ++i) {
+				seed = seed * 1103515245 + 12345;
+				septets[i] = (seed >> 16) & 0x7F;
+			}
+			const int octets = pdu_pack_septets(septets, length, fill,
+							    packed, sizeof(packed));
+			memset(unpacked, 0xA5, sizeof(unpacked));
+			const int count = pdu_unpack_septets(packed, octets, fill,
+							     unpacked, length);
+			if (count != length ||
+			    memcmp(unpacked, septets, length) != 0 ||
+			    unpacked[length] != 0xA5) {
+				fprintf(stderr, "unpacking %d septets with fill %d failed\n",
+					length, fill);
+				return 1;
+			}
+			// A short input yields only the septets it holds.
+			const int short_count = pdu_unpack_septets(packed, octets / 2,
+								   fill, unpacked, length);
+			int expected = (octets / 2 * 8 - fill) / 7;
+			if (expected < 0)
+				expected = 0;
+			if (short_count != (expected < length ? expected : length)) {
+				fprintf(stderr, "%d septets from %d octets with fill %d\n",
+					short_count, octets / 2, fill);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int test_decode_gsm7(void)
+{
+	/* An escape across the first 8 septet block, then '@' (septet 0). */
+	static const unsigned char septets[] = {
+		'a', 'b', 'c', 'd', 'e', 'f', 'g', 0x1B, 0x65, 0x00, 0x1B,
+	};
+	unsigned char packed[16];
+	char text[16];
+
+	for (int fill = 0; fill <= 6; ++fill) {
+		const int octets = pdu_pack_septets(septets, sizeof(septets), fill,
+						    packed, sizeof(packed));
+		if (pdu_decode_gsm7(packed, octets, fill, sizeof(septets), text,
+				    sizeof(text)) != 11 ||
+		    strcmp(text, "abcdefg\xE2\x82\xAC@") != 0) {
+			fprintf(stderr, "GSM-7 to UTF-8 with fill %d failed\n", fill);
+			return 1;
+		}
+	}
+	/* Characters that do not fit are dropped whole. */
+	if (pdu_decode_gsm7(packed, sizeof(packed), 6, sizeof(septets), text,
+			    10) != 7 || strcmp(text, "abcdefg") != 0 ||
+	    pdu_decode_gsm7(packed, 2, 0, 3, text, sizeof(text)) != -1) {
+		fprintf(stderr, "bounded GSM-7 to UTF-8 failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int test_hex(void)
+{
+	static const char invalid[] = "/:@G`g \x80\xC6\xFF";
+	unsigned char data[100];
+	unsigned char decoded[100];
+	unsigned char scalar_decoded[100];
+	char hex[2 * 100 + 1];
+	char scalar_hex[2 * 100 + 1];
+
+	for (int i = 0; i < (int)sizeof(data); ++i)
+		data[i] = i * 73 + 5;
+	for (int length = 0; length <= (int)sizeof(data); ++length) {
+		pdu_hex_encode(data, length, hex);
+		pdu_hex_encode_scalar(data, length, scalar_hex);
+		if (strcmp(hex, scalar_hex) != 0 ||
+		    (int)strlen(hex) != 2 * length ||
+		    pdu_hex_decode(hex, 2 * length, decoded,
+				   sizeof(decoded)) != length ||
+		    memcmp(decoded, data, length) != 0) {
+			fprintf(stderr, "hex round trip of %d octets failed\n",
+				length);
+			return 1;
+		}
+	}
+	/* Lower case is accepted; hex holds 200 digits from above. */
+	for (int i = 0; i < 200; ++i)
+		hex[i] = hex[i] >= 'A' ? hex[i] | 0x20 : hex[i];
+	if (pdu_hex_decode(hex, 200, decoded, sizeof(decoded)) != 100 ||
+	    memcmp(decoded, data, 100) != 0 ||
+	    pdu_hex_decode(hex, 199, decoded, sizeof(decoded)) != -1 ||
+	    pdu_hex_decode(hex, 200, decoded, 99) != -1) {
+		fprintf(stderr, "hex decoding of lower case or bounds failed\n");
+		return 1;
+	}
+	/* Any other character anywhere is rejected, by both versions. */
+	for (size_t c = 0; c < sizeof(invalid) - 1; ++c) {
+		for (int i = 0; i < 200; ++i) {
+			const char saved = hex[i];
+			hex[i] = invalid[c];
+			if (pdu_hex_decode(hex, 200, decoded,
+					   sizeof(decoded)) != -1 ||
+			    pdu_hex_decode_scalar(hex, 200, scalar_decoded,
+						  sizeof(scalar_decoded)) != -1) {
+				fprintf(stderr, "hex 0x%02X at %d was accepted\n",
+					(unsigned char)invalid[c], i);
+				return 1;
+			}
+			hex[i] = saved;
+		}
+	}
+	return 0;
+}
+
+static int test_pdu_view(void)
+{
+	unsigned char submit[SMS_MAX_PDU_LENGTH];
+	unsigned char deliver[SMS_MAX_PDU_LENGTH + 8];
+	struct sms_pdu_view view;
+	char text[200];
+	char sender[32];
+	int total_parts;
+	int tz_minutes;
+	int failed = 0;
+
+	memset(text, 'A', 199);
+	text[199] = '\0';
+	int length = pdu_encode_multipart("", "+1234567890", text, 0x66, 2,
+					  &total_parts, submit, sizeof(submit));
+	length = submit_to_deliver(submit, length, deliver);
+	deliver[17] = 0x4A;  /* UTC-6:00 */
+	if (pdu_view_parse(&view, deliver, length) < 0 ||
+	    view.total_parts != 2 || view.part_number != 2 ||
+	    view.ref_number != 0x66 || view.udh_length != 6 ||
+	    view.fill_bits != 1 || view.text_length != 46 ||
+	    pdu_view_sender(&view, sender, sizeof(sender)) != 10 ||
+	    strcmp(sender, "1234567890") != 0 ||
+	    pdu_view_time(&view, &tz_minutes) != 1723725296 ||
+	    tz_minutes != -360 ||
+	    pdu_view_text(&view, text, sizeof(text)) != 46 ||
+	    strspn(text, "A") != 46) {
+		fprintf(stderr, "deliver view does not match\n");
+		failed = 1;
+	}
+
+	/* Nothing is read past the end of a truncated PDU. */
+	for (int i = 0; i < length; ++i) {
+		if (pdu_view_parse(&view, deliver, i) >= 0) {
+			fprintf(stderr, "PDU truncated to %d octets was accepted\n", i);
+			failed = 1;
+			break;
+		}
+	}
+	deliver[18] = 0xFF;  /* UDL past the end */
+	if (pdu_view_parse(&view, deliver, length) >= 0) {
+		fprintf(stderr, "user data past the end was accepted\n");
+		failed = 1;
+	}
+	deliver[18] = 7;  /* 7 septets, 7 octets of UDH */
+	deliver[19] = 6;
+	if (pdu_view_parse(&view, deliver, length) >= 0) {
+		fprintf(stderr, "header longer than the user data was accepted\n");
+		failed = 1;
+	}
+
+	/* A sent message listed from storage shows its recipient. */
+	length = pdu_encode("", "+1234567890", "Hi {x}", submit, sizeof(submit));
+	if (pdu_view_parse(&view, submit, length) < 0 || view.scts != -1 ||
+	    pdu_view_sender(&view, sender, sizeof(sender)) != 10 ||
+	    strcmp(sender, "1234567890") != 0 ||
+	    pdu_view_time(&view, &tz_minutes) != 0 || tz_minutes != 0 ||
+	    pdu_view_text(&view, text, sizeof(text)) != 6 ||
+	    strcmp(text, "Hi {x}") != 0) {
+		fprintf(stderr, "SMS-SUBMIT view does not match\n");
+		failed = 1;
+	}
+	for (int i = 0; i < length; ++i) {
+		if (pdu_view_parse(&view, submit, i) >= 0) {
+			fprintf(stderr, "submit truncated to %d octets was accepted\n", i);
+			failed = 1;
+			break;
+		}
+	}
+
+	length = pdu_encode("", "+1234567890", "Дима", submit, sizeof(submit));
+	length = submit_to_deliver(submit, length, deliver);
+	if (pdu_view_parse(&view, deliver, length) < 0 ||
+	    view.alphabet != SMS_ALPHABET_UCS2 || view.udh != -1 ||
+	    pdu_view_text(&view, text, sizeof(text)) != 8 ||
+	    strcmp(text, "Дима") != 0) {
+		fprintf(stderr, "UCS-2 view text does not match\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+static int test_udh_iterator(void)
+{
+	static const unsigned char header[] = {
+		0x00, 0x44, 0x0B, 0x91, 0x21, 0x43, 0x65, 0x87, 0x09, 0xF1,
+		0x00, 0x00, 0x42, 0x80, 0x51, 0x21, 0x43, 0x65, 0x00, 24,
+		18,
+		0x08, 0x04, 0x12, 0x34, 0x03, 0x02,	/* 16-bit concatenation */
+		0x05, 0x04, 0x0B, 0x84, 0x23, 0xF0,	/* ports 2948, 9200 */
+		0x25, 0x01, 0x01,			/* Turkish locking shift */
+		0x70, 0x01, 0x00,			/* unknown */
+	};
+	static const unsigned char septets[] = { 0x0C, 0x69 };  /* "ği" */
+	static const int ids[] = { 0x08, 0x05, 0x25, 0x70 };
+	unsigned char deliver[64];
+	struct sms_pdu_view view;
+	struct sms_udh_iterator it;
+	struct sms_udh_ie ie;
+	char text[16];
+	int count = 0;
+	int failed = 0;
+
+	memcpy(deliver, header, sizeof(header));
+	const int length = sizeof(header) +
+		pdu_pack_septets(septets, sizeof(septets), 2,
+				 deliver + sizeof(header),
+				 sizeof(deliver) - sizeof(header));
+	if (pdu_view_parse(&view, deliver, length) < 0) {
+		fprintf(stderr, "deliver with several IEs was rejected\n");
+		return 1;
+	}
+	pdu_udh_begin(&it, &view);
+	while (pdu_udh_next(&it, &ie)) {
+		if (count >= 4 || ie.id != ids[count] || ie.data[-1] != ie.length)
+			break;
+		++count;
+	}
+	if (count != 4 || view.ref_number != 0x1234 || view.total_parts != 3 ||
+	    view.part_number != 2 || view.destination_port != 2948 ||
+	    view.source_port != 9200 || view.locking_shift != 1 ||
+	    view.fill_bits != 2 || view.text_length != 2 ||
+	    pdu_view_text(&view, text, sizeof(text)) != 3 ||
+	    strcmp(text, "\xC4\x9Fi") != 0) {
+		fprintf(stderr, "UDH information elements not parsed\n");
+		failed = 1;
+	}
+
+	/* An element running past the header ends the walk. */
+	deliver[sizeof(header) - 2] = 2;
+	pdu_view_parse(&view, deliver, length);
+	count = 0;
+	for (pdu_udh_begin(&it, &view); pdu_udh_next(&it, &ie); )
+		++count;
+	if (count != 3 || view.locking_shift != 1) {
+		fprintf(stderr, "UDH element past the header was read\n");
+		failed = 1;
+	}
+	return failed;
+}
+
+/* Decode a generated corpus with pdu_decoder in batch mode, checking that
+ * every line comes out in input order. */
+static int test_decoder_batch(void)
+{
+	enum { CORPUS_MESSAGES = 200000 };
+	unsigned char submit[SMS_MAX_PDU_LENGTH];
+	unsigned char deliver[SMS_MAX_PDU_LENGTH + 8];
+	char text[64];
+	char line[512];
+	int failed = 0;
+
+	FILE* corpus = fopen("pdu_test_corpus.hex", "w");
+	if (!corpus)
+		return 1;
+	for (int i = 0; i < CORPUS_MESSAGES; ++i) {
+		if (i % 1000 == 999) {
+			fputs("not a pdu\n", corpus);
+			continue;
+		}
+		snprintf(text, sizeof(text), i % 3 ? "message %d" :
+			 "сообщение %d", i);
+		int length = pdu_encode("", "+1234567890", text, submit,
+					sizeof(submit));
+		length = submit_to_deliver(submit, length, deliver);
+		for (int j = 0; j < length; ++j)
+			fprintf(corpus, "%02X", deliver[j]);
+		fputs(i % 2 ? "\r\n" : "\n", corpus);
+	}
+	fclose(corpus);
+
+	const int status = system("./pdu_decoder -t 4 pdu_test_corpus.hex "
+				  "> pdu_test_corpus.ndjson 2> /dev/null");
+	FILE* output = fopen("pdu_test_corpus.ndjson", "r");
+	if (status == -1 || !output) {
+		fprintf(stderr, "pdu_decoder batch mode did not run\n");
+		return 1;
+	}
+	int count = 0;
+	for (; fgets(line, sizeof(line), output); ++count) {
+		if (count % 1000 == 999) {
+			snprintf(text, sizeof(text), "\"error\"");
+		} else {
+			snprintf(text, sizeof(text), count % 3 ?
+				 "\"content\":\"message %d\"}" :
+				 "\"content\":\"сообщение %d\"}", count);
+		}
+		if (!strstr(line, text)) {
+			fprintf(stderr, "batch output line %d: %s", count + 1, line);
+			failed = 1;
+			break;
+		}
+	}
+	if (!failed && count != CORPUS_MESSAGES) {
+		fprintf(stderr, "batch output has %d of %d lines\n", count,
+			CORPUS_MESSAGES);
+		failed = 1;
+	}
+	fclose(output);
+	remove("pdu_test_corpus.hex");
+	remove("pdu_test_corpus.ndjson");
+	return failed;
+}
+
 static int test_part_count_limit(void)
 {
 	const size_t max_length = 153 * 255;
@@ -197,6 +1195,22 @@ int main(void)
 	failed |= test_ucs2_multipart();
 	failed |= test_gsm7_multipart();
 	failed |= test_gsm7_escape_boundary();
+	failed |= test_utf8_to_gsm7();
+	failed |= test_national_language_tables();
+	failed |= test_mixed_encoding();
+	failed |= test_ref16_multipart();
+	failed |= test_status_report();
+	failed |= test_encode_parts();
+	failed |= test_encode_parts_scratch();
+	failed |= test_simd_transcoder();
+	failed |= test_ucs2_to_utf8();
+	failed |= test_pack_septets();
+	failed |= test_unpack_septets();
+	failed |= test_decode_gsm7();
+	failed |= test_hex();
+	failed |= test_pdu_view();
+	failed |= test_udh_iterator();
+	failed |= test_decoder_batch();
 	failed |= test_part_count_limit();
 
 	if (pdu_encode("", "+12x34", "test", pdu, sizeof(pdu)) >= 0) {
@@ -209,8 +1223,8 @@ int main(void)
 		failed = 1;
 	}
 	for (int i = 0; i < 71; ++i) {
-		long_ucs2[2 * i] = (char)0xC2;
-		long_ucs2[2 * i + 1] = (char)0xA3;
+		long_ucs2[2 * i] = (char)0xC4;
+		long_ucs2[2 * i + 1] = (char)0x85;
 	}
 	long_ucs2[sizeof(long_ucs2) - 1] = '\0';
 	if (pdu_encode("", "+1234", long_ucs2, pdu, sizeof(pdu)) >= 0) {
@@ -14,8 +14,13 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <strings.h>
 #include <termios.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "pdu_lib/pdu.h"
 
@@ -23,22 +28,36 @@ static void usage()
 {
 	fprintf(stderr,
 		"usage: [options] send phoneNumber message\n"
+		"       [options] batch [file]\n"
+		"       [options] sendpdu [file]\n"
 		"       [options] recv\n"
-		"       [options] delete msg_index | all\n"
+		"       [options] listen\n"
+		"       [options] delete msg_index | range first last | read | all\n"
 		"       [options] status\n"
 		"       [options] ussd code\n"
 		"       [options] at command\n"
 		"options:\n"
+		"\t-A <seconds> request delivery reports and wait for them (for send/batch/sendpdu)\n"
 		"\t-b <baudrate> (default: 115200)\n"
 		"\t-c coding scheme (for ussd, 0 - 7BIT, 2 - UCS2, default: detect)\n"
+		"\t-C <milliseconds>[,<parts>] merge messages to the same recipient (for batch, default parts: 3)\n"
 		"\t-d <tty device> (default: /dev/ttyUSB0)\n"
-		"\t-D debug (for ussd and at)\n"
+		"\t-D debug (for send, batch, sendpdu, ussd and at)\n"
 		"\t-f <date/time format> (for sms/recv)\n"
 		"\t-j json output (for sms/recv)\n"
+		"\t-l use 16-bit concatenation references (for send/batch)\n"
+		"\t-m choose GSM-7 or UCS-2 for each part of a long message (for send/batch)\n"
+		"\t-M <seconds> merge the parts of long messages, keeping incomplete ones up to <seconds> (for recv/listen)\n"
+		"\t-n print only messages not printed before (for recv/listen)\n"
 		"\t-R use raw input (for ussd)\n"
-		"\t-r use raw output (for ussd and sms/recv)\n"
-		"\t-s <preferred storage> (for sms/recv/status)\n"
+		"\t-r use raw output (for ussd, sms/recv and listen)\n"
+		"\t-s <preferred storage> (for sms/recv/listen/delete/status)\n"
+		"\t-S <state directory> (default: /var/run/sms_tool)\n"
+		"\t-T route new messages to the TE as +CMT, acknowledged once written (for listen)\n"
+		"\t-t <milliseconds> minimum interval between sent PDUs (for send/batch/sendpdu)\n"
 		"\t-w <milliseconds> keep reading after OK (for asynchronous at replies)\n"
+		"\t-x delete merged messages from storage (for recv/listen -M)\n"
+		"\t--consume delete messages from storage once they are printed (for recv/listen)\n"
 		);
 	exit(2);
 }
@@ -48,6 +67,10 @@ static int port = -1;
 static const char* dev = "/dev/ttyUSB0";
 static const char* storage = "";
 static const char* dateformat = "%D %T";
+static const char* statedir = "/var/run/sms_tool";
+static FILE* pf = NULL;
+static FILE* pfi = NULL;
+static int encode_flags = 0;
 
 static void setserial(int baudrate)
 {
@@ -132,17 +155,6 @@ static int starts_with(const char* prefix, const char* str)
 	return 1;
 }
 
-static int char_to_hex(char c)
-{
-	if (isdigit(c))
-		return c - '0';
-	if (islower(c))
-		return 10 + c - 'a';
-	if (isupper(c))
-		return 10 + c - 'A';
-	return -1;
-}
-
 /*
  * Return 1 for a complete response, 0 when more input is needed and -1 for
  * malformed input. Some modems split +CUSD after the comma, so parse the
@@ -179,93 +191,2153 @@ static int parse_cusd_response(const char *response, char *payload,
 	if (*p++ != '"')
 		return -1;
 
-	const char *payload_start = p;
-	const char *payload_end = strchr(payload_start, '"');
-	if (payload_end == NULL)
-		return 0;
-	if ((size_t)(payload_end - payload_start) >= payload_size)
+	const char *payload_start = p;
+	const char *payload_end = strchr(payload_start, '"');
+	if (payload_end == NULL)
+		return 0;
+	if ((size_t)(payload_end - payload_start) >= payload_size)
+		return -1;
+	memcpy(payload, payload_start, (size_t)(payload_end - payload_start));
+	payload[payload_end - payload_start] = '\0';
+
+	p = payload_end + 1;
+	while (isspace((unsigned char)*p))
+		p++;
+	if (*p != ',')
+		return *p == '\0' ? 0 : -1;
+	p++;
+	while (isspace((unsigned char)*p))
+		p++;
+	errno = 0;
+	long value = strtol(p, &end, 10);
+	if (end == p)
+		return *p == '\0' ? 0 : -1;
+	if (errno == ERANGE || value < 0 || value > 255)
+		return -1;
+	*dcs = (int)value;
+	return 1;
+}
+
+static int looks_like_ucs2(const unsigned char *data, size_t length)
+{
+	size_t printable = 0;
+	size_t zero_high = 0;
+	size_t characters;
+
+	if (length < 4 || (length & 1) != 0)
+		return 0;
+	characters = length / 2;
+	for (size_t i = 0; i < length; i += 2) {
+		unsigned int codepoint = ((unsigned int)data[i] << 8) | data[i + 1];
+		if (codepoint >= 0xd800 && codepoint <= 0xdfff)
+			return 0;
+		if (data[i] == 0)
+			zero_high++;
+		if (codepoint == '\n' || codepoint == '\r' || codepoint == '\t' ||
+				(codepoint >= 0x20 && codepoint != 0x7f))
+			printable++;
+	}
+
+	/* Keep auto-detection conservative to avoid mistaking packed GSM-7. */
+	return zero_high * 4 >= characters * 3 &&
+		printable * 10 >= characters * 9;
+}
+
+static void print_json_escape_char(char c1, char c2)
+{
+	if (c1 == 0x0) {
+		if(c2 == '"') printf("\\\"");
+		else if(c2 == '\\') printf("\\\\");
+		else if(c2 == '\b') printf("\\b");
+		else if(c2 == '\n') printf("\\n");
+		else if(c2 == '\f') printf("\\f");
+		else if(c2 == '\r') printf("\\r");
+		else if(c2 == '\t') printf("\\t");
+		else if(c2 == '/') printf("\\/");
+		else if(c2 < ' ') printf("\\u00%02x", (unsigned char)c2);
+		else if(c2 > '~') printf("\\u00%02x", (unsigned char)c2);
+		else printf("%c", c2);
+	} else {
+		printf("\\u%02x%02x", (unsigned char)c1, (unsigned char)c2);
+	}
+}
+
+/*
+ * +CMS ERROR codes (3GPP TS 24.011, TS 27.005) grouped by how the sender
+ * should react: back off and retry, retry after a pause, or give up.
+ */
+enum cms_class {
+	CMS_PERMANENT = 0,
+	CMS_TRANSIENT,
+	CMS_CONGESTION,
+};
+
+static enum cms_class classify_cms_error(int code)
+{
+	switch (code) {
+	case 38:	/* network out of order */
+	case 41:	/* temporary failure */
+	case 42:	/* congestion */
+	case 47:	/* resources unavailable */
+	case 500:	/* unknown error, reported by many modems when throttled */
+	case 512:	/* vendor specific, MO SMS rejected while busy */
+		return CMS_CONGESTION;
+	case 314:	/* SIM busy */
+	case 331:	/* no network service */
+	case 332:	/* network timeout */
+		return CMS_TRANSIENT;
+	case -1:	/* plain ERROR or no +CMGS: the SMSC may have the message */
+	default:
+		return CMS_PERMANENT;
+	}
+}
+
+enum {
+	RATE_MAX_CODES = 16,
+	RATE_MAX_RETRIES = 5,
+	RATE_STEP_MS = 250,
+	RATE_BACKOFF_MIN_MS = 1000,
+	RATE_BACKOFF_MAX_MS = 60000,
+	RATE_TRANSIENT_PAUSE_MS = 2000,
+};
+
+/*
+ * AIMD send pacing: the pause between two submissions shrinks by a fixed
+ * step after every accepted PDU and doubles on congestion errors.
+ */
+static struct {
+	int interval_ms;
+	int min_interval_ms;
+	int backoff;
+	int started;
+	struct timespec last_send;
+	unsigned long sent;
+	unsigned long failed;
+	unsigned long retries;
+	int codes;
+	struct {
+		int code;
+		unsigned long count;
+	} code_count[RATE_MAX_CODES];
+} rate;
+
+static long elapsed_ms(const struct timespec* since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000 +
+		(now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void sleep_ms(long ms)
+{
+	struct timespec ts = {
+		.tv_sec = ms / 1000,
+		.tv_nsec = (ms % 1000) * 1000000,
+	};
+
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static void rate_wait(void)
+{
+	if (rate.started) {
+		long remaining = rate.interval_ms - elapsed_ms(&rate.last_send);
+		if (remaining > 0)
+			sleep_ms(remaining);
+	}
+	rate.started = 1;
+	clock_gettime(CLOCK_MONOTONIC, &rate.last_send);
+}
+
+static void rate_update(int result)
+{
+	if (result == 0) {
+		rate.sent++;
+		rate.backoff = 0;
+		rate.interval_ms -= RATE_STEP_MS;
+		if (rate.interval_ms < rate.min_interval_ms)
+			rate.interval_ms = rate.min_interval_ms;
+		return;
+	}
+
+	int i;
+	for (i = 0; i < rate.codes && rate.code_count[i].code != result; ++i)
+		;
+	if (i < RATE_MAX_CODES) {
+		if (i == rate.codes)
+			rate.code_count[rate.codes++].code = result;
+		rate.code_count[i].count++;
+	}
+
+	if (classify_cms_error(result) == CMS_CONGESTION) {
+		rate.backoff++;
+		rate.interval_ms *= 2;
+		if (rate.interval_ms < RATE_BACKOFF_MIN_MS)
+			rate.interval_ms = RATE_BACKOFF_MIN_MS;
+		if (rate.interval_ms > RATE_BACKOFF_MAX_MS)
+			rate.interval_ms = RATE_BACKOFF_MAX_MS;
+	}
+}
+
+static void rate_report(void)
+{
+	fprintf(stderr, "sent: %lu, failed: %lu, retries: %lu, interval: %d ms",
+		rate.sent, rate.failed, rate.retries, rate.interval_ms);
+	if (rate.interval_ms > 0)
+		fprintf(stderr, " (%.1f msg/min)", 60000.0 / rate.interval_ms);
+	fprintf(stderr, ", backoff: %d\n", rate.backoff);
+	for (int i = 0; i < rate.codes; ++i) {
+		if (rate.code_count[i].code < 0)
+			fprintf(stderr, "ERROR: %lu\n", rate.code_count[i].count);
+		else
+			fprintf(stderr, "+CMS ERROR %d: %lu\n",
+				rate.code_count[i].code, rate.code_count[i].count);
+	}
+}
+
+/* Defined with the delivery report tracking below. */
+static int handle_urc(const char* line);
+
+static int set_pdu_mode(void)
+{
+	char buf[1024];
+
+	alarm(30);
+	if (fputs("AT+CMGF=0\r\n", pf) == EOF)
+		return -1;
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if(starts_with("OK", buf)) {
+			alarm(0);
+			return 0;
+		}
+		if(starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			fprintf(stderr, "failed to enable PDU mode: %s", buf);
+			return -1;
+		}
+	}
+	fprintf(stderr, "no response while enabling PDU mode\n");
+	return -1;
+}
+
+/* Read and delete messages in the preferred storage given with -s. */
+static void select_storage(void)
+{
+	char buf[1024];
+
+	if (strlen(storage) == 0)
+		return;
+	fputs("AT+CPMS=\"", pf);
+	fputs(storage, pf);
+	fputs("\"\r\n", pf);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if(starts_with("OK", buf))
+			break;
+	}
+}
+
+/* The memory listen reads, "" when the modem did not tell. */
+static char listen_mem[3];
+
+/*
+ * Make new messages land where listen reads them: CNMI mt=1 stores them in
+ * mem3 of AT+CPMS, while AT+CMGR reads mem1. With -s all three are set to
+ * it, otherwise mem3 is set to mem1.
+ */
+static int select_listen_storage(void)
+{
+	char buf[1024];
+	char mem1[3], mem2[3], mem3[3];
+	int found = 0;
+
+	if (strlen(storage) > 0) {
+		snprintf(listen_mem, sizeof(listen_mem), "%s", storage);
+		fprintf(pf, "AT+CPMS=\"%s\",\"%s\",\"%s\"\r\n",
+			storage, storage, storage);
+	} else {
+		fputs("AT+CPMS?\r\n", pf);
+		while (fgets(buf, sizeof(buf), pfi)) {
+			if (handle_urc(buf))
+				continue;
+			if (starts_with("+CPMS:", buf))
+				found = sscanf(buf, "+CPMS: \"%2[^\"]\",%*d,%*d,"
+					       "\"%2[^\"]\",%*d,%*d,\"%2[^\"]\"",
+					       mem1, mem2, mem3) == 3;
+			if (starts_with("OK", buf) || starts_with("ERROR", buf) ||
+					starts_with("+CMS ERROR:", buf))
+				break;
+		}
+		if (!found)
+			return 0;
+		memcpy(listen_mem, mem1, sizeof(listen_mem));
+		if (!strcmp(mem1, mem3))
+			return 0;
+		fprintf(pf, "AT+CPMS=\"%s\",\"%s\",\"%s\"\r\n", mem1, mem2, mem1);
+	}
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if (starts_with("OK", buf))
+			return 0;
+		if (starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			fprintf(stderr, "failed to select storage: %s", buf);
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Wait for the "> " prompt that follows AT+CMGS. Returns 0 when the modem is
+ * ready for the PDU, otherwise an error code as for send_pdu().
+ */
+static int wait_prompt(void)
+{
+	char line[256];
+	size_t length = 0;
+	int c;
+
+	while ((c = fgetc(pfi)) != EOF) {
+		if (c == '>' && length == 0)
+			return 0;
+		if (c == '\n') {
+			line[length] = '\0';
+			handle_urc(line);
+			if (starts_with("+CMS ERROR:", line))
+				return atoi(line + 11);
+			if (starts_with("ERROR", line))
+				return -1;
+			length = 0;
+		} else if (c != '\r' && length < sizeof(line) - 1) {
+			line[length++] = (char)c;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Submit one PDU with AT+CMGS. Returns 0 and stores the message reference on
+ * success, the +CMS ERROR code on rejection or -1 on any other failure.
+ */
+static int send_pdu(const unsigned char* pdu, int pdu_len, int* mr)
+{
+	char pdustr[2 * SMS_MAX_PDU_LENGTH + 4];
+	char buf[1024];
+
+	pdu_hex_encode(pdu, pdu_len, pdustr);
+	sprintf(pdustr + 2 * pdu_len, "%c\r\n", 0x1A);
+
+	alarm(30);
+	if (fprintf(pf, "AT+CMGS=%d\r\n", pdu_len - 1 - pdu[0]) < 0)
+		return -1;
+	int rc = wait_prompt();
+	if (rc != 0)
+		return rc;
+	if (fputs(pdustr, pf) == EOF)
+		return -1;
+
+	errno = 0;
+	int cmgs_received = 0;
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if(starts_with("+CMGS:", buf)) {
+			cmgs_received = 1;
+			*mr = atoi(buf + 6);
+		} else if(starts_with("+CMS ERROR:", buf)) {
+			return atoi(buf + 11);
+		} else if(starts_with("ERROR", buf)) {
+			return -1;
+		} else if(starts_with("OK", buf) && cmgs_received) {
+			break;
+		}
+	}
+	if (!cmgs_received) {
+		fprintf(stderr, "reading port: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int open_state_file(const char* name, int flags)
+{
+	char path[4096];
+
+	if (mkdir(statedir, 0700) < 0 && errno != EEXIST)
+		return -1;
+	if (snprintf(path, sizeof(path), "%s/%s", statedir, name) >= (int)sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return open(path, flags | O_CLOEXEC, 0600);
+}
+
+enum { REFERENCE_SLOTS = 4096 };
+
+/*
+ * Allocate a concatenation reference from a counter table in the state
+ * directory, shared by all sms_tool processes. Every recipient hashes to one
+ * 16-bit counter, so consecutive long messages to the same number never
+ * repeat a reference until the counter wraps. Recipients sharing a slot only
+ * make each other skip values. 8-bit references use the low byte.
+ */
+static int allocate_reference(const char* number)
+{
+	const off_t offset = (off_t)(pdu_number_hash(number) % REFERENCE_SLOTS) * 2;
+	unsigned char counter[2];
+	unsigned int reference;
+
+	int fd = open_state_file("references", O_RDWR | O_CREAT);
+	if (fd < 0 || flock(fd, LOCK_EX) < 0) {
+		fprintf(stderr, "reference store in %s unavailable: %s\n",
+			statedir, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return (int)((time(NULL) ^ getpid()) & 0xFFFF);
+	}
+
+	if (pread(fd, counter, sizeof(counter), offset) == sizeof(counter) &&
+			(counter[0] | counter[1]) != 0)
+		reference = ((unsigned int)counter[0] << 8) | counter[1];
+	else
+		reference = (unsigned int)(time(NULL) ^ getpid()) & 0xFFFF;
+
+	/* Zero marks an unused slot. */
+	unsigned int next = (reference + 1) & 0xFFFF;
+	if (next == 0)
+		next = 1;
+	counter[0] = next >> 8;
+	counter[1] = next & 0xFF;
+	if (pwrite(fd, counter, sizeof(counter), offset) != sizeof(counter))
+		fprintf(stderr, "updating reference store: %s\n", strerror(errno));
+	close(fd);
+	return (int)reference;
+}
+
+static void print_ids(FILE* f, const int* ids, int id_count)
+{
+	fprintf(f, "sms ");
+	for (int i = 0; i < id_count; ++i)
+		fprintf(f, i + 1 < id_count ? "%d," : "%d ", ids[i]);
+}
+
+/*
+ * Delivery report correlation. Each submitted part is recorded under its
+ * TP-MR and recipient in an open-addressing table, so that +CDS reports are
+ * matched in constant time. Entries expire after the report wait time, which
+ * keeps message references reused by the modem from matching stale parts.
+ */
+enum { TRACK_SLOTS = 2048 };
+
+struct tracked_message {
+	int* ids;
+	int id_count;
+	int parts;
+	int delivered;
+	int done;
+};
+
+static int report_wait_s = 0;
+
+static struct {
+	struct {
+		time_t expires;		/* 0: never used, in the past: free */
+		unsigned int recipient;
+		int mr;
+		int message;
+	} slot[TRACK_SLOTS];
+	struct tracked_message* messages;
+	int message_count;
+	int pending;
+	int undelivered;
+} track;
+
+static int track_message(const int* ids, int id_count, int parts)
+{
+	struct tracked_message* messages = realloc(track.messages,
+		(size_t)(track.message_count + 1) * sizeof(*messages));
+	if (!messages)
+		return -1;
+	track.messages = messages;
+
+	struct tracked_message* m = &messages[track.message_count];
+	m->ids = NULL;
+	if (id_count > 0) {
+		m->ids = malloc((size_t)id_count * sizeof(*ids));
+		if (!m->ids)
+			return -1;
+		memcpy(m->ids, ids, (size_t)id_count * sizeof(*ids));
+	}
+	m->id_count = id_count;
+	m->parts = parts;
+	m->delivered = 0;
+	m->done = 0;
+	track.pending++;
+	return track.message_count++;
+}
+
+static void track_done(int message, int delivered)
+{
+	struct tracked_message* m = &track.messages[message];
+
+	if (m->done)
+		return;
+	m->done = 1;
+	track.pending--;
+	if (!delivered)
+		track.undelivered++;
+	free(m->ids);
+	m->ids = NULL;
+}
+
+static unsigned int track_hash(unsigned int recipient, int mr)
+{
+	return (recipient * 31u + (unsigned int)mr) % TRACK_SLOTS;
+}
+
+static void track_part(int message, const char* number, int mr)
+{
+	const unsigned int recipient = pdu_number_hash(number);
+	const time_t now = time(NULL);
+	int free_slot = -1;
+	unsigned int i = track_hash(recipient, mr);
+
+	for (int n = 0; n < TRACK_SLOTS; ++n, i = (i + 1) % TRACK_SLOTS) {
+		if (track.slot[i].expires > now &&
+				track.slot[i].recipient == recipient &&
+				track.slot[i].mr == mr) {
+			/* The modem reused the reference; the old part is lost. */
+			free_slot = (int)i;
+			break;
+		}
+		if (track.slot[i].expires <= now && free_slot < 0)
+			free_slot = (int)i;
+		if (track.slot[i].expires == 0)
+			break;
+	}
+	if (free_slot < 0) {
+		fprintf(stderr, "delivery report table full, not tracking reference %d\n", mr);
+		return;
+	}
+	track.slot[free_slot].expires = now + report_wait_s;
+	track.slot[free_slot].recipient = recipient;
+	track.slot[free_slot].mr = mr;
+	track.slot[free_slot].message = message;
+}
+
+static void track_report(const char* hex, int hex_length)
+{
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+	char recipient[40];
+	time_t discharge_time;
+	int mr, status;
+
+	int length = pdu_hex_decode(hex, hex_length, pdu, sizeof(pdu));
+	if (length < 0 || pdu_decode_status_report(pdu, length, &mr,
+			recipient, sizeof(recipient), &discharge_time, &status) < 0) {
+		fprintf(stderr, "unparsable status report: %s\n", hex);
+		return;
+	}
+
+	const unsigned int key = pdu_number_hash(recipient);
+	const time_t now = time(NULL);
+	int found = -1;
+	unsigned int i = track_hash(key, mr);
+	for (int n = 0; n < TRACK_SLOTS && track.slot[i].expires != 0;
+			++n, i = (i + 1) % TRACK_SLOTS) {
+		if (track.slot[i].expires > now && track.slot[i].recipient == key &&
+				track.slot[i].mr == mr) {
+			found = (int)i;
+			break;
+		}
+	}
+	/*
+	 * The SC may report the recipient in another type of number, national
+	 * instead of international or the reverse. The reference alone then
+	 * decides, provided a single part pending a report carries it.
+	 */
+	for (int j = 0; found < 0 && j < TRACK_SLOTS; ++j) {
+		if (track.slot[j].expires <= now || track.slot[j].mr != mr)
+			continue;
+		found = j;
+		for (int k = j + 1; k < TRACK_SLOTS; ++k) {
+			if (track.slot[k].expires > now && track.slot[k].mr == mr)
+				return;
+		}
+	}
+	if (found < 0)
+		return;
+
+	struct tracked_message* m = &track.messages[track.slot[found].message];
+	if (status >= 0x20 && status < 0x40)
+		return;		/* SC still trying */
+	track.slot[found].expires = 1;
+	if (m->done)
+		return;
+	print_ids(stdout, m->ids, m->id_count);
+	if (status >= 0x40) {
+		printf("not delivered, status: %d\n", status);
+		track_done(track.slot[found].message, 0);
+	} else if (++m->delivered == m->parts) {
+		printf("delivered\n");
+		track_done(track.slot[found].message, 1);
+	} else {
+		printf("part delivered (%d/%d)\n", m->delivered, m->parts);
+	}
+	fflush(stdout);
+}
+
+/* Storage slots announced by +CMTI and not read yet. */
+enum { ANNOUNCED_SLOTS = 256 };
+static struct {
+	int index[ANNOUNCED_SLOTS];
+	char mem[ANNOUNCED_SLOTS][3];
+	unsigned int head;
+	unsigned int tail;
+	int overflow;		/* announcements were dropped */
+} announced;
+
+/*
+ * Messages routed to the TE as +CMT (listen -T), waiting to be written out
+ * and acknowledged. The modem sends the next one only after AT+CNMA.
+ */
+enum { DELIVERED_SLOTS = 8 };
+static struct {
+	char hex[DELIVERED_SLOTS][2 * SMS_MAX_PDU_LENGTH + 8];
+	unsigned int head;
+	unsigned int tail;
+} delivered;
+
+/*
+ * Consume an unsolicited result code that may arrive in the middle of other
+ * responses. Returns 1 when line was one.
+ */
+static int handle_urc(const char* line)
+{
+	char buf[2 * SMS_MAX_PDU_LENGTH + 8];
+	char mem[3] = "";
+	int index;
+
+	if (starts_with("+CMTI:", line)) {
+		if (sscanf(line, "+CMTI: \"%2[^\"]\",%d", mem, &index) != 2 &&
+				sscanf(line, "+CMTI: %*[^,],%d", &index) != 1) {
+			fprintf(stderr, "unparsable CMTI indication: %s", line);
+		} else if (announced.tail - announced.head == ANNOUNCED_SLOTS) {
+			announced.overflow = 1;
+		} else {
+			const unsigned int slot = announced.tail++ % ANNOUNCED_SLOTS;
+			announced.index[slot] = index;
+			memcpy(announced.mem[slot], mem, sizeof(mem));
+		}
+		return 1;
+	}
+	if (starts_with("+CMT:", line)) {
+		if (delivered.tail - delivered.head == DELIVERED_SLOTS) {
+			/* Left unacknowledged, so the network sends it again. */
+			fprintf(stderr, "too many unacknowledged messages\n");
+			fgets(buf, sizeof(buf), pfi);
+		} else if (fgets(delivered.hex[delivered.tail % DELIVERED_SLOTS],
+				sizeof(delivered.hex[0]), pfi)) {
+			delivered.tail++;
+		}
+		return 1;
+	}
+	if (!starts_with("+CDS:", line))
+		return 0;
+	if (fgets(buf, sizeof(buf), pfi)) {
+		const int length = strcspn(buf, "\r\n");
+		buf[length] = '\0';
+		track_report(buf, length);
+	}
+	return 1;
+}
+
+static int cnmi_saved = 0;
+static int cnmi[5];
+
+static void restore_cnmi(void)
+{
+	fprintf(pf, "AT+CNMI=%d,%d,%d,%d,%d\r\n",
+		cnmi[0], cnmi[1], cnmi[2], cnmi[3], cnmi[4]);
+}
+
+/*
+ * Set how new messages (mt) and status reports (ds) are indicated to the
+ * TE, -1 keeping the current setting. The settings found by the first call
+ * are restored at exit.
+ */
+static int configure_cnmi(int mt, int ds, const char* what)
+{
+	char buf[1024];
+	int current[5];
+	int known = 0;
+	int rc = -1;
+
+	alarm(10);
+	fputs("AT+CNMI?\r\n", pf);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if(starts_with("+CNMI:", buf))
+			known = sscanf(buf, "+CNMI: %d,%d,%d,%d,%d", &current[0],
+				       &current[1], &current[2], &current[3],
+				       &current[4]) == 5;
+		if(starts_with("OK", buf) || starts_with("ERROR", buf) ||
+				starts_with("+CMS ERROR:", buf))
+			break;
+	}
+	if (mt < 0)
+		mt = known ? current[1] : 0;
+	if (ds < 0)
+		ds = known ? current[3] : 0;
+	fprintf(pf, "AT+CNMI=%d,%d,%d,%d,%d\r\n",
+		known && current[0] != 0 ? current[0] : 2, mt,
+		known ? current[2] : 0, ds, known ? current[4] : 0);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if(starts_with("OK", buf)) {
+			rc = 0;
+			break;
+		}
+		if(starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			fprintf(stderr, "modem cannot %s: %s", what, buf);
+			break;
+		}
+	}
+	alarm(0);
+	if (rc == 0 && known && !cnmi_saved) {
+		memcpy(cnmi, current, sizeof(cnmi));
+		cnmi_saved = 1;
+		atexit(restore_cnmi);
+	}
+	return rc;
+}
+
+static int csms_saved = -1;
+
+static void restore_csms(void)
+{
+	fprintf(pf, "AT+CSMS=%d\r\n", csms_saved);
+}
+
+/*
+ * Select phase 2+ message service (AT+CSMS=1), so that messages routed to
+ * the TE are acknowledged by it with AT+CNMA. The previous service is
+ * restored at exit.
+ */
+static int enable_acknowledgement(void)
+{
+	char buf[1024];
+	int rc = -1;
+
+	alarm(10);
+	fputs("AT+CSMS?\r\n", pf);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if(starts_with("+CSMS:", buf) &&
+				sscanf(buf, "+CSMS: %d", &csms_saved) != 1)
+			csms_saved = -1;
+		if(starts_with("OK", buf) || starts_with("ERROR", buf) ||
+				starts_with("+CMS ERROR:", buf))
+			break;
+	}
+	fputs("AT+CSMS=1\r\n", pf);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if(starts_with("OK", buf)) {
+			rc = 0;
+			break;
+		}
+		if(starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			fprintf(stderr, "modem cannot select phase 2+ service: %s", buf);
+			break;
+		}
+	}
+	alarm(0);
+	if (rc == 0 && csms_saved >= 0 && csms_saved != 1)
+		atexit(restore_csms);
+	return rc;
+}
+
+/* Acknowledge the last +CMT with AT+CNMA. */
+static int acknowledge_message(void)
+{
+	char buf[1024];
+
+	alarm(10);
+	fputs("AT+CNMA\r\n", pf);
+	while(fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if(starts_with("OK", buf)) {
+			alarm(0);
+			return 0;
+		}
+		if(starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			fprintf(stderr, "acknowledging message: %s", buf);
+			break;
+		}
+	}
+	alarm(0);
+	return -1;
+}
+
+/* Route status reports to the TE as +CDS, keeping other CNMI settings. */
+static int enable_status_reports(void)
+{
+	return configure_cnmi(-1, 1, "forward status reports");
+}
+
+/* Process URCs that are already waiting on the serial port. */
+static void poll_urcs(int timeout_ms)
+{
+	char buf[1024];
+	struct pollfd pfd = {
+		.fd = fileno(pfi),
+		.events = POLLIN,
+	};
+
+	while (poll(&pfd, 1, timeout_ms) > 0 && fgets(buf, sizeof(buf), pfi)) {
+		handle_urc(buf);
+		timeout_ms = 0;
+	}
+}
+
+/*
+ * Wait until every tracked message is resolved or the report wait time has
+ * passed. Returns 0 when all messages were delivered.
+ */
+static int wait_reports(void)
+{
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (track.pending > 0) {
+		long remaining = report_wait_s * 1000L - elapsed_ms(&start);
+		if (remaining <= 0)
+			break;
+		poll_urcs((int)remaining);
+	}
+	for (int i = 0; i < track.message_count; ++i) {
+		if (track.messages[i].done)
+			continue;
+		print_ids(stdout, track.messages[i].ids, track.messages[i].id_count);
+		printf("delivery report not received\n");
+		track_done(i, 0);
+	}
+	return track.undelivered > 0;
+}
+
+/*
+ * Submit one encoded part, retrying it according to classify_cms_error().
+ * The result is reported for each of the batch ids the message was built
+ * from. Returns 0 when the part was accepted.
+ */
+static int send_part(const int* ids, int id_count, const char* number,
+		const unsigned char* pdu, int pdu_len, int part_number,
+		int total_parts, int message, int debug)
+{
+	for (int attempt = 0; ; ++attempt) {
+		int mr = -1;
+		rate_wait();
+		int rc = send_pdu(pdu, pdu_len, &mr);
+		alarm(0);
+		rate_update(rc);
+		if (debug == 1)
+			rate_report();
+		if (rc == 0) {
+			print_ids(stdout, ids, id_count);
+			if (total_parts > 1)
+				printf("part %d/%d ", part_number, total_parts);
+			printf("sent successfully: %d\n", mr);
+			if (message >= 0 && number)
+				track_part(message, number, mr);
+			return 0;
+		}
+
+		const enum cms_class class = classify_cms_error(rc);
+		if (class == CMS_PERMANENT || attempt >= RATE_MAX_RETRIES) {
+			print_ids(stderr, ids, id_count);
+			if (rc < 0)
+				fprintf(stderr, "not sent, command error\n");
+			else
+				fprintf(stderr, "not sent, code: %d\n", rc);
+			rate.failed++;
+			if (message >= 0)
+				track_done(message, 0);
+			return 1;
+		}
+		rate.retries++;
+		if (class == CMS_TRANSIENT)
+			sleep_ms(RATE_TRANSIENT_PAUSE_MS);
+	}
+}
+
+/*
+ * Destination address of an SMS-SUBMIT PDU, used to match delivery reports
+ * of pre-encoded messages.
+ */
+static int submit_recipient(const unsigned char* pdu, int pdu_len,
+		char* number, size_t number_size)
+{
+	const int address = 1 + pdu[0] + 2;	/* skip first octet and TP-MR */
+	if (address + 2 > pdu_len)
+		return -1;
+	const int digits = pdu[address];
+	if (address + 2 + (digits + 1) / 2 > pdu_len ||
+			(size_t)digits + 1 > number_size)
+		return -1;
+	for (int i = 0; i < digits; ++i) {
+		unsigned char octet = pdu[address + 2 + i / 2];
+		number[i] = '0' + (i % 2 ? octet >> 4 : octet & 0x0F);
+	}
+	number[digits] = '\0';
+	return 0;
+}
+
+/*
+ * Encode and submit all parts of a message. Returns 0 when every part was
+ * accepted.
+ */
+static int send_message(const int* ids, int id_count, const char* number,
+		const char* text, int debug)
+{
+	static unsigned char pdus[SMS_MAX_PARTS][SMS_MAX_PDU_LENGTH];
+	static unsigned char scratch[SMS_ENCODE_SCRATCH_SIZE];
+	int pdu_lengths[SMS_MAX_PARTS];
+	int total_parts = pdu_encode_parts_scratch("", number, text, 0,
+						   encode_flags, pdus, pdu_lengths,
+						   SMS_MAX_PARTS, scratch,
+						   sizeof(scratch));
+	/* The reference is only taken once the text is known to need it. */
+	if (total_parts > 1) {
+		const int reference_number = allocate_reference(number);
+		for (int i = 0; i < total_parts; ++i) {
+			if (pdu_set_reference(pdus[i], pdu_lengths[i],
+					      reference_number) < 0)
+				total_parts = -1;
+		}
+	}
+	if (total_parts < 0) {
+		fprintf(stderr, "error encoding to PDU: %s \"%s\"\n",
+			number, text);
+		rate.failed++;
+		return 1;
+	}
+
+	const int message = report_wait_s > 0 ?
+		track_message(ids, id_count, total_parts) : -1;
+	int failed = 0;
+	for (int part_number = 1; part_number <= total_parts && !failed; ++part_number)
+		failed = send_part(ids, id_count, number, pdus[part_number - 1],
+				   pdu_lengths[part_number - 1], part_number,
+				   total_parts, message, debug);
+	return failed;
+}
+
+/*
+ * Line reader on a raw descriptor, so that a poll() timeout can interrupt
+ * waiting for input without losing lines already buffered by stdio.
+ */
+struct line_reader {
+	int fd;
+	int notify_fd;		/* -1 or a descriptor that interrupts waiting */
+	int eof;
+	char* buf;
+	size_t start;
+	size_t length;
+	size_t size;
+};
+
+/*
+ * Return 1 and point line at the next line (without the line terminator),
+ * 0 when nothing arrived within timeout_ms (-1 waits forever), 2 when
+ * notify_fd became readable first or -1 at the end of input.
+ */
+static int read_line(struct line_reader* r, int timeout_ms, char** line)
+{
+	for (;;) {
+		char* begin = r->buf + r->start;
+		char* end = r->length > r->start ?
+			memchr(begin, '\n', r->length - r->start) : NULL;
+		if (end || (r->eof && r->length > r->start)) {
+			if (!end)
+				end = r->buf + r->length++;
+			*end = '\0';
+			if (end > begin && end[-1] == '\r')
+				end[-1] = '\0';
+			r->start = (size_t)(end - r->buf) + 1;
+			*line = begin;
+			return 1;
+		}
+		if (r->eof)
+			return -1;
+
+		memmove(r->buf, begin, r->length - r->start);
+		r->length -= r->start;
+		r->start = 0;
+		if (r->size - r->length < 2) {
+			size_t size = r->size ? r->size * 2 : 4096;
+			char* buf = realloc(r->buf, size);
+			if (!buf)
+				return -1;
+			r->buf = buf;
+			r->size = size;
+		}
+
+		struct pollfd pfd[2] = {
+			{ .fd = r->fd, .events = POLLIN },
+			{ .fd = r->notify_fd, .events = POLLIN },
+		};
+		int rc = poll(pfd, r->notify_fd < 0 ? 1 : 2, timeout_ms);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc == 0)
+			return 0;
+		if (rc > 0 && r->notify_fd >= 0 && pfd[1].revents)
+			return 2;
+		ssize_t n = read(r->fd, r->buf + r->length, r->size - r->length - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			r->eof = 1;
+		else
+			r->length += (size_t)n;
+	}
+}
+
+/*
+ * Optional coalescing of batch messages: messages to the same recipient that
+ * arrive within window_ms of the first one are joined with a newline, as long
+ * as the result fits max_parts and needs no more parts than sending them one
+ * by one.
+ */
+struct coalesce_group {
+	char* number;
+	char* text;
+	int* ids;
+	int id_count;
+	int parts;
+	struct timespec first;
+};
+
+static struct {
+	int window_ms;
+	int max_parts;
+	struct coalesce_group* groups;
+	int count;
+} coalesce = {
+	.max_parts = 3,
+};
+
+static int count_parts(const char* number, const char* text)
+{
+	static unsigned char scratch[SMS_ENCODE_SCRATCH_SIZE];
+
+	return pdu_encode_parts_scratch("", number, text, 0, encode_flags,
+					NULL, NULL, 0, scratch, sizeof(scratch));
+}
+
+static int coalesce_send(int i, int debug)
+{
+	struct coalesce_group* g = &coalesce.groups[i];
+	int failed = send_message(g->ids, g->id_count, g->number, g->text, debug);
+
+	free(g->number);
+	free(g->text);
+	free(g->ids);
+	memmove(g, g + 1, (size_t)(coalesce.count - i - 1) * sizeof(*g));
+	coalesce.count--;
+	return failed;
+}
+
+/* Send groups whose window has passed, or all of them. */
+static int coalesce_flush(int all, int debug)
+{
+	int failed = 0;
+
+	for (int i = 0; i < coalesce.count; ) {
+		if (all || elapsed_ms(&coalesce.groups[i].first) >= coalesce.window_ms)
+			failed |= coalesce_send(i, debug);
+		else
+			++i;
+	}
+	return failed;
+}
+
+/* Time left until the oldest group must be sent, -1 without groups. */
+static int coalesce_timeout(void)
+{
+	if (coalesce.count == 0)
+		return -1;
+	long remaining = coalesce.window_ms - elapsed_ms(&coalesce.groups[0].first);
+	return remaining > 0 ? (int)remaining : 0;
+}
+
+static int coalesce_add(int id, const char* number, const char* text, int debug)
+{
+	int failed = 0;
+	int parts = count_parts(number, text);
+
+	if (coalesce.window_ms == 0 || parts < 0)
+		return send_message(&id, 1, number, text, debug);
+
+	for (int i = 0; i < coalesce.count; ++i) {
+		struct coalesce_group* g = &coalesce.groups[i];
+		if (strcmp(g->number, number))
+			continue;
+
+		size_t length = strlen(g->text);
+		char* merged = malloc(length + strlen(text) + 2);
+		int* ids = realloc(g->ids, (size_t)(g->id_count + 1) * sizeof(*ids));
+		if (!merged || !ids) {
+			free(merged);
+			if (ids)
+				g->ids = ids;
+			break;
+		}
+		g->ids = ids;
+		memcpy(merged, g->text, length);
+		merged[length] = '\n';
+		strcpy(merged + length + 1, text);
+
+		int merged_parts = count_parts(number, merged);
+		if (merged_parts > 0 && merged_parts <= coalesce.max_parts &&
+				merged_parts <= g->parts + parts) {
+			free(g->text);
+			g->text = merged;
+			g->parts = merged_parts;
+			g->ids[g->id_count++] = id;
+			return 0;
+		}
+		free(merged);
+		failed |= coalesce_send(i, debug);
+		break;
+	}
+
+	struct coalesce_group* groups = realloc(coalesce.groups,
+		(size_t)(coalesce.count + 1) * sizeof(*groups));
+	if (!groups)
+		return failed | send_message(&id, 1, number, text, debug);
+	coalesce.groups = groups;
+
+	struct coalesce_group* g = &groups[coalesce.count];
+	g->number = strdup(number);
+	g->text = strdup(text);
+	g->ids = malloc(sizeof(*g->ids));
+	if (!g->number || !g->text || !g->ids) {
+		free(g->number);
+		free(g->text);
+		free(g->ids);
+		return failed | send_message(&id, 1, number, text, debug);
+	}
+	g->ids[0] = id;
+	g->id_count = 1;
+	g->parts = parts;
+	clock_gettime(CLOCK_MONOTONIC, &g->first);
+	coalesce.count++;
+	return failed;
+}
+
+/* Print UTF-8 text inside a JSON string, other than ASCII as \u escapes. */
+static void print_json_utf8(const char* text, int length)
+{
+	const unsigned char* s = (const unsigned char*)text;
+
+	for (int i = 0; i < length; ) {
+		unsigned int c = s[i];
+		int n = 1;
+		if (c >= 0xF0 && i + 3 < length) {
+			c = ((c & 0x07) << 18) | ((s[i + 1] & 0x3F) << 12) |
+				((s[i + 2] & 0x3F) << 6) | (s[i + 3] & 0x3F);
+			n = 4;
+		} else if (c >= 0xE0 && i + 2 < length) {
+			c = ((c & 0x0F) << 12) | ((s[i + 1] & 0x3F) << 6) |
+				(s[i + 2] & 0x3F);
+			n = 3;
+		} else if (c >= 0xC0 && i + 1 < length) {
+			c = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+			n = 2;
+		}
+		if (n == 1)
+			print_json_escape_char(0x0, c);
+		else if (c >= 0x10000)
+			printf("\\u%04X\\u%04X", 0xD800 + ((c - 0x10000) >> 10),
+			       0xDC00 + ((c - 0x10000) & 0x3FF));
+		else
+			printf("\\u%04X", c);
+		i += n;
+	}
+}
+
+static int printed_messages = 0;
+/* Messages are written out one per line as they arrive (listen). */
+static int stream_output = 0;
+
+/*
+ * Start the output of a message read from the given storage slots. A
+ * merged message lists the slots of all its parts still in storage.
+ */
+static void print_message_start(const int* indexes, int index_count,
+		int merged, int json)
+{
+	if (json) {
+		if (printed_messages > 0 && !stream_output)
+			printf(",");
+		printf("{");
+		if (index_count > 0)
+			printf("\"index\":%d,", indexes[0]);
+		if (merged) {
+			printf("\"indexes\":[");
+			for (int i = 0; i < index_count; ++i)
+				printf(i ? ",%d" : "%d", indexes[i]);
+			printf("],");
+		}
+	} else {
+		printf("MSG: ");
+		for (int i = 0; i < index_count; ++i)
+			printf(i ? ",%d" : "%d", indexes[i]);
+		printf("\n");
+	}
+	printed_messages++;
+}
+
+static void print_message_end(int json)
+{
+	if (json)
+		printf(stream_output ? "}\n" : "}");
+	if (stream_output)
+		fflush(stdout);
+}
+
+/* Slots to delete once the messages printed from them are written out. */
+static int consume_output = 0;
+static struct {
+	int* index;
+	int count;
+	int size;
+} consumed;
+
+static void consume(const int* indexes, int index_count)
+{
+	for (int i = 0; i < index_count; ++i) {
+		if (indexes[i] < 0)
+			continue;
+		if (consumed.count == consumed.size) {
+			const int size = consumed.size ? 2 * consumed.size : 64;
+			int* index = realloc(consumed.index, size * sizeof(int));
+			if (!index) {
+				fprintf(stderr, "out of memory, message %d is not deleted\n",
+					indexes[i]);
+				continue;
+			}
+			consumed.index = index;
+			consumed.size = size;
+		}
+		consumed.index[consumed.count++] = indexes[i];
+	}
+}
+
+/*
+ * Print the sender, time, concatenation and UTF-8 text of a message. A
+ * stored submit has its recipient instead, and no time.
+ */
+static void print_message(const struct sms_pdu_view* view, const char* sender,
+		const char* text, int text_length, int merged, int json)
+{
+	const time_t sms_time = pdu_view_time(view, NULL);
+	char time_data_str[64];
+	strftime(time_data_str, sizeof(time_data_str), dateformat,
+		gmtime(&sms_time));
+
+	if (json) {
+		printf(view->scts < 0 ? "\"recipient\":\"" : "\"sender\":\"");
+		print_json_utf8(sender, strlen(sender));
+		if (view->scts < 0)
+			printf("\",");
+		else
+			printf("\",\"timestamp\":\"%s\",", time_data_str);
+		if (merged)
+			printf("\"reference\":%d,\"total\":%d,",
+				view->ref_number, view->total_parts);
+		else if (view->total_parts > 0)
+			printf("\"reference\":%d,\"part\":%d,\"total\":%d,",
+				view->ref_number, view->part_number,
+				view->total_parts);
+		printf("\"content\":\"");
+		print_json_utf8(text, text_length);
+		printf("\"");
+	} else {
+		if (view->scts < 0) {
+			printf("To: %s\n", sender);
+		} else {
+			printf("From: %s\n", sender);
+			printf("Date/Time: %s\n", time_data_str);
+		}
+		if (view->total_parts > 0) {
+			printf("Reference number: %d\n", view->ref_number);
+			if (merged)
+				printf("SMS segments: %d\n", view->total_parts);
+			else
+				printf("SMS segment %d of %d\n", view->part_number,
+					view->total_parts);
+		}
+		fwrite(text, 1, (size_t)text_length, stdout);
+		printf("\n\n");
+	}
+	print_message_end(json);
+}
+
+/* Print a single message or part; 8-bit data has no text. */
+static void print_deliver(const struct sms_pdu_view* view, const char* sender,
+		int index, int json)
+{
+	char text[4 * 160 + 1];
+	int text_length = pdu_view_text(view, text, sizeof(text));
+
+	if (text_length < 0)
+		text_length = 0;
+	print_message_start(&index, index >= 0, 0, json);
+	print_message(view, sender, text, text_length, 0, json);
+	if (consume_output)
+		consume(&index, 1);
+}
+
+/* FNV-1a of the PDU octets, never 0. */
+static uint32_t pdu_fingerprint(const unsigned char* pdu, int length)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < length; ++i)
+		hash = (hash ^ pdu[i]) * 16777619u;
+	return hash ? hash : 1;
+}
+
+/*
+ * Messages already printed by recv -n: the fingerprint of the PDU in each
+ * storage slot, kept in the state directory between runs.
+ */
+enum { SEEN_SLOTS = 1024 };
+enum { SEEN_NO_UNREAD = 0x01 };	/* the modem rejected AT+CMGL=0 */
+
+struct seen_state {
+	char magic[8];
+	uint32_t flags;
+	uint32_t fingerprint[SEEN_SLOTS];	/* 0 for an empty slot */
+};
+
+static const char seen_state_magic[8] = "SMSSEEN1";
+static struct seen_state seen;
+static int seen_fd = -1;
+/* Slots are tracked, by recv -n or for the lifetime of listen. */
+static int seen_active = 0;
+
+static int seen_before(int index, uint32_t fingerprint)
+{
+	return seen_active && index >= 0 && index < SEEN_SLOTS &&
+		seen.fingerprint[index] == fingerprint;
+}
+
+static void set_seen(int index, uint32_t fingerprint)
+{
+	if (seen_active && index >= 0 && index < SEEN_SLOTS)
+		seen.fingerprint[index] = fingerprint;
+}
+
+static int delete_message(int index)
+{
+	char buf[256];
+
+	alarm(10);
+	fprintf(pf, "AT+CMGD=%d\r\n", index);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if (starts_with("OK", buf)) {
+			set_seen(index, 0);
+			return 0;
+		}
+		if (starts_with("+CMS ERROR:", buf) || starts_with("ERROR", buf)) {
+			fprintf(stderr, "Error deleting message %d: %s", index, buf);
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Delete every message of a kind at once with AT+CMGD=0,<flag>: 1 read,
+ * 2 read and sent, 3 read, sent and unsent, 4 all. The index is ignored.
+ * Returns -1 when the modem rejects the flag.
+ */
+static int delete_flagged(int flag)
+{
+	char buf[256];
+
+	alarm(10);
+	fprintf(pf, "AT+CMGD=0,%d\r\n", flag);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if (starts_with("OK", buf)) {
+			if (flag == 4)
+				memset(seen.fingerprint, 0, sizeof(seen.fingerprint));
+			return 0;
+		}
+		if (starts_with("+CMS ERROR:", buf) || starts_with("ERROR", buf))
+			return -1;
+	}
+	return -1;
+}
+
+/*
+ * Parts of concatenated messages received by recv -M wait in a file mapped
+ * from the state directory until the message is complete, so that parts
+ * read in different runs are merged. A part is keyed by sender, reference,
+ * total and part number and keeps the time it was first seen; parts still
+ * incomplete after the merge expiry are printed on their own.
+ */
+enum { PART_SLOTS = 256 };
+
+struct stored_part {
+	int64_t stored;		/* first seen, 0 for a free slot */
+	unsigned short reference;
+	unsigned char total;
+	unsigned char part;
+	unsigned char expired;
+	unsigned short length;
+	short index;		/* storage slot it was last listed from */
+	uint32_t fingerprint;
+	char sender[40];
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+};
+
+struct part_store {
+	char magic[8];
+	struct stored_part parts[PART_SLOTS];
+};
+
+static const char part_store_magic[8] = "SMSPART2";
+static int merge_expiry_s = 0;
+static int merge_delete = 0;
+static struct part_store* part_store = NULL;
+/* Storage slot each stored part was listed from in this run, or -1. */
+static int part_index[PART_SLOTS];
+
+/* Map the part store, locked until the process exits. */
+static int open_part_store(void)
+{
+	int fd = open_state_file("parts", O_RDWR | O_CREAT);
+	struct stat st;
+
+	if (fd < 0 || flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0 ||
+			(st.st_size != sizeof(struct part_store) &&
+			 (ftruncate(fd, 0) < 0 ||
+			  ftruncate(fd, sizeof(struct part_store)) < 0))) {
+		fprintf(stderr, "part store in %s unavailable: %s\n",
+			statedir, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	void* map = mmap(NULL, sizeof(struct part_store),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "mapping part store: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	part_store = map;
+	if (memcmp(part_store->magic, part_store_magic, sizeof(part_store_magic))) {
+		memset(part_store, 0, sizeof(*part_store));
+		memcpy(part_store->magic, part_store_magic, sizeof(part_store_magic));
+	}
+	for (int i = 0; i < PART_SLOTS; ++i)
+		part_index[i] = -1;
+	return 0;
+}
+
+static int same_message(const struct stored_part* a, const struct stored_part* b)
+{
+	return a->reference == b->reference && a->total == b->total &&
+		!strcmp(a->sender, b->sender);
+}
+
+/*
+ * Keep a part listed from storage slot index. Returns -1 when it is not a
+ * valid part, which is then printed as it is.
+ */
+static int store_part(const struct sms_pdu_view* view, const char* sender,
+		int index)
+{
+	if (view->part_number < 1 || view->part_number > view->total_parts ||
+			strlen(sender) >= sizeof(part_store->parts[0].sender))
+		return -1;
+
+	struct stored_part key;
+	key.reference = view->ref_number;
+	key.total = view->total_parts;
+	key.part = view->part_number;
+	strcpy(key.sender, sender);
+
+	int slot = -1;
+	int oldest = 0;
+	for (int i = 0; i < PART_SLOTS; ++i) {
+		const struct stored_part* p = &part_store->parts[i];
+		if (p->stored && p->part == key.part && same_message(p, &key)) {
+			slot = i;
+			break;
+		}
+		if (slot < 0 && !p->stored)
+			slot = i;
+		if (p->stored < part_store->parts[oldest].stored)
+			oldest = i;
+	}
+	/* A full store makes room by forgetting the oldest part. */
+	if (slot < 0)
+		slot = oldest;
+
+	struct stored_part* p = &part_store->parts[slot];
+	if (!p->stored || p->part != key.part || !same_message(p, &key)) {
+		key.stored = time(NULL);
+		key.expired = 0;
+		memcpy(p, &key, offsetof(struct stored_part, pdu));
+	}
+	p->length = view->length;
+	memcpy(p->pdu, view->pdu, view->length);
+	p->index = index;
+	p->fingerprint = pdu_fingerprint(view->pdu, view->length);
+	part_index[slot] = index;
+	return 0;
+}
+
+/* Print the parts in slots[1..total] as one message and forget them. */
+static int print_merged(const int* slots, int total, int json)
+{
+	const size_t size = (size_t)total * 4 * 160 + 1;
+	char* text = malloc(size);
+	int indexes[256];
+	int index_count = 0;
+	int length = 0;
+	struct sms_pdu_view first;
+
+	if (!text)
+		return -1;
+	for (int part = 1; part <= total; ++part) {
+		const struct stored_part* p = &part_store->parts[slots[part]];
+		struct sms_pdu_view view;
+		if (pdu_view_parse(&view, p->pdu, p->length) < 0)
+			continue;
+		if (part == 1)
+			first = view;
+		const int n = pdu_view_text(&view, text + length, size - length);
+		if (n > 0)
+			length += n;
+		/* With -n, parts listed in earlier runs may still be stored. */
+		if (part_index[slots[part]] >= 0 ||
+				seen_before(p->index, p->fingerprint))
+			indexes[index_count++] = p->index;
+	}
+	print_message_start(indexes, index_count, 1, json);
+	print_message(&first, part_store->parts[slots[1]].sender, text, length,
+		1, json);
+	free(text);
+
+	if (merge_delete || consume_output)
+		consume(indexes, index_count);
+	for (int part = 1; part <= total; ++part) {
+		memset(&part_store->parts[slots[part]], 0, sizeof(struct stored_part));
+		part_index[slots[part]] = -1;
+	}
+	return 0;
+}
+
+/*
+ * After listing: print every complete message, and on their own the parts
+ * that waited longer than the merge expiry. Expired parts stay while they
+ * are still in storage, so that they are printed like any other message.
+ */
+static void merge_parts(int json)
+{
+	const time_t now = time(NULL);
+	int slots[256];
+
+	for (int i = 0; i < PART_SLOTS; ++i) {
+		const struct stored_part* first = &part_store->parts[i];
+		if (!first->stored)
+			continue;
+		int found = 0;
+		for (int part = 1; part <= first->total; ++part)
+			slots[part] = -1;
+		for (int j = i; j < PART_SLOTS; ++j) {
+			const struct stored_part* p = &part_store->parts[j];
+			if (p->stored && same_message(p, first) && slots[p->part] < 0) {
+				slots[p->part] = j;
+				found++;
+			}
+		}
+		if (found == first->total)
+			print_merged(slots, first->total, json);
+	}
+
+	for (int i = 0; i < PART_SLOTS; ++i) {
+		struct stored_part* p = &part_store->parts[i];
+		if (!p->stored || now - p->stored < merge_expiry_s)
+			continue;
+		struct sms_pdu_view view;
+		if ((!p->expired || part_index[i] >= 0) &&
+				pdu_view_parse(&view, p->pdu, p->length) == 0)
+			print_deliver(&view, p->sender, part_index[i], json);
+		p->expired = 1;
+		if (part_index[i] < 0)
+			memset(p, 0, sizeof(*p));
+	}
+}
+
+/*
+ * Print the message read from storage slot index, given as a line of hex.
+ * Returns 1 when it was printed or kept for merging, 0 when it had been
+ * printed before by recv -n.
+ */
+static int print_stored(int index, char* line, int json, int raw)
+{
+	unsigned char pdu[SMS_MAX_PDU_LENGTH];
+
+	line[strcspn(line, "\r\n")] = '\0';
+	// Invalid hex gives -1, which both decoders reject.
+	const int pdu_length = pdu_hex_decode(line, strlen(line), pdu, sizeof(pdu));
+	if (seen_active) {
+		const uint32_t fingerprint = pdu_fingerprint(pdu,
+				pdu_length > 0 ? pdu_length : 0);
+		if (seen_before(index, fingerprint))
+			return 0;
+		set_seen(index, fingerprint);
+	}
+
+	if (raw) {
+		print_message_start(&index, index >= 0, 0, json);
+		if (json)
+			printf("\"content\":\"%s\"", line);
+		else
+			printf("%s\n", line);
+		print_message_end(json);
+		if (consume_output)
+			consume(&index, 1);
+		return 1;
+	}
+
+	time_t sms_time;
+	char phone_str[40];
+	int report_mr;
+	int report_status;
+	if (pdu_decode_status_report(pdu, pdu_length, &report_mr,
+			phone_str, sizeof(phone_str), &sms_time,
+			&report_status) == 0) {
+		char time_data_str[64];
+		strftime(time_data_str, 64, dateformat, gmtime(&sms_time));
+		print_message_start(&index, index >= 0, 0, json);
+		if (json) {
+			printf("\"type\":\"status_report\",\"recipient\":\"%s\",\"message_reference\":%d,\"timestamp\":\"%s\",\"status\":%d",
+			       phone_str, report_mr, time_data_str, report_status);
+		} else {
+			printf("Status report for: %s\n", phone_str);
+			printf("Message reference: %d\n", report_mr);
+			printf("Date/Time: %s\n", time_data_str);
+			printf("Status: %d\n\n", report_status);
+		}
+		print_message_end(json);
+		if (consume_output)
+			consume(&index, 1);
+		return 1;
+	}
+
+	struct sms_pdu_view view;
+	if (pdu_length < 0 || pdu_view_parse(&view, pdu, pdu_length) < 0 ||
+			pdu_view_sender(&view, phone_str, sizeof(phone_str)) < 0) {
+		fprintf(stderr, "error decoding pdu %d: %s\n", index, line);
+		print_message_start(&index, index >= 0, 0, json);
+		if (json)
+			printf("\"error\":\"error decoding pdu\",\"sender\":\"\",\"timestamp\":\"\",\"content\":\"\"");
+		print_message_end(json);
+		return 1;
+	}
+
+	/* Parts of a stored submit are printed on their own. */
+	if (merge_expiry_s > 0 && view.scts >= 0 && view.total_parts > 1 &&
+			store_part(&view, phone_str, index) == 0)
+		return 1;
+	print_deliver(&view, phone_str, index, json);
+	return 1;
+}
+
+/*
+ * List the messages of the given status with AT+CMGL. With recv -n only
+ * new ones are printed, and after a full listing (status 4) slots that
+ * were not listed are forgotten. Returns -1 when the modem rejects the
+ * command.
+ */
+static int list_messages(int stat, int json, int raw)
+{
+	char buf[1024];
+	unsigned char listed[SEEN_SLOTS] = { 0 };
+
+	fprintf(pf, "AT+CMGL=%d\r\n", stat);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (starts_with("OK", buf)) {
+			if (seen_active && stat == 4) {
+				for (int i = 0; i < SEEN_SLOTS; ++i)
+					if (!listed[i])
+						seen.fingerprint[i] = 0;
+			}
+			return 0;
+		}
+		if (starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf))
+			return -1;
+		if (handle_urc(buf) || !starts_with("+CMGL:", buf))
+			continue;
+		int index;
+		if (sscanf(buf, "+CMGL: %d,", &index) != 1) {
+			fprintf(stderr, "unparsable CMGL response: %s\n", buf+7);
+			continue;
+		}
+		if (!fgets(buf, sizeof(buf), pfi)) {
+			fprintf(stderr, "reading pdu %d\n", index);
+			break;
+		}
+		if (index >= 0 && index < SEEN_SLOTS)
+			listed[index] = 1;
+		print_stored(index, buf, json, raw);
+	}
+	return -1;
+}
+
+/*
+ * Read storage slot index with AT+CMGR. Returns 1 for a message, 0 for an
+ * empty slot and -1 when the modem does not answer.
+ */
+static int read_message(int index, int json, int raw)
+{
+	char buf[1024];
+	int found = 0;
+
+	fprintf(pf, "AT+CMGR=%d\r\n", index);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (starts_with("OK", buf))
+			return found;
+		if (starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
+			set_seen(index, 0);
+			return 0;
+		}
+		if (handle_urc(buf))
+			continue;
+		if (starts_with("+CMGR:", buf) && fgets(buf, sizeof(buf), pfi)) {
+			print_stored(index, buf, json, raw);
+			found = 1;
+		}
+	}
+	return -1;
+}
+
+/* Used and total slots of the first preferred storage, from AT+CPMS?. */
+static int storage_usage(int* used, int* total)
+{
+	char buf[256];
+	int found = 0;
+
+	fputs("AT+CPMS?\r\n", pf);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (handle_urc(buf))
+			continue;
+		if (starts_with("+CPMS:", buf))
+			found = sscanf(buf, "+CPMS: \"%*[^\"]\",%d,%d", used, total) == 2;
+		if (starts_with("OK", buf))
+			return found ? 0 : -1;
+		if (starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf))
+			return -1;
+	}
+	return -1;
+}
+
+/*
+ * Make the printed messages durable before the modem forgets them: stdout
+ * is synced when it is a file, and so are parts kept for merging.
+ */
+static int hand_off(void)
+{
+	if (fflush(stdout) == EOF ||
+			(fsync(fileno(stdout)) < 0 && errno != EINVAL &&
+			 errno != EROFS) ||
+			(part_store && msync(part_store, sizeof(*part_store),
+					     MS_SYNC) < 0)) {
+		fprintf(stderr, "writing message: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Collect the slots listed by AT+CMGL for the given status, without
+ * decoding them. Returns their number or -1.
+ */
+static int list_indexes(int stat, int* indexes, int max)
+{
+	char buf[1024];
+	int count = 0;
+
+	alarm(30);
+	fprintf(pf, "AT+CMGL=%d\r\n", stat);
+	while (fgets(buf, sizeof(buf), pfi)) {
+		if (starts_with("OK", buf))
+			return count;
+		if (starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf))
+			return -1;
+		if (handle_urc(buf) || !starts_with("+CMGL:", buf))
+			continue;
+		if (count < max && sscanf(buf, "+CMGL: %d,", &indexes[count]) == 1)
+			count++;
+		if (!fgets(buf, sizeof(buf), pfi))
+			break;
+	}
+	return -1;
+}
+
+/* Whether index is one of the count indexes. */
+static int has_index(const int* indexes, int count, int index)
+{
+	for (int i = 0; i < count; ++i)
+		if (indexes[i] == index)
+			return 1;
+	return 0;
+}
+
+/* Whether the read messages in storage are exactly the consumed slots. */
+static int consumed_all_read(void)
+{
+	int* listed = malloc((consumed.count + 1) * sizeof(int));
+	int same = 0;
+
+	if (!listed)
+		return 0;
+	/* One more than consumed tells a longer listing apart. */
+	const int count = list_indexes(1, listed, consumed.count + 1);
+	if (count >= 0 && count <= consumed.count) {
+		same = 1;
+		for (int i = 0; same && i < count; ++i)
+			same = has_index(consumed.index, consumed.count, listed[i]);
+		for (int i = 0; same && i < consumed.count; ++i)
+			same = has_index(listed, count, consumed.index[i]);
+	}
+	free(listed);
+	return same;
+}
+
+/*
+ * Delete the consumed slots once their messages are written out. When
+ * they are all the storage holds and a listing of read messages gives
+ * exactly those slots, AT+CMGD=0,1 deletes them at once: messages arriving
+ * since are unread. Sent messages printed with -r are not read messages,
+ * so they are deleted one by one.
+ */
+static int delete_consumed(void)
+{
+	int used, total;
+	int failed = 0;
+
+	if (consumed.count == 0)
+		return 0;
+	if (hand_off() < 0)
+		return -1;
+	alarm(10);
+	if (consumed.count > 1 && storage_usage(&used, &total) == 0 &&
+			used == consumed.count && consumed_all_read() &&
+			delete_flagged(1) == 0) {
+		for (int i = 0; i < consumed.count; ++i)
+			set_seen(consumed.index[i], 0);
+		consumed.count = 0;
+	}
+	for (int i = 0; i < consumed.count; ++i)
+		failed |= delete_message(consumed.index[i]) < 0;
+	consumed.count = 0;
+	alarm(0);
+	return failed ? -1 : 0;
+}
+
+/* Delete the listed slots one by one. Returns non-zero if any failed. */
+static int delete_indexes(const int* indexes, int count)
+{
+	int failed = 0;
+
+	for (int i = 0; i < count; ++i) {
+		if (delete_message(indexes[i]) < 0) {
+			failed = 1;
+			continue;
+		}
+		printf("Deleted message %d\n", indexes[i]);
+	}
+	return failed;
+}
+
+/*
+ * Delete all (stat 4) or read (stat 1) messages. One AT+CMGD with a
+ * delete flag does it on most modems. Otherwise the occupied slots are
+ * listed and deleted, which costs nothing more when AT+CPMS? reports an
+ * empty storage.
+ */
+static int delete_messages(int stat)
+{
+	int indexes[1024];
+	int used, total;
+
+	if (delete_flagged(stat == 4 ? 4 : 1) == 0) {
+		printf("Deleted %s messages\n", stat == 4 ? "all" : "read");
+		return 0;
+	}
+	alarm(10);
+	if (storage_usage(&used, &total) == 0 && used == 0)
+		return 0;
+	const int count = list_indexes(stat, indexes, 1024);
+	if (count < 0) {
+		fprintf(stderr, "cannot list messages to delete\n");
+		return 1;
+	}
+	return delete_indexes(indexes, count);
+}
+
+/*
+ * Delete the occupied slots from first to last. Without a listing every
+ * slot in the range is tried.
+ */
+static int delete_range(int first, int last)
+{
+	int indexes[1024];
+	int count = list_indexes(4, indexes, 1024);
+	int n = 0;
+
+	if (count < 0) {
+		for (int i = first; i <= last && n < 1024; ++i)
+			indexes[n++] = i;
+	} else {
+		for (int i = 0; i < count; ++i)
+			if (indexes[i] >= first && indexes[i] <= last)
+				indexes[n++] = indexes[i];
+	}
+	return delete_indexes(indexes, n);
+}
+
+/* Load the slots printed by earlier runs of recv -n from this storage. */
+static int open_seen_state(void)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), storage[0] ? "seen.%s" : "seen", storage);
+	seen_fd = open_state_file(name, O_RDWR | O_CREAT);
+	if (seen_fd < 0 || flock(seen_fd, LOCK_EX) < 0) {
+		fprintf(stderr, "recv state in %s unavailable: %s\n",
+			statedir, strerror(errno));
+		if (seen_fd >= 0)
+			close(seen_fd);
+		seen_fd = -1;
 		return -1;
-	memcpy(payload, payload_start, (size_t)(payload_end - payload_start));
-	payload[payload_end - payload_start] = '\0';
+	}
+	if (pread(seen_fd, &seen, sizeof(seen), 0) != sizeof(seen) ||
+			memcmp(seen.magic, seen_state_magic, sizeof(seen_state_magic))) {
+		memset(&seen, 0, sizeof(seen));
+		memcpy(seen.magic, seen_state_magic, sizeof(seen_state_magic));
+	}
+	seen_active = 1;
+	return 0;
+}
 
-	p = payload_end + 1;
-	while (isspace((unsigned char)*p))
-		p++;
-	if (*p != ',')
-		return *p == '\0' ? 0 : -1;
-	p++;
-	while (isspace((unsigned char)*p))
-		p++;
-	errno = 0;
-	long value = strtol(p, &end, 10);
-	if (end == p)
-		return *p == '\0' ? 0 : -1;
-	if (errno == ERANGE || value < 0 || value > 255)
-		return -1;
-	*dcs = (int)value;
-	return 1;
+/* Called once the printed messages are flushed. */
+static void save_seen_state(void)
+{
+	if (seen_fd >= 0 && pwrite(seen_fd, &seen, sizeof(seen), 0) != sizeof(seen))
+		fprintf(stderr, "saving recv state: %s\n", strerror(errno));
 }
 
-static int decode_hex(const char *hex, unsigned char *output, size_t output_size)
+/* Empty slots read past the expected ones before listing everything. */
+enum { GAP_PROBES = 8 };
+
+/*
+ * Print only the messages stored since the last run. New messages are
+ * normally unread, so AT+CMGL=0 finds them. When the storage then holds
+ * more messages than are known, some arrived already read: up to a few
+ * unknown slots are read with AT+CMGR, lowest first as modems fill them.
+ * A storage holding fewer messages than known, or more gaps than that,
+ * is listed in full with AT+CMGL=4, still printing only new messages.
+ */
+static void recv_new(int json, int raw)
 {
-	size_t length = strlen(hex);
+	int used = -1;
+	int total = 0;
+
+	if (!(seen.flags & SEEN_NO_UNREAD)) {
+		if (list_messages(0, json, raw) < 0) {
+			seen.flags |= SEEN_NO_UNREAD;
+		} else if (storage_usage(&used, &total) == 0) {
+			int known = 0;
+			for (int i = 0; i < SEEN_SLOTS; ++i)
+				known += seen.fingerprint[i] != 0;
+			if (total > SEEN_SLOTS)
+				total = SEEN_SLOTS;
+			if (used == known)
+				return;
+			int probes = used - known + GAP_PROBES;
+			for (int i = 0; i < total && used > known && probes > 0; ++i) {
+				if (seen.fingerprint[i])
+					continue;
+				probes--;
+				const int found = read_message(i, json, raw);
+				if (found < 0)
+					break;
+				known += found;
+			}
+			if (used == known)
+				return;
+		}
+	}
+	list_messages(4, json, raw);
+}
 
-	if ((length & 1) != 0 || length / 2 > output_size)
-		return -1;
-	for (size_t i = 0; i < length; i += 2) {
-		int high = char_to_hex(hex[i]);
-		int low = char_to_hex(hex[i + 1]);
-		if (high < 0 || low < 0)
+/*
+ * Write out the messages received as +CMT and acknowledge each one, before
+ * the modem gives up waiting and stops routing them to the TE.
+ */
+static int acknowledge_delivered(int raw)
+{
+	while (delivered.head != delivered.tail) {
+		print_stored(-1, delivered.hex[delivered.head % DELIVERED_SLOTS],
+			1, raw);
+		if (hand_off() < 0 || acknowledge_message() < 0)
 			return -1;
-		output[i / 2] = (unsigned char)((high << 4) | low);
+		delivered.head++;
 	}
-	return (int)(length / 2);
+	return 0;
 }
 
-static int looks_like_ucs2(const unsigned char *data, size_t length)
+static volatile sig_atomic_t listening = 1;
+
+static void stop_listening(int sig)
 {
-	size_t printable = 0;
-	size_t zero_high = 0;
-	size_t characters;
+	(void)sig;
+	listening = 0;
+}
 
-	if (length < 4 || (length & 1) != 0)
-		return 0;
-	characters = length / 2;
-	for (size_t i = 0; i < length; i += 2) {
-		unsigned int codepoint = ((unsigned int)data[i] << 8) | data[i + 1];
-		if (codepoint >= 0xd800 && codepoint <= 0xdfff)
-			return 0;
-		if (data[i] == 0)
-			zero_high++;
-		if (codepoint == '\n' || codepoint == '\r' || codepoint == '\t' ||
-				(codepoint >= 0x20 && codepoint != 0x7f))
-			printable++;
+/*
+ * Print messages as they arrive, one JSON object per line: new messages
+ * are announced by +CMTI and read from their slot with AT+CMGR. Messages
+ * already in storage are printed first, or only those not printed before
+ * with -n. With direct, new messages are routed to the TE as +CMT instead
+ * of being stored, and each one is acknowledged with AT+CNMA once it is
+ * written out; unacknowledged messages are sent again by the network.
+ * Runs until SIGINT or SIGTERM. Returns non-zero when the modem goes away
+ * or a message cannot be written.
+ */
+static int listen_messages(int incremental, int direct, int raw)
+{
+	struct sigaction sa = { .sa_handler = stop_listening };
+	struct pollfd pfd = {
+		.fd = fileno(pfi),
+		.events = POLLIN,
+	};
+	char buf[1024];
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	if (direct && enable_acknowledgement() < 0) {
+		fprintf(stderr, "reading new messages from storage\n");
+		direct = 0;
 	}
+	if (configure_cnmi(1, -1, "indicate new messages") < 0)
+		return 1;
 
-	/* Keep auto-detection conservative to avoid mistaking packed GSM-7. */
-	return zero_high * 4 >= characters * 3 &&
-		printable * 10 >= characters * 9;
-}
+	/* Announced slots may also be in the first listing. */
+	seen_active = 1;
+	stream_output = 1;
+	alarm(30);
+	if (incremental)
+		recv_new(1, raw);
+	else
+		list_messages(4, 1, raw);
+	/*
+	 * Only now, as the modem stops routing to the TE when a +CMT is not
+	 * acknowledged in time; messages of the meantime are announced.
+	 */
+	if (direct && configure_cnmi(2, -1, "route new messages") < 0)
+		return 1;
 
-static void print_json_escape_char(char c1, char c2)
-{
-	if (c1 == 0x0) {
-		if(c2 == '"') printf("\\\"");
-		else if(c2 == '\\') printf("\\\\");
-		else if(c2 == '\b') printf("\\b");
-		else if(c2 == '\n') printf("\\n");
-		else if(c2 == '\f') printf("\\f");
-		else if(c2 == '\r') printf("\\r");
-		else if(c2 == '\t') printf("\\t");
-		else if(c2 == '/') printf("\\/");
-		else if(c2 < ' ') printf("\\u00%02x", (unsigned char)c2);
-		else if(c2 > '~') printf("\\u00%02x", (unsigned char)c2);
-		else printf("%c", c2);
-	} else {
-		printf("\\u%02x%02x", (unsigned char)c1, (unsigned char)c2);
+	while (listening) {
+		const int printed = printed_messages;
+		if (acknowledge_delivered(raw) < 0)
+			return 1;
+		if (announced.overflow) {
+			announced.overflow = 0;
+			announced.head = announced.tail;
+			alarm(30);
+			list_messages(4, 1, raw);
+			if (acknowledge_delivered(raw) < 0)
+				return 1;
+		}
+		while (announced.head != announced.tail) {
+			const unsigned int slot = announced.head++ % ANNOUNCED_SLOTS;
+			/* Class 2 messages go to the SIM whatever mem3 is. */
+			if (announced.mem[slot][0] && listen_mem[0] &&
+					strcasecmp(announced.mem[slot], listen_mem)) {
+				fprintf(stderr, "message %d is stored in %s, not %s\n",
+					announced.index[slot], announced.mem[slot],
+					listen_mem);
+				continue;
+			}
+			alarm(10);
+			read_message(announced.index[slot], 1, raw);
+			if (acknowledge_delivered(raw) < 0)
+				return 1;
+		}
+		if (merge_expiry_s > 0) {
+			merge_parts(1);
+			/* Parts stay listed only until they have been merged once. */
+			for (int i = 0; i < PART_SLOTS; ++i)
+				part_index[i] = -1;
+		}
+		delete_consumed();
+		alarm(0);
+		if (printed != printed_messages)
+			save_seen_state();
+		/* Indications read along with the last responses. */
+		if (delivered.head != delivered.tail ||
+				announced.head != announced.tail)
+			continue;
+
+		const int rc = poll(&pfd, 1, merge_expiry_s > 0 ? 1000 : -1);
+		if (rc < 0 && errno != EINTR) {
+			fprintf(stderr, "poll(%s): %s\n", dev, strerror(errno));
+			return 1;
+		}
+		if (rc <= 0)
+			continue;
+		if (!fgets(buf, sizeof(buf), pfi)) {
+			if (!listening)
+				break;
+			fprintf(stderr, "read(%s): end of input\n", dev);
+			return 1;
+		}
+		handle_urc(buf);
 	}
+	save_seen_state();
+	return 0;
 }
 
+/* Options without a short form. */
+enum { OPT_CONSUME = 256 };
+
+static const struct option long_options[] = {
+	{ "consume", no_argument, NULL, OPT_CONSUME },
+	{ NULL, 0, NULL, 0 }
+};
+
 int main(int argc, char* argv[])
 {
 	int ch;
@@ -273,17 +2345,64 @@ int main(int argc, char* argv[])
 	int rawinput = 0;
 	int rawoutput = 0;
 	int jsonoutput = 0;
+	int incremental = 0;
+	int direct = 0;
 	int debug = 0;
 	int dcs = -1;
 	int at_wait_ms = 0;
 
-	while ((ch = getopt(argc, argv, "b:c:d:Ds:f:jRrw:")) != -1){
+	while ((ch = getopt_long(argc, argv, "A:b:c:C:d:Ds:S:f:jlmM:nRrTt:w:x",
+			long_options, NULL)) != -1){
 		switch (ch) {
+		case 'A':
+		{
+			char *end = NULL;
+			long wait = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || wait < 1 || wait > 604800) {
+				fprintf(stderr, "Invalid delivery report wait: %s\n", optarg);
+				return 2;
+			}
+			report_wait_s = (int)wait;
+			encode_flags |= PDU_ENCODE_STATUS_REPORT;
+			break;
+		}
 		case 'b': baudrate = atoi(optarg); break;
 		case 'c': dcs = atoi(optarg); break;
+		case 'C':
+		{
+			char *end = NULL;
+			long window = strtol(optarg, &end, 10);
+			long parts = coalesce.max_parts;
+			if (*end == ',')
+				parts = strtol(end + 1, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || window < 0 ||
+					window > 3600000 || parts < 1 || parts > 255) {
+				fprintf(stderr, "Invalid coalescing window: %s\n", optarg);
+				return 2;
+			}
+			coalesce.window_ms = (int)window;
+			coalesce.max_parts = (int)parts;
+			break;
+		}
 		case 'd': dev = optarg; break;
 		case 'D': debug = 1; break;
 		case 's': storage = optarg; break;
+		case 'S': statedir = optarg; break;
+		case 'l': encode_flags |= PDU_ENCODE_REF16; break;
+		case 'm': encode_flags |= PDU_ENCODE_MIXED; break;
+		case 'T': direct = 1; break;
+		case 't':
+		{
+			char *end = NULL;
+			long interval = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || interval < 0 ||
+					interval > RATE_BACKOFF_MAX_MS) {
+				fprintf(stderr, "Invalid send interval: %s\n", optarg);
+				return 2;
+			}
+			rate.min_interval_ms = rate.interval_ms = (int)interval;
+			break;
+		}
 		case 'w':
 		{
 			char *end = NULL;
@@ -297,6 +2416,21 @@ int main(int argc, char* argv[])
 		}
 		case 'f': dateformat = optarg; break;
 		case 'j': jsonoutput = 1; break;
+		case 'M':
+		{
+			char *end = NULL;
+			long expiry = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || expiry < 1 ||
+					expiry > 30 * 86400) {
+				fprintf(stderr, "Invalid merge expiry: %s\n", optarg);
+				return 2;
+			}
+			merge_expiry_s = (int)expiry;
+			break;
+		}
+		case 'n': incremental = 1; break;
+		case 'x': merge_delete = 1; break;
+		case OPT_CONSUME: consume_output = 1; break;
 		case 'R': rawinput = 1; break;
 		case 'r': rawoutput = 1; break;
 		default:
@@ -312,11 +2446,13 @@ int main(int argc, char* argv[])
 	{
 		if(argc < 3)
 			usage();
+	}else if (!strcmp("batch", argv[0]) || !strcmp("sendpdu", argv[0]))
+	{
 	}else if (!strcmp("delete",argv[0]))
 	{
-		if(argc < 2)
+		if(argc < 2 || (!strcmp("range", argv[1]) && argc < 4))
 			usage();
-	}else if (!strcmp("recv", argv[0]))
+	}else if (!strcmp("recv", argv[0]) || !strcmp("listen", argv[0]))
 	{
 	}else if (!strcmp("status", argv[0]))
 	{
@@ -352,8 +2488,8 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-	FILE* pf = fdopen(port, "w");
-	FILE* pfi = fdopen(port, "r");
+	pf = fdopen(port, "w");
+	pfi = fdopen(port, "r");
 	if (!pf || !pfi) {
 		fprintf(stderr, "fdopen(%s): %s\n", dev, strerror(errno));
 		return 1;
@@ -362,7 +2498,9 @@ int main(int argc, char* argv[])
 	{
 		fprintf(stderr, "failed to make serial port linebuffered\n");
 	}
-	if(!strcmp("at", argv[0]) && setvbuf(pfi, NULL, _IONBF, 0))
+	if((!strcmp("at", argv[0]) || !strcmp("listen", argv[0]) ||
+			report_wait_s > 0) &&
+			setvbuf(pfi, NULL, _IONBF, 0))
 	{
 		fprintf(stderr, "failed to make serial port unbuffered\n");
 	}
@@ -370,304 +2508,218 @@ int main(int argc, char* argv[])
 	char buf[1024];
 	if (!strcmp("send", argv[0]))
 	{
-		const unsigned char reference_number =
-			(unsigned char)(time(NULL) ^ getpid());
-		int total_parts = 0;
-		int pdu_len = pdu_encode_multipart("", argv[1], argv[2],
-						 reference_number, 1, &total_parts,
-						 pdu, sizeof(pdu));
-		if (pdu_len < 0) {
-			fprintf(stderr, "error encoding to PDU: %s \"%s\"\n",
-				argv[1], argv[2]);
+		if (set_pdu_mode() < 0)
 			return 1;
-		}
-
-		alarm(30);
-		if (fputs("AT+CMGF=0\r\n", pf) == EOF)
+		if (report_wait_s > 0 && enable_status_reports() < 0)
 			return 1;
-		int pdu_mode_ready = 0;
-		while(fgets(buf, sizeof(buf), pfi)) {
-			if(starts_with("OK", buf)) {
-				pdu_mode_ready = 1;
-				break;
-			}
-			if(starts_with("ERROR", buf) || starts_with("+CMS ERROR:", buf)) {
-				fprintf(stderr, "failed to enable PDU mode: %s", buf);
+		int failed = send_message(NULL, 0, argv[1], argv[2], debug);
+		if (report_wait_s > 0 && !failed)
+			failed = wait_reports();
+		return failed;
+	}
+
+	if (!strcmp("sendpdu", argv[0]))
+	{
+		FILE* input = stdin;
+		if (argc > 1 && strcmp("-", argv[1])) {
+			input = fopen(argv[1], "r");
+			if (!input) {
+				fprintf(stderr, "open(%s): %s\n", argv[1], strerror(errno));
 				return 1;
 			}
 		}
-		if (!pdu_mode_ready) {
-			fprintf(stderr, "no response while enabling PDU mode\n");
+		if (set_pdu_mode() < 0)
 			return 1;
-		}
-		for (int part_number = 1; part_number <= total_parts; ++part_number) {
-			if (part_number > 1) {
-				int encoded_total_parts;
-				pdu_len = pdu_encode_multipart("", argv[1], argv[2],
-							       reference_number, part_number,
-							       &encoded_total_parts, pdu,
-							       sizeof(pdu));
-				if (pdu_len < 0 || encoded_total_parts != total_parts) {
-					fprintf(stderr, "error encoding SMS part %d/%d\n",
-						part_number, total_parts);
-					return 1;
+		if (report_wait_s > 0 && enable_status_reports() < 0)
+			return 1;
+
+		struct line_reader reader = {
+			.fd = fileno(input),
+			.notify_fd = report_wait_s > 0 ? fileno(pfi) : -1,
+		};
+		char* line = NULL;
+		int line_number = 0;
+		int skip_id = 0;
+		int message = -1;
+		int failed = 0;
+		for (;;) {
+			int rc = read_line(&reader, -1, &line);
+			if (rc < 0)
+				break;
+			if (rc == 2)
+				poll_urcs(0);
+			if (rc != 1)
+				continue;
+			++line_number;
+			if (line[0] == '\0')
+				continue;
+
+			int id = line_number;
+			int part_number = 1;
+			int total_parts = 1;
+			char* hex = strrchr(line, '\t');
+			if (hex) {
+				if (sscanf(line, "%d\t%d/%d\t", &id, &part_number,
+						&total_parts) != 3 || part_number < 1 ||
+						part_number > total_parts) {
+					fprintf(stderr, "line %d: expected id<TAB>part/total<TAB>pdu\n",
+						line_number);
+					failed = 1;
+					continue;
 				}
+				hex++;
+			} else {
+				hex = line;
 			}
+			if (part_number > 1 && id == skip_id)
+				continue;
+			skip_id = 0;
 
-			const int pdu_len_except_smsc = pdu_len - 1 - pdu[0];
-			snprintf(cmdstr, sizeof(cmdstr), "AT+CMGS=%d\r\n",
-				 pdu_len_except_smsc);
-			int i;
-			for (i = 0; i < pdu_len; ++i)
-				sprintf(pdustr + 2 * i, "%02X", pdu[i]);
-			sprintf(pdustr + 2 * i, "%c\r\n", 0x1A);
-
-			alarm(30);
-			if (fputs(cmdstr, pf) == EOF)
-				return 1;
-			sleep(1);
-			if (fputs(pdustr, pf) == EOF)
-				return 1;
+			int pdu_len = pdu_hex_decode(hex, strlen(hex), pdu, sizeof(pdu));
+			if (pdu_len < 2 || 1 + pdu[0] >= pdu_len) {
+				fprintf(stderr, "line %d: invalid PDU\n", line_number);
+				failed = 1;
+				skip_id = id;
+				continue;
+			}
 
-			errno = 0;
-			int cmgs_received = 0;
-			while(fgets(buf, sizeof(buf), pfi)) {
-				if(starts_with("+CMGS:", buf)) {
-					cmgs_received = 1;
-					if (total_parts == 1)
-						printf("sms sent successfully: %s", buf + 7);
-					else
-						printf("sms part %d/%d sent successfully: %s",
-						       part_number, total_parts, buf + 7);
-				} else if(starts_with("+CMS ERROR:", buf)) {
-					fprintf(stderr,"sms not sent, code: %s\n", buf + 11);
-					return 1;
-				} else if(starts_with("ERROR", buf)) {
-					fprintf(stderr,"sms not sent, command error\n");
-					return 1;
-				} else if(starts_with("OK", buf) && cmgs_received) {
-					break;
-				}
+			char number[40];
+			const char* recipient = NULL;
+			if (report_wait_s > 0 &&
+					submit_recipient(pdu, pdu_len, number, sizeof(number)) == 0)
+				recipient = number;
+			if (part_number == 1)
+				message = recipient ? track_message(&id, 1, total_parts) : -1;
+			if (send_part(&id, 1, recipient, pdu, pdu_len, part_number,
+					total_parts, message, debug) != 0) {
+				failed = 1;
+				skip_id = id;
 			}
-			if (!cmgs_received) {
-				fprintf(stderr, "reading port: %s\n", strerror(errno));
+		}
+		free(reader.buf);
+		if (report_wait_s > 0)
+			failed |= wait_reports();
+		rate_report();
+		return failed;
+	}
+
+	if (!strcmp("batch", argv[0]))
+	{
+		FILE* input = stdin;
+		if (argc > 1 && strcmp("-", argv[1])) {
+			input = fopen(argv[1], "r");
+			if (!input) {
+				fprintf(stderr, "open(%s): %s\n", argv[1], strerror(errno));
 				return 1;
 			}
 		}
-		alarm(0);
-		return 0;
+		if (set_pdu_mode() < 0)
+			return 1;
+		if (report_wait_s > 0 && enable_status_reports() < 0)
+			return 1;
+
+		struct line_reader reader = {
+			.fd = fileno(input),
+			.notify_fd = report_wait_s > 0 ? fileno(pfi) : -1,
+		};
+		char* line = NULL;
+		int id = 0;
+		int failed = 0;
+		for (;;) {
+			int rc = read_line(&reader, coalesce_timeout(), &line);
+			if (rc < 0)
+				break;
+			failed |= coalesce_flush(0, debug);
+			if (rc == 2)
+				poll_urcs(0);
+			if (rc != 1)
+				continue;
+			++id;
+			if (line[0] == '\0')
+				continue;
+			char* text = strchr(line, '\t');
+			if (!text) {
+				fprintf(stderr, "line %d: expected phoneNumber<TAB>message\n", id);
+				failed = 1;
+				continue;
+			}
+			*text++ = '\0';
+			failed |= coalesce_add(id, line, text, debug);
+		}
+		failed |= coalesce_flush(1, debug);
+		free(reader.buf);
+		if (report_wait_s > 0)
+			failed |= wait_reports();
+		rate_report();
+		return failed;
 	}
 
 	if (!strcmp("recv", argv[0]))
 	{
 		alarm(10);
-		if (strlen(storage) > 0) {
-			fputs("AT+CPMS=\"", pf);
-			fputs(storage, pf);
-			fputs("\"\r\n", pf);
-			while(fgets(buf, sizeof(buf), pfi)) {
-				if(starts_with("OK", buf))
-					break;
-			}
-		}
+		select_storage();
 		fputs("AT+CMGF=0\r\n", pf);
 		while(fgets(buf, sizeof(buf), pfi)) {
 			if(starts_with("OK", buf))
 				break;
 		}
-		fputs("AT+CMGL=4\r\n", pf);
-		int idx[1024];
-		int count  = 0;
+		if (merge_expiry_s > 0 && open_part_store() < 0)
+			return 1;
+		if (incremental && open_seen_state() < 0)
+			return 1;
 		if(jsonoutput == 1) {
 			printf("{\"msg\":[");
 		}
-		while(fgets(buf, sizeof buf, pfi))
-		{
-			if(starts_with("OK", buf))
-				break;
-			if(starts_with("+CMGL:", buf))
-			{
-				if(sscanf(buf, "+CMGL: %d,", &idx[count]) != 1)
-				{
-					fprintf(stderr, "unparsable CMGL response: %s\n", buf+7);
-					continue;
-				}
-				if(!fgets(buf, sizeof buf, pfi))
-					fprintf(stderr,"reading pdu %d\n", count);
-
-				if(jsonoutput == 1) {
-					if (count > 0) {
-						printf(",");
-					}
-					printf("{\"index\":%d,",idx[count]);
-				} else {
-					printf("MSG: %d\n",idx[count]);
-				}
-
-				++count;
-
-				if(rawoutput == 1)
-				{
-					if(jsonoutput == 1) {
-						printf("\"content\":\"%s\"", buf);
-					} else {
-						printf("%s\n", buf);
-					}
-					continue;
-				}
-
-				int l = strlen(buf);
-				int i;
-				for(i = 0; i < l; i+=2)
-					pdu[i/2] = 16*char_to_hex(buf[i]) + char_to_hex(buf[i+1]);
-
-				time_t sms_time;
-				char phone_str[40];
-				char sms_txt[322];
-
-				int tp_dcs_type;
-				int ref_number;
-				int total_parts;
-				int part_number;
-				int skip_bytes;
-
-				int sms_len = pdu_decode(pdu, l/2, &sms_time, phone_str, sizeof(phone_str), sms_txt, sizeof(sms_txt),&tp_dcs_type,&ref_number,&total_parts,&part_number,&skip_bytes);
-				if (sms_len <= 0) {
-					fprintf(stderr, "error decoding pdu %d: %s\n", count-1, buf);
-					if(jsonoutput == 1) {
-						printf("\"error\":\"error decoding pdu\",\"sender\":\"\",\"timestamp\":\"\",\"content\":\"\"}");
-					}
-					continue;
-				}
-
-				if(jsonoutput == 1) {
-					printf("\"sender\":\"%s\",",phone_str);
-				} else {
-					printf("From: %s\n",phone_str);
-				}
-				char time_data_str[64];
-				strftime(time_data_str, 64, dateformat, gmtime(&sms_time));
-				if(jsonoutput == 1) {
-					printf("\"timestamp\":\"%s\",",time_data_str);
-				} else {
-					printf("Date/Time: %s\n",time_data_str);
-				}
-
-				if(total_parts > 0) {
-					if(jsonoutput == 1) {
-						printf("\"reference\":%d,\"part\":%d,\"total\":%d,", ref_number, part_number, total_parts);
-					} else {
-						printf("Reference number: %d\n", ref_number);
-						printf("SMS segment %d of %d\n", part_number, total_parts);
-					}
-				}
-
-				if(jsonoutput == 1) {
-					printf("\"content\":\"");
-				}
-				switch((tp_dcs_type / 4) % 4)
-				{
-					case 0:
-					{
-						// GSM 7 bit
-						int i = skip_bytes;
-						if(skip_bytes > 0) i = (skip_bytes*8+6)/7;
-						for(; i<sms_len; i++)
-						{
-							if(jsonoutput == 1) {
-								if ((unsigned char)sms_txt[i] == 0xCE) {
-									unsigned int codepoint = 
-										(((unsigned char)sms_txt[i] & 0x1F) << 6) | 
-										((unsigned char)sms_txt[i + 1] & 0x3F);
-									printf("\\u%04X", codepoint);
-									i++;
-								} else {
-									print_json_escape_char(0x0, sms_txt[i]);
-								}
-							} else {
-								printf("%c", sms_txt[i]);
-							}
-						}
-						break;
-					}
-					case 2:
-					{
-						// UCS2
-						for(int i = skip_bytes;i<sms_len;i+=2)
-						{
-							if(jsonoutput == 1) {
-								print_json_escape_char(sms_txt[i],sms_txt[i+1]);
-							} else {
-								int ucs2_char = 0x000000FF&sms_txt[i+1];
-								ucs2_char|=(0x0000FF00&(sms_txt[i]<<8));
-								unsigned char utf8_char[5];
-								int len = ucs2_to_utf8(ucs2_char,utf8_char);
-								int j;
-								for(j=0;j<len;j++)
-								{
-									printf("%c", utf8_char[j]);
-								}
-							}
-						}
-						break;
-					}
-					default:
-						break;
-				}
-				if(jsonoutput == 1) {
-					printf("\"}");
-				} else {
-					printf("\n\n");
-				}
-			}
-		}
+		if (incremental)
+			recv_new(jsonoutput, rawoutput);
+		else
+			list_messages(4, jsonoutput, rawoutput);
+		if (merge_expiry_s > 0)
+			merge_parts(jsonoutput);
 		if(jsonoutput == 1) {
 			printf("]}\n");
 		}
+		int failed = delete_consumed() < 0;
+		if (incremental) {
+			fflush(stdout);
+			save_seen_state();
+		}
+		return failed;
+	}
 
+	if (!strcmp("listen", argv[0]))
+	{
+		alarm(10);
+		if (select_listen_storage() < 0 || set_pdu_mode() < 0)
+			return 1;
+		if (merge_expiry_s > 0 && open_part_store() < 0)
+			return 1;
+		if (incremental && open_seen_state() < 0)
+			return 1;
+		return listen_messages(incremental, direct, rawoutput);
 	}
 
 	if (!strcmp("delete",argv[0]))
 	{
-		int i = atoi(argv[1]);
-		int j = i;
-		if(!strcmp("all",argv[1]))
-		{
-			i = 0;
-			j = 49;
-		}
-		printf("delete msg from %d to %d\n",i,j);
-		for(;i<=j;i++)
-		{
-			fprintf(pf, "AT+CMGD=%d\r\n", i);
-			while(fgets(buf, sizeof buf, pfi))
-			{
-				if(starts_with("OK", buf))
-				{
-					printf("Deleted message %d\n", i);
-					break;
-				}
-				if(starts_with("+CMS ERROR:", buf))
-				{
-					printf("Error deleting message %d: %s\n", i, buf+12);
-					break;
-				}
-			}
-		}
+		alarm(10);
+		select_storage();
+		/* The AT+CMGL fallback lists by numeric stat. */
+		if (set_pdu_mode() < 0)
+			return 1;
+		if (!strcmp("all", argv[1]))
+			return delete_messages(4);
+		if (!strcmp("read", argv[1]))
+			return delete_messages(1);
+		if (!strcmp("range", argv[1]))
+			return delete_range(atoi(argv[2]), atoi(argv[3]));
+		const int index = atoi(argv[1]);
+		return delete_indexes(&index, 1);
 	}
 
 	if (!strcmp("status", argv[0]))
 	{
 		alarm(10);
-		if (strlen(storage) > 0) {
-			fputs("AT+CPMS=\"", pf);
-			fputs(storage, pf);
-			fputs("\"\r\n", pf);
-			while(fgets(buf, sizeof(buf), pfi)) {
-				if(starts_with("OK", buf))
-					break;
-			}
-		}
+		select_storage();
 		fputs("AT+CPMS?\r\n", pf);
 		while(fgets(buf, sizeof buf, pfi))
 		{
@@ -708,8 +2760,7 @@ int main(int argc, char* argv[])
 			if (pdu_len > 0)
 			{
 				if (pdu[pdu_len - 1] == 0) {pdu[pdu_len - 1] = 0x1d;}
-				for (int i = 0; i < pdu_len; ++i)
-					sprintf(pdustr+2*i, "%02X", pdu[i]);
+				pdu_hex_encode(pdu, pdu_len, pdustr);
 				snprintf(cmdstr, sizeof(cmdstr), "AT+CUSD=1,\"%s\",15\r\n", pdustr);
 			}
 			else
@@ -767,7 +2818,8 @@ int main(int argc, char* argv[])
 				break;
 			}
 
-			int pdu_length = decode_hex(ussd_buf, pdu, sizeof(pdu));
+			int pdu_length = pdu_hex_decode(ussd_buf, strlen(ussd_buf),
+							pdu, sizeof(pdu));
 			if (pdu_length < 0) {
 				/* Some modems return already-decoded text instead of hex. */
 				printf("%s\n", ussd_buf);
@@ -834,13 +2886,18 @@ int main(int argc, char* argv[])
 				{
 					case SMS_CHARSET_7BIT:
 					{
-						// GSM 7 bit
-						int l = DecodePDUMessage_GSM_7bit(pdu, pdu_length,
+						// GSM 7 bit. A reply filling 7n octets ends
+						// with a padding septet, CR or by some
+						// networks 0 (23.038 6.1.2.3.1).
+						int septets = pdu_length * 8 / 7;
+						if (pdu_length > 0 && pdu_length % 7 == 0 &&
+						    ((pdu[pdu_length - 1] >> 1) == '\r' ||
+						     (pdu[pdu_length - 1] >> 1) == 0))
+							septets--;
+						int l = pdu_decode_gsm7(pdu, pdu_length, 0,
+								septets,
 								(char *)ussd_txt, sizeof(ussd_txt));
 						if (l > 0) {
-							if ((size_t)l < sizeof(ussd_txt))
-								ussd_txt[l] = 0;
-
 							printf("%s\n", (char *)ussd_txt);
 						} else {
 							fprintf(stderr, "error decoding pdu: %s\n", ussd_buf);
@@ -851,24 +2908,10 @@ int main(int argc, char* argv[])
 					case SMS_CHARSET_UCS2:
 					{
 						// UCS2
-						size_t utf_pos = 0;
-						for(int i = 0; i + 1 < pdu_length; i += 2)
-						{
-							int ucs2_char = 0x000000FF&pdu[i+1];
-							ucs2_char|=(0x0000FF00&(pdu[i]<<8));
-							unsigned char encoded[4];
-							int encoded_length = ucs2_to_utf8(ucs2_char, encoded);
-							if (encoded_length <= 0 || utf_pos + encoded_length >= sizeof(ussd_txt)) {
-								utf_pos = 0;
-								break;
-							}
-							memcpy(ussd_txt + utf_pos, encoded, (size_t)encoded_length);
-							utf_pos += (size_t)encoded_length;
-						}
+						size_t utf_pos = ucs2be_to_utf8(pdu, pdu_length,
+								(char *)ussd_txt, sizeof(ussd_txt));
 
 						if (utf_pos > 0) {
-							ussd_txt[utf_pos] = 0;
-
 							printf("%s\n", (char *)ussd_txt);
 						} else {
 							fprintf(stderr, "error decoding pdu: %s\n", ussd_buf);